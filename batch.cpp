@@ -0,0 +1,299 @@
+#include "batch.h"
+#include "buffer.h"
+#include "columns.h"
+#include "editing.h"
+#include "file-io.h"
+#include "kill-ring.h"
+#include "replace.h"
+#include "search.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iterator>
+#include <string_view>
+
+/**Parses a whole (non-empty) string of digits*/
+static bool parse_number(std::string_view text, std::size_t &number)
+{
+    const auto end = text.data() + text.size();
+    const auto [last, error] = std::from_chars(text.data(), end, number);
+    return !text.empty() && error == std::errc() && last == end;
+}
+
+/**The text typed by a type command, with its escapes turned into the
+   characters they stand for*/
+static std::string unescape(std::string_view text)
+{
+    std::string result;
+    for(std::size_t i = 0; i < text.size(); ++i) {
+        if(text[i] != '\\' || i + 1 == text.size()) {
+            result.push_back(text[i]);
+            continue;
+        }
+        switch(text[++i]) {
+        case 'n':
+            result.push_back('\n');
+            break;
+        case 't':
+            result.push_back('\t');
+            break;
+        default:
+            result.push_back(text[i]);
+        }
+    }
+    return result;
+}
+
+bool Script::load(const char *filename, std::string &error)
+{
+    std::vector<char> contents;
+    if(!read_file(filename, contents)) {
+        error = std::string("Can't read ") + filename;
+        return false;
+    }
+    m_commands.clear();
+    std::size_t line_number = 0;
+    for(auto first = contents.begin(); first != contents.end();) {
+        const auto last = std::find(first, contents.end(), '\n');
+        std::string line(first, last);
+        first = last == contents.end() ? last : std::next(last);
+        ++line_number;
+        if(!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if(line.empty() || line[0] == '#')
+            continue;
+        Command command;
+        command.line = line_number;
+        if(!parse(line, command, error)) {
+            error = "Line " + std::to_string(line_number) + " of " + filename + ": " + error;
+            return false;
+        }
+        m_commands.push_back(std::move(command));
+    }
+    return true;
+}
+
+bool Script::parse(const std::string &line, Command &command, std::string &error)
+{
+    // What each command takes after its name
+    enum class Argument : char { None, Count, Line, Text, Pattern };
+    struct Name {
+        std::string_view name;
+        Command::Kind kind;
+        Argument argument;
+    };
+    static constexpr Name names[] = {
+        {"type", Command::Kind::Type, Argument::Text},
+        {"enter", Command::Kind::Enter, Argument::None},
+        {"backspace", Command::Kind::Backspace, Argument::Count},
+        {"left", Command::Kind::Left, Argument::Count},
+        {"right", Command::Kind::Right, Argument::Count},
+        {"up", Command::Kind::Up, Argument::Count},
+        {"down", Command::Kind::Down, Argument::Count},
+        {"home", Command::Kind::Home, Argument::None},
+        {"end", Command::Kind::End, Argument::None},
+        {"goto", Command::Kind::Goto, Argument::Line},
+        {"find", Command::Kind::Find, Argument::Text},
+        {"replace", Command::Kind::Replace, Argument::Pattern},
+        {"mark", Command::Kind::Mark, Argument::None},
+        {"cut", Command::Kind::Cut, Argument::None},
+        {"copy", Command::Kind::Copy, Argument::None},
+        {"paste", Command::Kind::Paste, Argument::None},
+    };
+
+    const std::string_view text(line);
+    const auto space = text.find(' ');
+    const auto word = text.substr(0, space);
+    const auto rest = space == std::string_view::npos ? std::string_view()
+        : text.substr(space + 1);
+    const auto found = std::find_if(std::begin(names), std::end(names),
+                                    [word](const Name &name) { return name.name == word; });
+    if(found == std::end(names)) {
+        error = "unknown command \"" + std::string(word) + '"';
+        return false;
+    }
+    command.kind = found->kind;
+    switch(found->argument) {
+    case Argument::None:
+        if(!rest.empty()) {
+            error = std::string(word) + " takes nothing after it";
+            return false;
+        }
+        return true;
+    case Argument::Count:
+        if(rest.empty())
+            return true;
+        [[fallthrough]];
+    case Argument::Line:
+        if(!parse_number(rest, command.count) || command.count == 0) {
+            error = std::string(word) + " needs a number (from 1 up)";
+            return false;
+        }
+        return true;
+    case Argument::Text:
+        command.text = command.kind == Command::Kind::Type ? unescape(rest) : std::string(rest);
+        if(command.text.empty()) {
+            error = std::string(word) + " needs some text";
+            return false;
+        }
+        return true;
+    case Argument::Pattern: {
+        // e.g. /old/new/, where the first character marks where each part ends
+        const auto middle = rest.empty() ? std::string_view::npos : rest.find(rest[0], 1);
+        const auto end = middle == std::string_view::npos ? middle
+            : rest.find(rest[0], middle + 1);
+        if(end == std::string_view::npos || end + 1 != rest.size() || middle == 1) {
+            error = "replace needs the text to replace and its replacement, as in /old/new/";
+            return false;
+        }
+        command.text = rest.substr(1, middle - 1);
+        command.replacement = rest.substr(middle + 1, end - middle - 1);
+        return true;
+    }
+    }
+    return true;
+}
+
+BatchResult Script::run(const char *filename) const
+{
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    BatchResult result;
+    const auto finish = [&](std::string error) {
+        result.ok = error.empty();
+        result.error = std::move(error);
+        result.milliseconds
+            = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        return result;
+    };
+
+    std::vector<char> contents;
+    if(!read_file(filename, contents))
+        return finish("can't read the file");
+    Buffer buffer;
+    // Each row keeps where it came from, so saving can copy rows left alone
+    const char *data = contents.data();
+    const char *data_end = data + contents.size();
+    for(const char *row = data;;) {
+        const char *newline = std::find(row, data_end, '\n');
+        buffer.append(row, newline, row - data);
+        if(newline == data_end)
+            break;
+        row = newline + 1;
+    }
+    std::vector<char>().swap(contents);
+    bool changed = false;
+    buffer.on_change([&changed](Buffer::RowChange, std::size_t, Buffer::iterator) {
+        changed = true;
+    });
+
+    Position place{buffer.begin(), 0, 0};
+    bool marked = false;
+    std::size_t mark_row = 0;
+    std::size_t mark_col = 0;
+    Clip clip;
+    bool have_clip = false;
+    std::string erased;
+    for(const auto &command : m_commands) {
+        const auto fail = [&](const std::string &error) {
+            return finish("line " + std::to_string(command.line) + ": " + error);
+        };
+        changed = false;
+        switch(command.kind) {
+        case Command::Kind::Type: {
+            std::string_view text(command.text);
+            for(auto newline = text.find('\n'); newline != std::string_view::npos;
+                newline = text.find('\n')) {
+                if(newline > 0)
+                    place = insert_text(buffer, nullptr, place, text.substr(0, newline));
+                place = split_row(buffer, nullptr, place);
+                text.remove_prefix(newline + 1);
+            }
+            if(!text.empty())
+                place = insert_text(buffer, nullptr, place, text);
+            break;
+        }
+        case Command::Kind::Enter:
+            place = split_row(buffer, nullptr, place);
+            break;
+        case Command::Kind::Backspace:
+            for(std::size_t i = 0; i < command.count; ++i)
+                place = erase_char_before(buffer, nullptr, place, erased);
+            break;
+        case Command::Kind::Left:
+            for(std::size_t i = 0; i < command.count; ++i)
+                move_left(buffer, nullptr, place);
+            break;
+        case Command::Kind::Right:
+            for(std::size_t i = 0; i < command.count; ++i)
+                move_right(buffer, nullptr, place);
+            break;
+        case Command::Kind::Up:
+        case Command::Kind::Down:
+            for(std::size_t i = 0; i < command.count; ++i)
+                move_vertically(buffer, nullptr, place, command.kind == Command::Kind::Down,
+                                place.row_it->column_of(place.col));
+            break;
+        case Command::Kind::Home:
+            place.col = 0;
+            break;
+        case Command::Kind::End:
+            place.col = place.row_it->size();
+            break;
+        case Command::Kind::Goto: {
+            const auto row = std::min(command.count, buffer.size()) - 1;
+            place = {std::next(buffer.begin(), row), row, 0};
+            break;
+        }
+        case Command::Kind::Find: {
+            Query query(command.text, false);
+            Position match;
+            if(!find_next(buffer, place, query, match))
+                return fail("\"" + command.text + "\" not found");
+            place = match;
+            place.col += command.text.size();
+            break;
+        }
+        case Command::Kind::Replace:
+            replace_at(buffer, find_all(buffer, command.text), command.text.size(),
+                       command.replacement);
+            // Its row may be shorter now
+            place.col = 0;
+            break;
+        case Command::Kind::Mark:
+            marked = true;
+            mark_row = place.row;
+            mark_col = place.col;
+            break;
+        case Command::Kind::Cut:
+        case Command::Kind::Copy: {
+            if(!marked)
+                return fail("nothing is marked");
+            marked = false;
+            clip = {buffer.snapshot(),
+                    region_between(mark_row, mark_col, place.row, place.col)};
+            have_clip = true;
+            if(command.kind == Command::Kind::Copy)
+                break;
+            const auto &region = clip.region;
+            place = cut_region(buffer, nullptr, std::next(buffer.begin(), region.first_row),
+                               region);
+            break;
+        }
+        case Command::Kind::Paste: {
+            if(!have_clip)
+                return fail("nothing has been cut or copied");
+            place = insert_clip(buffer, nullptr, place, clip);
+            break;
+        }
+        }
+        if(changed) {
+            ++result.edits;
+            // The marked place may not be there anymore
+            marked = false;
+        }
+    }
+    if(result.edits > 0 && !save(buffer, filename))
+        return finish("can't save the file");
+    return finish(std::string());
+}
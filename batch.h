@@ -0,0 +1,62 @@
+#ifndef BATCH_H
+#define BATCH_H
+#include <string>
+#include <vector>
+
+/**How running a script on one file went*/
+struct BatchResult {
+    bool ok = true;
+    // What went wrong (and on which line of the script), if anything
+    std::string error;
+    // How many of the script's commands changed the text
+    std::size_t edits = 0;
+    // Time taken to load, edit and save the file
+    double milliseconds = 0;
+};
+
+/**Edits to make to files without a terminal ("editorial --batch"). A script
+   has one command per line, each acting at a cursor that starts at the top
+   of the file, the way the keys they are named after would in the editor:
+
+       type TEXT       put in TEXT (\n, \t and \\ are a newline, tab and \)
+       enter           split the line at the cursor
+       backspace [N]   erase the character before the cursor (N times)
+       left/right/up/down [N]
+       home / end      go to the start/end of the line
+       goto LINE       go to the start of a line, counting from 1
+       find TEXT       go to just after the next match of TEXT, wrapping
+                       around; the file fails if there is none
+       replace /A/B/   replace every A with B (any character can stand in
+                       for the /), leaving the cursor at the start of its line
+       mark            start selecting at the cursor; any command that
+                       changes the text drops the mark
+       cut / copy      take the text between the mark and the cursor
+       paste           put in the text cut or copied last
+
+   Blank lines and lines starting with # are skipped. A file is only saved
+   if every command worked and some of them changed it. Scripts hold no
+   state besides their commands, so one can be run on many files at once*/
+class Script {
+public:
+    /**Reads the script from a file; on failure, error says why*/
+    bool load(const char *filename, std::string &error);
+    BatchResult run(const char *filename) const;
+private:
+    struct Command {
+        enum class Kind : char {
+            Type, Enter, Backspace, Left, Right, Up, Down, Home, End, Goto, Find,
+            Replace, Mark, Cut, Copy, Paste
+        };
+        Kind kind;
+        std::size_t count = 1;
+        std::string text;
+        std::string replacement;
+        // Where it is in the script, counting from 1
+        std::size_t line;
+    };
+
+    std::vector<Command> m_commands;
+
+    static bool parse(const std::string &line, Command &command, std::string &error);
+};
+#endif
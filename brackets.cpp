@@ -0,0 +1,226 @@
+#include "brackets.h"
+#include <algorithm>
+
+static bool is_opener(char bracket)
+{
+    return bracket == '(' || bracket == '[' || bracket == '{';
+}
+
+/**The bracket that closes/opens the given one*/
+static char counterpart(char bracket)
+{
+    switch(bracket) {
+    case '(': return ')';
+    case '[': return ']';
+    case '{': return '}';
+    case ')': return '(';
+    case ']': return '[';
+    default: return '{';
+    }
+}
+
+BracketSummary operator+(const BracketSummary &first, const BracketSummary &second)
+{
+    BracketSummary sum;
+    for(std::size_t state = 0; state < BracketSummary::EntryStates; ++state) {
+        const auto &before = first.spans[state];
+        const auto &after = second.spans[before.end_state];
+        sum.spans[state].depth = before.depth + after.depth;
+        sum.spans[state].min_depth = std::min(before.min_depth,
+                                              before.depth + after.min_depth);
+        sum.spans[state].end_state = after.end_state;
+    }
+    return sum;
+}
+
+BracketSummary BracketIndex::summarize(const char *first, const char *last) const
+{
+    BracketSummary summary;
+    for(std::size_t state = 0; state < BracketSummary::EntryStates; ++state) {
+        // Rows never start in states with bits that aren't carried over
+        if((state & m_mode.carried) != state)
+            continue;
+        auto &span = summary.spans[state];
+        span = m_mode.brackets(state, first, last, nullptr);
+        span.end_state &= m_mode.carried;
+    }
+    return summary;
+}
+
+void BracketIndex::build(const Buffer &buffer)
+{
+    if(m_built)
+        return;
+    std::vector<BracketSummary> rows;
+    rows.reserve(buffer.size());
+    for(const auto &row : buffer)
+        rows.push_back(summarize(row.begin(), row.end()));
+    m_rows.assign(rows);
+    m_built = true;
+}
+
+void BracketIndex::update(Buffer::RowChange change, std::size_t row, const BufferRow &text)
+{
+    if(!m_built)
+        return;
+    switch(change) {
+    case Buffer::RowChange::Inserted:
+        m_rows.insert(row, summarize(text.begin(), text.end()));
+        break;
+    case Buffer::RowChange::Changed:
+        m_rows.set(row, summarize(text.begin(), text.end()));
+        break;
+    case Buffer::RowChange::Erased:
+        m_rows.erase(row);
+        break;
+    }
+}
+
+BracketIndex::RowStart BracketIndex::row_start(std::size_t row) const
+{
+    // The file starts outside of any string/comment
+    const auto before = m_rows.prefix(row).spans[0];
+    return {before.end_state, before.depth};
+}
+
+void BracketIndex::scan(const RowText &text, std::size_t row,
+                        std::vector<std::size_t> &offsets,
+                        std::vector<std::int32_t> &depths) const
+{
+    const auto start = row_start(row);
+    offsets.clear();
+    depths.clear();
+    m_mode.brackets(start.state, text.data(), text.data() + text.size(), &offsets);
+    auto depth = start.depth;
+    for(const auto offset : offsets) {
+        depths.push_back(depth);
+        depth += is_opener(text.data()[offset]) ? 1 : -1;
+    }
+}
+
+/**Whether the brackets somewhere in a run of rows (coming after the rows
+   summed up by before) get as shallow as depth*/
+static bool reaches(const BracketSummary &before, const BracketSummary &run,
+                    std::int32_t depth)
+{
+    const auto &start = before.spans[0];
+    return start.depth + run.spans[start.end_state].min_depth <= depth;
+}
+
+bool BracketIndex::find_opener(const Snapshot &rows, std::size_t row, std::size_t col,
+                               std::int32_t depth, Place &opener) const
+{
+    std::vector<std::size_t> offsets;
+    std::vector<std::int32_t> depths;
+    const auto *text = &rows.row(row);
+    scan(*text, row, offsets, depths);
+    for(auto i = offsets.size(); i-- > 0;) {
+        if(offsets[i] < col && is_opener(text->data()[offsets[i]]) && depths[i] == depth) {
+            opener = {row, offsets[i]};
+            return true;
+        }
+    }
+    // Every row in between stays deeper, and the opener is on the last one
+    // that doesn't (where the depth last goes back up)
+    row = m_rows.find_prev(row, [depth](const BracketSummary &before,
+                                        const BracketSummary &run) {
+        return reaches(before, run, depth);
+    });
+    if(row == m_rows.NoRow)
+        return false;
+    text = &rows.row(row);
+    scan(*text, row, offsets, depths);
+    for(auto i = offsets.size(); i-- > 0;) {
+        if(is_opener(text->data()[offsets[i]]) && depths[i] == depth) {
+            opener = {row, offsets[i]};
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BracketIndex::find_closer(const Snapshot &rows, std::size_t row, std::size_t col,
+                               std::int32_t depth, Place &closer) const
+{
+    std::vector<std::size_t> offsets;
+    std::vector<std::int32_t> depths;
+    const auto *text = &rows.row(row);
+    scan(*text, row, offsets, depths);
+    for(std::size_t i = 0; i < offsets.size(); ++i) {
+        if(offsets[i] > col && !is_opener(text->data()[offsets[i]])
+           && depths[i] == depth + 1) {
+            closer = {row, offsets[i]};
+            return true;
+        }
+    }
+    // The closer is on the first row after this one whose depth drops
+    row = m_rows.find_next(row + 1, [depth](const BracketSummary &before,
+                                            const BracketSummary &run) {
+        return reaches(before, run, depth);
+    });
+    if(row == m_rows.NoRow)
+        return false;
+    text = &rows.row(row);
+    scan(*text, row, offsets, depths);
+    for(std::size_t i = 0; i < offsets.size(); ++i) {
+        if(!is_opener(text->data()[offsets[i]]) && depths[i] == depth + 1) {
+            closer = {row, offsets[i]};
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BracketIndex::find_match(const Snapshot &rows, std::size_t row, std::size_t col,
+                              Place &match, bool &mismatched) const
+{
+    std::vector<std::size_t> offsets;
+    std::vector<std::int32_t> depths;
+    const auto &text = rows.row(row);
+    scan(text, row, offsets, depths);
+    const auto at = std::lower_bound(offsets.begin(), offsets.end(), col);
+    if(at == offsets.end() || *at != col)
+        return false;
+    const char bracket = text.data()[col];
+    const auto depth = depths[at - offsets.begin()];
+    const bool found = is_opener(bracket) ? find_closer(rows, row, col, depth, match)
+        : find_opener(rows, row, col, depth - 1, match);
+    if(!found) {
+        match = {row, col};
+        mismatched = true;
+    } else {
+        mismatched = rows.row(match.row).data()[match.col] != counterpart(bracket);
+    }
+    return true;
+}
+
+bool BracketIndex::find_enclosing(const Snapshot &rows, std::size_t row, std::size_t col,
+                                  Place &opener) const
+{
+    std::vector<std::size_t> offsets;
+    std::vector<std::int32_t> depths;
+    const auto &text = rows.row(row);
+    scan(text, row, offsets, depths);
+    // The depth at col
+    auto depth = row_start(row).depth;
+    for(std::size_t i = 0; i < offsets.size() && offsets[i] < col; ++i)
+        depth = depths[i] + (is_opener(text.data()[offsets[i]]) ? 1 : -1);
+    return depth > 0 && find_opener(rows, row, col, depth - 1, opener);
+}
+
+bool BracketIndex::find_block(const Snapshot &rows, std::size_t row, Place &opener,
+                              Place &closer) const
+{
+    std::vector<std::size_t> offsets;
+    std::vector<std::int32_t> depths;
+    const auto &text = rows.row(row);
+    scan(text, row, offsets, depths);
+    for(std::size_t i = 0; i < offsets.size(); ++i) {
+        if(text.data()[offsets[i]] == '{'
+           && find_closer(rows, row, offsets[i], depths[i], closer) && closer.row > row) {
+            opener = {row, offsets[i]};
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,91 @@
+#ifndef BRACKETS_H
+#define BRACKETS_H
+#include <array>
+#include <cstddef>
+#include <vector>
+#include "buffer.h"
+#include "syntax-highlight.h"
+#include "row-tree.h"
+
+/**How the brackets in a run of rows nest, for each state the highlighter
+   could be in at the start of the run: every combination of the bits of
+   the state that carry over between rows (which are among the lowest two).
+   Summing up runs this way means a comment or string opened on one row is
+   accounted for on all of the rows after it, without rescanning them*/
+struct BracketSummary {
+    static constexpr std::size_t EntryStates = 4;
+
+    std::array<BracketSpan, EntryStates> spans;
+
+    /**No rows: no brackets, and the state is left alone*/
+    BracketSummary()
+    {
+        for(std::size_t state = 0; state < EntryStates; ++state)
+            spans[state].end_state = state;
+    }
+    friend BracketSummary operator+(const BracketSummary &first,
+                                    const BracketSummary &second);
+};
+
+/**Where the brackets in a buffer are, kept as a summary of each row in a
+   RowTree, so that the bracket matching another (or opening the block
+   around some spot) is found in O(log n) plus the length of the row it is
+   on, however far away it is. Built the first time it is needed, then kept
+   up to date row by row as the buffer changes*/
+class BracketIndex {
+public:
+    struct Place {
+        std::size_t row;
+        std::size_t col;
+    };
+
+    explicit BracketIndex(const HighlightMode &mode) : m_mode(mode) {}
+    /**Whether the mode has brackets to match*/
+    bool enabled() const { return m_mode.brackets != nullptr; }
+    /**Summarizes every row of the buffer, if that hasn't been done yet*/
+    void build(const Buffer &buffer);
+    /**Keeps the index up to date with an edit to the buffer; given to
+       Buffer::on_change()*/
+    void update(Buffer::RowChange change, std::size_t row, const BufferRow &text);
+
+    /**If there is a bracket at byte col of the row (with the given text),
+       returns true and sets match to the bracket that matches it, or to
+       {row, col} if there is none; mismatched is set if the match is the
+       wrong kind of bracket. The index must be built*/
+    bool find_match(const Snapshot &rows, std::size_t row, std::size_t col,
+                    Place &match, bool &mismatched) const;
+    /**Finds the bracket that opens the innermost block around byte col of
+       the row; false if that is outside of every block*/
+    bool find_enclosing(const Snapshot &rows, std::size_t row, std::size_t col,
+                        Place &opener) const;
+    /**Finds the first '{' on the row that is closed on a later row,
+       setting opener and closer to where the block starts and ends; false
+       if no block starts on the row*/
+    bool find_block(const Snapshot &rows, std::size_t row, Place &opener,
+                    Place &closer) const;
+private:
+    // The state at the start of a row and the depth of brackets there
+    struct RowStart {
+        LexState state;
+        std::int32_t depth;
+    };
+
+    const HighlightMode &m_mode;
+    RowTree<BracketSummary> m_rows;
+    bool m_built = false;
+
+    BracketSummary summarize(const char *first, const char *last) const;
+    RowStart row_start(std::size_t row) const;
+    /**The brackets on a row and the depth before each one*/
+    void scan(const RowText &text, std::size_t row, std::vector<std::size_t> &offsets,
+              std::vector<std::int32_t> &depths) const;
+    /**The last opening bracket before byte col of the row (or before the
+       row, if col is 0) with depth brackets open before it*/
+    bool find_opener(const Snapshot &rows, std::size_t row, std::size_t col,
+                     std::int32_t depth, Place &opener) const;
+    /**The first closing bracket after byte col of the row that leaves depth
+       brackets open after it*/
+    bool find_closer(const Snapshot &rows, std::size_t row, std::size_t col,
+                     std::int32_t depth, Place &closer) const;
+};
+#endif
@@ -0,0 +1,269 @@
+#include "buffer.h"
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#ifdef __linux__
+  #include <sys/sendfile.h>
+#endif
+
+// Size of the blocks read from/written to disk at a time
+constexpr std::size_t ChunkSize = 1 << 16;
+
+/**Copies len bytes starting at src_offset in src_fd to the current position
+   of dest_fd without passing them through userspace where possible*/
+static bool copy_range(int src_fd, off_t src_offset, int dest_fd, off_t len)
+{
+#ifdef __linux__
+    bool use_copy_file_range = true;
+    while(len > 0) {
+        ssize_t copied;
+        if(use_copy_file_range) {
+            copied = copy_file_range(src_fd, &src_offset, dest_fd, nullptr, len, 0);
+            if(copied == -1 && (errno == ENOSYS || errno == EXDEV
+                                || errno == EINVAL || errno == EOPNOTSUPP)) {
+                // Filesystem can't do it; sendfile is the next best thing
+                use_copy_file_range = false;
+                continue;
+            }
+        } else {
+            copied = sendfile(dest_fd, src_fd, &src_offset, len);
+        }
+        if(copied == -1 && errno == EINTR)
+            continue;
+        if(copied <= 0)
+            return false;
+        len -= copied;
+    }
+    return true;
+#else
+    std::vector<char> chunk(ChunkSize);
+    while(len > 0) {
+        const ssize_t got = pread(src_fd, chunk.data(),
+                                  std::min<off_t>(len, chunk.size()), src_offset);
+        if(got == -1 && errno == EINTR)
+            continue;
+        if(got <= 0)
+            return false;
+        for(ssize_t done = 0; done < got;) {
+            const ssize_t written = write(dest_fd, chunk.data() + done, got - done);
+            if(written == -1 && errno == EINTR)
+                continue;
+            if(written <= 0)
+                return false;
+            done += written;
+        }
+        src_offset += got;
+        len -= got;
+    }
+    return true;
+#endif
+}
+
+/**Writes out the bytes that have to come from userspace*/
+static bool flush(int fd, std::vector<char> &pending)
+{
+    const char *pos = pending.data();
+    std::size_t remaining = pending.size();
+    while(remaining > 0) {
+        const ssize_t written = write(fd, pos, remaining);
+        if(written == -1) {
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        pos += written;
+        remaining -= written;
+    }
+    pending.clear();
+    return true;
+}
+
+/**Writes the rows to dest_fd. Runs of rows that are unchanged and
+   contiguous in src_fd (the original file, or -1 to write every row from
+   memory) are copied kernel-side; edited rows (and the newlines separating
+   runs) are batched into ordinary writes*/
+static bool write_rows(const Buffer &buffer, int src_fd, int dest_fd)
+{
+    std::vector<char> pending;
+    pending.reserve(ChunkSize);
+    // The run of unchanged bytes in the original file waiting to be copied
+    bool in_run = false;
+    off_t run_start = 0;
+    off_t run_end = 0;
+    // Whether the last row of the run is followed by another row
+    bool run_needs_newline = false;
+    auto end_run = [&]() {
+        if(!in_run)
+            return true;
+        in_run = false;
+        if(!flush(dest_fd, pending)
+           || !copy_range(src_fd, run_start, dest_fd, run_end - run_start))
+            return false;
+        if(run_needs_newline)
+            pending.push_back('\n');
+        return true;
+    };
+
+    bool ok = true;
+    for(auto row = buffer.begin(); ok && row != buffer.end(); ++row) {
+        const bool is_last = std::next(row) == buffer.end();
+        if(src_fd != -1 && row->origin() != BufferRow::NoOrigin) {
+            if(!in_run || row->origin() != run_end + 1) {
+                // Not adjacent to the current run; start a new one
+                ok = end_run();
+                in_run = true;
+                run_start = row->origin();
+            }
+            // Otherwise the newline between the rows is copied with them
+            run_end = row->origin() + row->size();
+            run_needs_newline = !is_last;
+        } else {
+            ok = end_run();
+            pending.insert(pending.end(), row->begin(), row->end());
+            if(!is_last)
+                pending.push_back('\n');
+            if(pending.size() >= ChunkSize)
+                ok = ok && flush(dest_fd, pending);
+        }
+    }
+    return ok && end_run() && flush(dest_fd, pending);
+}
+
+/**Overwrites the file where it is, with every row written from memory:
+   for files a rename would change (hard links, or an owner the new file
+   can't be given) or that sit in a directory that can't be written*/
+static bool save_in_place(const Buffer &buffer, const char *filename, mode_t mode)
+{
+    const int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if(fd == -1)
+        return false;
+    const bool ok = write_rows(buffer, -1, fd) && fsync(fd) == 0;
+    return close(fd) == 0 && ok;
+}
+
+/**Saves by writing into a temporary file next to the original, then renaming
+   it over the original, so a crash part way leaves one or the other whole.
+   A symlink is followed, so it is the file it points to that is replaced.
+   Files that can't be replaced without losing something are written in
+   place instead*/
+bool save(Buffer &buffer, const char *filename)
+{
+    char *resolved = realpath(filename, nullptr);
+    // A new file is made where it was asked for
+    const std::string target(resolved != nullptr ? resolved : filename);
+    std::free(resolved);
+
+    const int src_fd = open(target.c_str(), O_RDONLY);
+    struct stat src_info;
+    const bool exists = src_fd != -1 && fstat(src_fd, &src_info) == 0;
+    const mode_t mode = exists ? src_info.st_mode & 07777 : 0644;
+    const auto slash = target.rfind('/');
+    const std::string directory = slash == std::string::npos ? std::string(".")
+        : target.substr(0, slash + 1);
+    bool ok;
+    if((exists && src_info.st_nlink > 1) || access(directory.c_str(), W_OK) != 0) {
+        ok = save_in_place(buffer, target.c_str(), mode);
+    } else {
+        const std::string temp_name(target + ".editorial-save");
+        const int dest_fd = open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+        if(dest_fd != -1 && exists && fchown(dest_fd, src_info.st_uid, src_info.st_gid) != 0) {
+            // Only the file's owner (or root) can keep it as it is
+            close(dest_fd);
+            unlink(temp_name.c_str());
+            ok = save_in_place(buffer, target.c_str(), mode);
+        } else if(dest_fd == -1) {
+            ok = false;
+        } else {
+            // Synced first, so the rename can't be seen before the contents
+            ok = write_rows(buffer, src_fd, dest_fd) && fsync(dest_fd) == 0;
+            ok = close(dest_fd) == 0 && ok && rename(temp_name.c_str(), target.c_str()) == 0;
+            if(!ok)
+                unlink(temp_name.c_str());
+        }
+    }
+    if(src_fd != -1)
+        close(src_fd);
+    if(!ok)
+        return false;
+
+    // Every row now matches its counterpart in the newly written file
+    off_t offset = 0;
+    for(auto row = buffer.begin(); row != buffer.end(); ++row) {
+        buffer.set_origin(row, offset);
+        offset += row->size() + 1;
+    }
+    return true;
+}
+
+void Buffer::append(const char *first, const char *last, off_t origin)
+{
+    const auto &row = m_rows.emplace_back(first, last, origin);
+    m_unsynced.push_back(row.text());
+    if(m_unsynced.size() == RowNode::MaxEntries)
+        sync();
+    ++m_version;
+    if(!m_on_change.empty())
+        notify(RowChange::Inserted, m_rows.size() - 1, std::prev(m_rows.end()));
+}
+
+Buffer::iterator Buffer::insert_row(iterator pos, std::size_t row)
+{
+    return insert_row(pos, row, RowText());
+}
+
+Buffer::iterator Buffer::insert_row(iterator pos, std::size_t row, RowText text)
+{
+    update_tree();
+    const auto row_it = m_rows.emplace(pos, std::move(text));
+    m_versions.insert(row, row_it->text());
+    ++m_version;
+    notify(RowChange::Inserted, row, row_it);
+    return row_it;
+}
+
+Buffer::iterator Buffer::erase_row(iterator row_it, std::size_t row)
+{
+    notify(RowChange::Erased, row, row_it);
+    update_tree();
+    m_versions.erase(row);
+    ++m_version;
+    return m_rows.erase(row_it);
+}
+
+BufferRow::iterator Buffer::insert(iterator row_it, std::size_t row,
+                                   BufferRow::const_iterator pos, std::size_t count,
+                                   char letter)
+{
+    changing(row_it, row);
+    m_edit = {std::size_t(pos - row_it->begin()), {}, count};
+    const auto result = edit(row_it).insert(pos, count, letter);
+    changed(row_it, row);
+    return result;
+}
+
+BufferRow::iterator Buffer::erase(iterator row_it, std::size_t row,
+                                  BufferRow::const_iterator first,
+                                  BufferRow::const_iterator last)
+{
+    changing(row_it, row);
+    m_erased.assign(first, last);
+    m_edit = {std::size_t(first - row_it->begin()), m_erased, 0};
+    const auto result = edit(row_it).erase(first, last);
+    changed(row_it, row);
+    return result;
+}
+
+void Buffer::assign(iterator row_it, std::size_t row, RowText text)
+{
+    changing(row_it, row);
+    // Kept (not copied) for m_edit.removed until the handlers are done
+    m_replaced = row_it->text();
+    m_edit = {0, {m_replaced.data(), m_replaced.size()}, text.size()};
+    edit(row_it).assign(std::move(text));
+    changed(row_it, row);
+}
@@ -0,0 +1,312 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+#include <vector>
+#include <list>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <algorithm>
+#include <iterator>
+#include "columns.h"
+#include "row-text.h"
+#include "snapshot.h"
+
+/**One line of text. Remembers where it was found in the file on disk so
+   that lines left untouched since the last load/save can be copied
+   straight from the original file instead of being re-serialized. The text
+   may be shared with snapshots, so it is only changed through insert() and
+   erase() (iterators are read-only positions)*/
+class BufferRow {
+public:
+    using value_type = char;
+    using iterator = const char*;
+    using const_iterator = const char*;
+    // Origin of a row that has no unchanged counterpart on disk
+    static constexpr off_t NoOrigin = -1;
+    // Distance in bytes between cached highlighting states
+    static constexpr std::size_t CheckpointInterval = 4096;
+
+    BufferRow() = default;
+    /**A row holding the line found at origin in the file on disk*/
+    BufferRow(const char *first, const char *last, off_t origin)
+        : m_text(first, last), m_origin(origin) {}
+    /**A row sharing text that came from elsewhere (e.g. another row)*/
+    explicit BufferRow(RowText text) : m_text(std::move(text)) {}
+
+    const_iterator begin() const { return m_text.data(); }
+    const_iterator end() const { return m_text.data() + m_text.size(); }
+    std::size_t size() const { return m_text.size(); }
+    bool empty() const { return m_text.size() == 0; }
+    const char* data() const { return m_text.data(); }
+    const RowText& text() const { return m_text; }
+
+    iterator insert(const_iterator pos, char letter)
+    {
+        return insert(pos, 1, letter);
+    }
+    iterator insert(const_iterator pos, std::size_t count, char letter)
+    {
+        char *at = m_text.open(changed(pos, 0, count), count);
+        std::fill_n(at, count, letter);
+        return at;
+    }
+    template<typename Iter>
+    iterator insert(const_iterator pos, Iter first, Iter last)
+    {
+        const std::size_t count = std::distance(first, last);
+        char *at = m_text.open(changed(pos, 0, count), count);
+        std::copy(first, last, at);
+        return at;
+    }
+    iterator erase(const_iterator pos)
+    {
+        return erase(pos, pos + 1);
+    }
+    iterator erase(const_iterator first, const_iterator last)
+    {
+        const auto offset = changed(first, last - first, 0);
+        m_text.close(offset, last - first);
+        return data() + offset;
+    }
+    /**Replaces all of the row's text at once*/
+    void assign(RowText text)
+    {
+        changed(begin(), size(), text.size());
+        m_text = std::move(text);
+    }
+
+    /**Byte offset of this line in the file on disk, or NoOrigin if the
+       line has been edited since the file was last loaded/saved*/
+    off_t origin() const { return m_origin; }
+    void set_origin(off_t origin) { m_origin = origin; }
+
+    /**Highlighting state at every CheckpointInterval-th byte of the row, filled
+       in as needed by lex_state_at(); entries past an edit are dropped*/
+    std::vector<unsigned char>& lex_checkpoints() const { return m_lex_checkpoints; }
+    /**A highlighting state known past the checkpoints, along with the state
+       at the end of the row (both given the state at lex_checkpoints()[0]
+       at its start). Kept through edits before offset, so that if the
+       state there comes out the same after one, the end state is too,
+       without scanning the rest of the row again*/
+    struct LexTail {
+        std::size_t offset = 0;
+        unsigned char state = 0;
+        unsigned char end = 0;
+        bool valid = false;
+    };
+    LexTail& lex_tail() const { return m_lex_tail; }
+
+    /**Onscreen column where the character containing byte is shown*/
+    std::size_t column_of(std::size_t byte) const
+    {
+        return m_columns.column(data(), size(), byte);
+    }
+    /**Offset of the character shown at the given onscreen column*/
+    std::size_t byte_at_column(std::size_t column) const
+    {
+        return m_columns.byte(data(), size(), column);
+    }
+    /**Offsets where each screen row after the first starts when this row is
+       wrapped to the given width; kept until an edit or a change in width*/
+    const std::vector<std::size_t>& wrap_points(std::size_t width) const
+    {
+        if(m_wrap_width != width) {
+            wrap_row(data(), size(), width, m_wrap_points);
+            m_wrap_width = width;
+        }
+        return m_wrap_points;
+    }
+private:
+    RowText m_text;
+    off_t m_origin = NoOrigin;
+    mutable std::vector<unsigned char> m_lex_checkpoints;
+    mutable LexTail m_lex_tail;
+    mutable ColumnMap m_columns;
+    mutable std::vector<std::size_t> m_wrap_points;
+    // Width that m_wrap_points was laid out for (0 if it is out of date)
+    mutable std::size_t m_wrap_width = 0;
+
+    /**Drops what was cached about the text from pos onwards, where removed
+       bytes are about to be replaced by added ones; returns pos as an
+       offset, since the text may move*/
+    std::size_t changed(const_iterator pos, std::size_t removed, std::size_t added)
+    {
+        const std::size_t offset = pos - begin();
+        m_origin = NoOrigin;
+        if(m_lex_tail.valid) {
+            // The nearest known state after the edit moves along with the
+            // text there; the checkpoint just past it is used if nearer
+            const std::size_t after = offset + removed;
+            const std::size_t next = (after + CheckpointInterval - 1) / CheckpointInterval;
+            if(next < m_lex_checkpoints.size()
+               && (m_lex_tail.offset < after || next * CheckpointInterval < m_lex_tail.offset)) {
+                m_lex_tail.offset = next * CheckpointInterval;
+                m_lex_tail.state = m_lex_checkpoints[next];
+            }
+            if(m_lex_tail.offset < after)
+                m_lex_tail.valid = false;
+            else
+                m_lex_tail.offset = m_lex_tail.offset - removed + added;
+        }
+        // Checkpoints at or before the edit only depend on text before it
+        const std::size_t valid = offset / CheckpointInterval + 1;
+        if(m_lex_checkpoints.size() > valid)
+            m_lex_checkpoints.resize(valid);
+        m_columns.truncate(data(), offset);
+        m_wrap_width = 0;
+        return offset;
+    }
+};
+
+/**The rows of the file being edited. The text is changed through the
+   buffer, by the index of the row, so that it can keep a persistent tree of
+   the rows alongside the list; snapshot() hands out the tree's current
+   version to be read on other threads while editing goes on*/
+class Buffer {
+public:
+    using iterator = std::list<BufferRow>::const_iterator;
+    using const_iterator = iterator;
+    /**What happened to a row, as told to the handlers given to on_change()*/
+    enum class RowChange : char {
+        Inserted, Changed, Erased
+    };
+    using ChangeHandler = std::function<void(RowChange change, std::size_t row,
+                                             iterator row_it)>;
+
+    iterator begin() const { return m_rows.begin(); }
+    iterator end() const { return m_rows.end(); }
+    std::size_t size() const { return m_rows.size(); }
+    bool empty() const { return m_rows.empty(); }
+    const BufferRow& back() const { return m_rows.back(); }
+
+    /**Adds a row holding the line found at origin in the file on disk*/
+    void append(const char *first, const char *last, off_t origin);
+    /**Adds an empty row before pos, which is row number row*/
+    iterator insert_row(iterator pos, std::size_t row);
+    /**Adds a row holding text (shared, not copied) before pos*/
+    iterator insert_row(iterator pos, std::size_t row, RowText text);
+    /**Removes the row at row_it, which is row number row*/
+    iterator erase_row(iterator row_it, std::size_t row);
+
+    // Edits the text of the row at row_it, which is row number row; these
+    // return the same as the BufferRow functions they call
+    template<typename Iter>
+    BufferRow::iterator insert(iterator row_it, std::size_t row,
+                               BufferRow::const_iterator pos, Iter first, Iter last)
+    {
+        changing(row_it, row);
+        m_edit = {std::size_t(pos - row_it->begin()), {},
+                  std::size_t(std::distance(first, last))};
+        const auto result = edit(row_it).insert(pos, first, last);
+        changed(row_it, row);
+        return result;
+    }
+    BufferRow::iterator insert(iterator row_it, std::size_t row,
+                               BufferRow::const_iterator pos, std::size_t count,
+                               char letter);
+    BufferRow::iterator erase(iterator row_it, std::size_t row,
+                              BufferRow::const_iterator first, BufferRow::const_iterator last);
+    void assign(iterator row_it, std::size_t row, RowText text);
+    /**Records where the row at row_it is now found on disk*/
+    void set_origin(iterator row_it, off_t origin) { edit(row_it).set_origin(origin); }
+
+    /**Has handler called after each row is added (appended or inserted) or
+       has its text changed, and just before each row is removed, so that
+       things worked out from the rows can be kept up to date row by row*/
+    void on_change(ChangeHandler handler) { m_on_change.push_back(std::move(handler)); }
+    /**What an edit to a row's text did: the bytes removed at offset were
+       replaced by added bytes*/
+    struct RowEdit {
+        std::size_t offset = 0;
+        std::string_view removed;
+        std::size_t added = 0;
+    };
+    /**While on_change() handlers are told a row's text changed, what the
+       edit was; removed is only valid until they return*/
+    const RowEdit& last_edit() const { return m_edit; }
+
+    /**The rows as they are now, in O(1) (plus O(log n) for each row whose
+       text changed since the last one)*/
+    Snapshot snapshot()
+    {
+        update_tree();
+        return m_versions.snapshot(m_version);
+    }
+private:
+    static constexpr std::size_t MaxStaleRows = RowNode::MaxEntries;
+
+    std::list<BufferRow> m_rows;
+    PersistentRows m_versions;
+    // Text of the rows at the end that haven't been added to the tree yet.
+    // The loader adds rows one at a time, so they go in a leaf at a time
+    std::vector<RowText> m_unsynced;
+    // Rows whose text changed since the tree last had it. Unless a snapshot
+    // still sees it, the tree lets go of the old text then rather than take
+    // the new, so the row's text isn't shared and is edited in place; the
+    // tree is given it once a snapshot is taken
+    std::vector<std::pair<std::size_t, iterator>> m_stale;
+    // Counts edits, to tell snapshots apart
+    std::uint64_t m_version = 0;
+    std::vector<ChangeHandler> m_on_change;
+    RowEdit m_edit;
+    // The bytes m_edit.removed refers to: those erased, or the row's whole
+    // text before it was assigned
+    std::string m_erased;
+    RowText m_replaced;
+
+    void notify(RowChange change, std::size_t row, iterator row_it)
+    {
+        for(const auto &handler : m_on_change)
+            handler(change, row, row_it);
+    }
+
+    /**Adds the rows appended since the last sync() to the tree*/
+    void sync()
+    {
+        if(!m_unsynced.empty())
+            m_versions.append(m_unsynced);
+    }
+    /**Brings the tree up to date with every row, before it is snapshotted
+       or rows are added or removed (which would renumber m_stale)*/
+    void update_tree()
+    {
+        sync();
+        for(const auto &[row, row_it] : m_stale)
+            m_versions.set(row, row_it->text());
+        m_stale.clear();
+    }
+
+    // Erasing an empty range turns a const_iterator into an iterator
+    BufferRow& edit(iterator row_it) { return *m_rows.erase(row_it, row_it); }
+    /**Before the row's text is changed: takes it out of the tree if no
+       snapshot needs it there, so it isn't copied*/
+    void changing(iterator row_it, std::size_t row)
+    {
+        // Typing goes on in the same row, so it is most likely the last one
+        const auto stale = std::find_if(m_stale.rbegin(), m_stale.rend(),
+                                        [row](const auto &entry) { return entry.first == row; });
+        if(stale == m_stale.rend()) {
+            // Kept short so looking through it stays cheap
+            if(m_stale.size() == MaxStaleRows)
+                update_tree();
+            sync();
+            m_versions.release(row);
+            m_stale.emplace_back(row, row_it);
+        }
+    }
+    /**Tells the handlers about a change to the row's text, which the tree
+       is brought up to date with later*/
+    void changed(iterator row_it, std::size_t row)
+    {
+        ++m_version;
+        notify(RowChange::Changed, row, row_it);
+        m_edit = RowEdit();
+        m_replaced = RowText();
+    }
+};
+
+/**Write the buffer to disk as a text file; returns false on failure*/
+bool save(Buffer &buffer, const char *filename);
+#endif
@@ -3,4 +3,4 @@
 compiler=g++
 #Add debug flag when using static analyzer
 #When running, you can do `./build.sh [any other flags you want to pass to compiler]`
-$compiler -std=c++17 -Wall -Wextra -pedantic-errors $@ -o editorial *.cpp -lncurses
+$compiler -std=c++17 -Wall -Wextra -pedantic-errors $@ -pthread -o editorial *.cpp $(pkg-config --libs ncursesw 2>/dev/null || echo -lncursesw)
@@ -0,0 +1,166 @@
+#include "columns.h"
+#include <algorithm>
+#include <cwchar>
+
+Glyph glyph_at(const char *text, std::size_t avail, std::size_t col)
+{
+    const auto lead = static_cast<unsigned char>(text[0]);
+    if(lead == '\t')
+        return {1, TabSize - col % TabSize, true};
+    if(lead < 0x80)
+        return {1, 1, true};
+
+    // Decode a multi-byte sequence, rejecting malformed/overlong ones
+    std::size_t len;
+    char32_t code_point;
+    if((lead & 0xe0) == 0xc0 && lead >= 0xc2) {
+        len = 2;
+        code_point = lead & 0x1f;
+    } else if((lead & 0xf0) == 0xe0) {
+        len = 3;
+        code_point = lead & 0x0f;
+    } else if((lead & 0xf8) == 0xf0 && lead <= 0xf4) {
+        len = 4;
+        code_point = lead & 0x07;
+    } else {
+        return {1, 1, false};
+    }
+    if(len > avail)
+        return {1, 1, false};
+    for(std::size_t i = 1; i < len; ++i) {
+        const auto next = static_cast<unsigned char>(text[i]);
+        if((next & 0xc0) != 0x80)
+            return {1, 1, false};
+        code_point = (code_point << 6) | (next & 0x3f);
+    }
+    if((len == 3 && code_point < 0x800) || (len == 4 && code_point < 0x10000)
+       || code_point > 0x10ffff || (code_point >= 0xd800 && code_point <= 0xdfff))
+        return {1, 1, false};
+
+    // Combining/unprintable characters still get a column so the cursor
+    // can land on them
+    const int width = wcwidth(static_cast<wchar_t>(code_point));
+    return {len, width == 2 ? 2u : 1u, true};
+}
+
+std::size_t prev_char(const char *text, std::size_t byte)
+{
+    if(byte == 0)
+        return 0;
+    // Back up over (at most 3) continuation bytes to a lead byte
+    std::size_t start = byte - 1;
+    while(start > 0 && byte - start < 4
+          && (static_cast<unsigned char>(text[start]) & 0xc0) == 0x80)
+        --start;
+    if(start + glyph_at(text + start, byte - start, 0).len == byte)
+        return start;
+    // Not a valid sequence; step back over a single byte
+    return byte - 1;
+}
+
+void wrap_row(const char *text, std::size_t size, std::size_t width,
+              std::vector<std::size_t> &wrap_points)
+{
+    wrap_points.clear();
+    std::size_t col = 0;
+    // Where the current screen row starts
+    std::size_t line_start = 0, line_start_col = 0;
+    // Where the word after the most recent space starts
+    std::size_t word_start = 0, word_start_col = 0;
+    for(std::size_t i = 0; i < size;) {
+        const auto glyph = glyph_at(text + i, size - i, col);
+        while(col + glyph.width > line_start_col + width && i > line_start) {
+            if(word_start > line_start) {
+                // Move the partial word down to the next row
+                line_start = word_start;
+                line_start_col = word_start_col;
+            } else {
+                // The word doesn't fit on a row by itself; split it
+                line_start = i;
+                line_start_col = col;
+            }
+            wrap_points.push_back(line_start);
+        }
+        const bool is_space = text[i] == ' ' || text[i] == '\t';
+        col += glyph.width;
+        i += glyph.len;
+        if(is_space) {
+            word_start = i;
+            word_start_col = col;
+        }
+    }
+}
+
+std::size_t ColumnMap::valid_column() const
+{
+    if(m_spans.empty())
+        return m_valid;
+    return m_spans.back().end_col + (m_valid - m_spans.back().end_byte);
+}
+
+/**Maps more of the row, until byte (or the character containing it) and
+   column have both been reached*/
+void ColumnMap::extend(const char *text, std::size_t size, std::size_t byte,
+                       std::size_t column)
+{
+    std::size_t col = valid_column();
+    while(m_valid < size && (m_valid <= byte || col <= column)) {
+        const auto glyph = glyph_at(text + m_valid, size - m_valid, col);
+        if(glyph.len != 1 || glyph.width != 1) {
+            m_spans.push_back({m_valid, m_valid + glyph.len, col, col + glyph.width});
+        }
+        m_valid += glyph.len;
+        col += glyph.width;
+    }
+}
+
+std::size_t ColumnMap::column(const char *text, std::size_t size, std::size_t byte)
+{
+    extend(text, size, byte, 0);
+    // Last special character starting at or before byte
+    auto span = std::upper_bound(m_spans.begin(), m_spans.end(), byte,
+                                 [](std::size_t b, const Span &s) {
+                                     return b < s.start_byte;
+                                 });
+    if(span == m_spans.begin())
+        // Only plain characters before it
+        return byte;
+    --span;
+    if(byte < span->end_byte)
+        return span->start_col;
+    return span->end_col + (byte - span->end_byte);
+}
+
+std::size_t ColumnMap::byte(const char *text, std::size_t size, std::size_t column)
+{
+    extend(text, size, 0, column);
+    auto span = std::upper_bound(m_spans.begin(), m_spans.end(), column,
+                                 [](std::size_t c, const Span &s) {
+                                     return c < s.start_col;
+                                 });
+    if(span == m_spans.begin())
+        return std::min(column, size);
+    --span;
+    if(column < span->end_col)
+        return span->start_byte;
+    return std::min<std::size_t>(span->end_byte + (column - span->end_col), size);
+}
+
+void ColumnMap::truncate(const char *text, std::size_t byte)
+{
+    // A multi-byte character just before the edit may have been cut short
+    // there, so takes in bytes put in at it (e.g. one typed a byte at a
+    // time); it is mapped again from its lead byte, at most 3 bytes back
+    if(byte > 0 && static_cast<unsigned char>(text[byte - 1]) >= 0x80) {
+        --byte;
+        for(std::size_t back = 0; back < 3 && byte > 0
+                && (static_cast<unsigned char>(text[byte]) & 0xc0) == 0x80; ++back)
+            --byte;
+    }
+    // Characters ending at or before that are still displayed where they were
+    while(!m_spans.empty() && m_spans.back().end_byte > byte)
+        m_spans.pop_back();
+    m_valid = std::min(m_valid, byte);
+    if(!m_spans.empty())
+        m_valid = std::max<std::size_t>(m_valid, m_spans.back().end_byte);
+}
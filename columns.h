@@ -0,0 +1,58 @@
+#ifndef COLUMNS_H
+#define COLUMNS_H
+#include <cstddef>
+#include <vector>
+
+constexpr std::size_t TabSize = 4; // in spaces
+
+/**One character of UTF-8 text and how it is shown onscreen*/
+struct Glyph {
+    // Number of bytes in the character
+    std::size_t len;
+    // Number of columns it takes up onscreen
+    std::size_t width;
+    // False for bytes that aren't valid UTF-8 (each shown as a single '?')
+    bool valid;
+};
+
+/**The character starting at text[0] (with avail bytes left in the row),
+   given the column it is displayed at (tabs depend on it)*/
+Glyph glyph_at(const char *text, std::size_t avail, std::size_t col);
+/**Offset where the character before the one at byte starts*/
+std::size_t prev_char(const char *text, std::size_t byte);
+/**Fills wrap_points with the offsets where each screen row after the first
+   starts when the text is wrapped to rows of width columns, breaking after
+   spaces where possible*/
+void wrap_row(const char *text, std::size_t size, std::size_t width,
+              std::vector<std::size_t> &wrap_points);
+
+/**Maps the byte offsets within a row to the columns they are displayed at
+   and back. Only characters that aren't 1 byte wide and 1 column wide (tabs,
+   multi-byte UTF-8) are recorded, so plain ASCII rows cost nothing. The map
+   is filled in lazily and an edit only drops the part after it*/
+class ColumnMap {
+public:
+    /**The column that the character containing byte starts at*/
+    std::size_t column(const char *text, std::size_t size, std::size_t byte);
+    /**The start of the character displayed at column (or the end of
+       the row if it isn't that wide)*/
+    std::size_t byte(const char *text, std::size_t size, std::size_t column);
+    /**Forgets everything at or past byte (and the character just before
+       it, if that is multi-byte); call with the row's text just before it
+       is edited there*/
+    void truncate(const char *text, std::size_t byte);
+private:
+    struct Span {
+        std::size_t start_byte, end_byte;
+        std::size_t start_col, end_col;
+    };
+    // The wide/multi-byte characters in the row, in order
+    std::vector<Span> m_spans;
+    // Bytes [0, m_valid) of the row have been mapped
+    std::size_t m_valid = 0;
+
+    std::size_t valid_column() const;
+    void extend(const char *text, std::size_t size, std::size_t byte,
+                std::size_t column);
+};
+#endif
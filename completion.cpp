@@ -0,0 +1,222 @@
+#include "completion.h"
+#include <algorithm>
+#include <cctype>
+#include <queue>
+#include <string>
+#include <tuple>
+
+// Longer runs of word bytes (e.g. encoded data) aren't offered as words
+constexpr std::size_t MaxWordLength = 64;
+
+bool is_word_byte(char letter)
+{
+    const auto byte = static_cast<unsigned char>(letter);
+    return std::isalnum(byte) || letter == '_' || letter == '$' || byte >= 0x80;
+}
+
+std::size_t word_start(const BufferRow &row, std::size_t col)
+{
+    while(col > 0 && is_word_byte(row.data()[col - 1]))
+        --col;
+    return col;
+}
+
+std::uint32_t WordTrie::child_of(std::uint32_t node, char letter, bool create)
+{
+    // Siblings are kept in letter order, so the search can stop early
+    const auto byte = static_cast<unsigned char>(letter);
+    auto prev = None;
+    auto child = m_nodes[node].child;
+    while(child != None && static_cast<unsigned char>(m_nodes[child].letter) < byte) {
+        prev = child;
+        child = m_nodes[child].sibling;
+    }
+    if(child != None && m_nodes[child].letter == letter)
+        return child;
+    if(!create)
+        return None;
+    const std::uint32_t added = m_nodes.size();
+    m_nodes.push_back({None, child, 0, 0, letter});
+    if(prev == None)
+        m_nodes[node].child = added;
+    else
+        m_nodes[prev].sibling = added;
+    return added;
+}
+
+std::uint32_t WordTrie::find(std::string_view word) const
+{
+    std::uint32_t node = 0;
+    for(const char letter : word) {
+        const auto byte = static_cast<unsigned char>(letter);
+        node = m_nodes[node].child;
+        while(node != None && static_cast<unsigned char>(m_nodes[node].letter) < byte)
+            node = m_nodes[node].sibling;
+        if(node == None || m_nodes[node].letter != letter)
+            return None;
+    }
+    return node;
+}
+
+void WordTrie::add(std::string_view word)
+{
+    std::uint32_t node = 0;
+    for(const char letter : word)
+        node = child_of(node, letter, true);
+    const auto count = ++m_nodes[node].count;
+    // Every node on the way down now has a word used at least this much
+    node = 0;
+    m_nodes[node].best = std::max(m_nodes[node].best, count);
+    for(const char letter : word) {
+        node = child_of(node, letter, false);
+        m_nodes[node].best = std::max(m_nodes[node].best, count);
+    }
+}
+
+void WordTrie::remove(std::string_view word)
+{
+    m_path.clear();
+    std::uint32_t node = 0;
+    m_path.push_back(node);
+    for(const char letter : word) {
+        node = child_of(node, letter, false);
+        if(node == None)
+            return;
+        m_path.push_back(node);
+    }
+    if(m_nodes[node].count == 0)
+        return;
+    --m_nodes[node].count;
+    // Work out the highest counts again from the bottom up, stopping once
+    // one stays the same
+    for(auto step = m_path.rbegin(); step != m_path.rend(); ++step) {
+        auto &current = m_nodes[*step];
+        auto best = current.count;
+        for(auto child = current.child; child != None; child = m_nodes[child].sibling)
+            best = std::max(best, m_nodes[child].best);
+        if(best == current.best)
+            break;
+        current.best = best;
+    }
+}
+
+std::vector<std::string> WordTrie::complete(std::string_view prefix, std::size_t max) const
+{
+    std::vector<std::string> words;
+    const auto start = find(prefix);
+    if(start == None || max == 0)
+        return words;
+    // The letters after the prefix leading to each node queued, as a link
+    // back to the letters before
+    struct Letters {
+        std::uint32_t before;
+        char letter;
+    };
+    std::vector<Letters> letters;
+    // Subtrees are queued by the highest count in them and words by their
+    // own, so words come out most used first (and in letter order among
+    // equals, since entries queued earlier win ties)
+    using Entry = std::tuple<std::uint32_t, bool, std::int64_t, std::uint32_t, std::uint32_t>;
+    std::priority_queue<Entry> queue;
+    std::int64_t order = 0;
+    const auto push = [&](std::uint32_t priority, bool is_word, std::uint32_t node,
+                          std::uint32_t at) {
+        queue.emplace(priority, is_word, --order, node, at);
+    };
+    push(m_nodes[start].best, false, start, None);
+    while(!queue.empty() && words.size() < max) {
+        const auto [priority, is_word, entry_order, node, at] = queue.top();
+        queue.pop();
+        if(priority == 0)
+            break;
+        if(is_word) {
+            std::string word;
+            for(auto link = at; link != None; link = letters[link].before)
+                word.push_back(letters[link].letter);
+            std::reverse(word.begin(), word.end());
+            words.push_back(std::string(prefix) + word);
+            continue;
+        }
+        if(node != start && m_nodes[node].count > 0)
+            push(m_nodes[node].count, true, node, at);
+        for(auto child = m_nodes[node].child; child != None; child = m_nodes[child].sibling) {
+            if(m_nodes[child].best == 0)
+                continue;
+            letters.push_back({at, m_nodes[child].letter});
+            push(m_nodes[child].best, false, child, letters.size() - 1);
+        }
+    }
+    return words;
+}
+
+void WordIndex::count_words(const char *first, const char *last, bool add)
+{
+    while(first != last) {
+        if(!is_word_byte(*first)) {
+            ++first;
+            continue;
+        }
+        const char *end = first;
+        while(end != last && is_word_byte(*end))
+            ++end;
+        const std::size_t length = end - first;
+        if(length > 1 && length <= MaxWordLength
+           && !std::isdigit(static_cast<unsigned char>(*first))) {
+            if(add)
+                m_words.add({first, length});
+            else
+                m_words.remove({first, length});
+        }
+        first = end;
+    }
+}
+
+void WordIndex::build(const Buffer &buffer)
+{
+    if(m_built)
+        return;
+    if(m_mode.keywords != nullptr) {
+        for(auto keyword = m_mode.keywords; *keyword != nullptr; ++keyword)
+            m_words.add(*keyword);
+    }
+    for(const auto &row : buffer)
+        count_words(row.begin(), row.end(), true);
+    m_built = true;
+}
+
+void WordIndex::update(Buffer::RowChange change, const BufferRow &row,
+                       const Buffer::RowEdit &edit)
+{
+    if(!m_built)
+        return;
+    switch(change) {
+    case Buffer::RowChange::Inserted:
+        count_words(row.begin(), row.end(), true);
+        break;
+    case Buffer::RowChange::Erased:
+        count_words(row.begin(), row.end(), false);
+        break;
+    case Buffer::RowChange::Changed: {
+        // Only the words overlapping the edit are recounted, the text around
+        // it being the same before and after
+        const char *text = row.data();
+        const std::size_t size = row.size();
+        std::size_t first = edit.offset;
+        std::size_t last = edit.offset + edit.added;
+        // Widen to the edges of the words there. Past MaxWordLength bytes
+        // a word is too long to count anyway, cut off there or not
+        for(std::size_t i = 0; i <= MaxWordLength && first > 0
+                && is_word_byte(text[first - 1]); ++i)
+            --first;
+        for(std::size_t i = 0; i <= MaxWordLength && last < size
+                && is_word_byte(text[last]); ++i)
+            ++last;
+        std::string old_text(text + first, text + edit.offset);
+        old_text += edit.removed;
+        old_text.append(text + edit.offset + edit.added, text + last);
+        count_words(old_text.data(), old_text.data() + old_text.size(), false);
+        count_words(text + first, text + last, true);
+        break;
+    }
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "buffer.h"
+#include "syntax-highlight.h"
+
+/**Whether a byte can be part of a word to complete: letters, digits, '_',
+   '$' (for MIPS registers), or any byte of a non-ASCII character*/
+bool is_word_byte(char letter);
+
+/**Where the word ending at byte col of a row starts (col if there is none)*/
+std::size_t word_start(const BufferRow &row, std::size_t col);
+
+/**Words and how many times each is used, in a trie laid out in one array
+   (so that walking it stays in cache and needs no allocations): each node
+   has a letter, the index of its first child and of its next sibling (in
+   letter order), how many times the word ending there is used and the
+   most any word below it is used. The most used completions of a prefix
+   are found best-first, without looking at the words that aren't returned*/
+class WordTrie {
+public:
+    void add(std::string_view word);
+    /**Takes away one use of the word, if it has any*/
+    void remove(std::string_view word);
+    /**Up to max words starting with prefix (and longer than it), the most
+       used first*/
+    std::vector<std::string> complete(std::string_view prefix, std::size_t max) const;
+private:
+    static constexpr std::uint32_t None = static_cast<std::uint32_t>(-1);
+
+    struct Node {
+        std::uint32_t child;
+        std::uint32_t sibling;
+        std::uint32_t count;
+        // The highest count of any word at or below this node
+        std::uint32_t best;
+        char letter;
+    };
+
+    // The root (the empty word) is first. Nodes whose words are no longer
+    // used are left in place, with a best of 0
+    std::vector<Node> m_nodes = std::vector<Node>(1, Node{None, None, 0, 0, 0});
+    // The nodes on the way down to a word being removed
+    std::vector<std::uint32_t> m_path;
+
+    /**The child of node with the given letter; None if there isn't one and
+       create is false*/
+    std::uint32_t child_of(std::uint32_t node, char letter, bool create);
+    std::uint32_t find(std::string_view word) const;
+};
+
+/**The words in a buffer, plus the ones a highlighting mode knows, for
+   completing words as they are typed. Single letters, words starting with
+   a digit and very long words aren't counted. Built the first time it is
+   needed, then kept up to date as rows change by recounting only the
+   words around the part of a row that changed*/
+class WordIndex {
+public:
+    explicit WordIndex(const HighlightMode &mode) : m_mode(mode) {}
+    void build(const Buffer &buffer);
+    /**Keeps the index up to date with an edit to the buffer; edit says
+       what a Changed edit did (Buffer::last_edit())*/
+    void update(Buffer::RowChange change, const BufferRow &row, const Buffer::RowEdit &edit);
+    std::vector<std::string> complete(std::string_view prefix, std::size_t max) const
+    {
+        return m_words.complete(prefix, max);
+    }
+private:
+    const HighlightMode &m_mode;
+    WordTrie m_words;
+    bool m_built = false;
+
+    /**Adds (or removes) the words in [first, last), which must start and
+       end at the edges of words*/
+    void count_words(const char *first, const char *last, bool add);
+};
+#endif
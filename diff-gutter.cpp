@@ -0,0 +1,407 @@
+#include "diff-gutter.h"
+#include "file-io.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <unordered_map>
+
+// Stretches of at most this many rows (old and new together) are diffed
+// row by row; longer ones are first split up at lines found once on each side
+constexpr std::size_t MaxMyersRows = 1024;
+// Most rows the row by row diff of a stretch with no such lines lines up one
+// by one; past that, every row between its first and last difference is marked
+constexpr std::size_t MaxDiffChanges = 1024;
+// Rows hashed between checks for being called off
+constexpr std::size_t CancelCheckInterval = 4096;
+// Hunks of more rows than this only have the part of them near an edit
+// taken into the hunk it makes, so that what is diffed again stays small
+constexpr std::size_t MaxMergedRows = 256;
+// How many rows either side of an edit that part of such a hunk runs to
+constexpr std::size_t SplitContext = 16;
+// Most edits kept to take into a scan done while they were made
+constexpr std::size_t MaxPendingEdits = 1 << 16;
+
+static std::uint64_t hash_row(const char *first, const char *last)
+{
+    return std::hash<std::string_view>()({first, std::size_t(last - first)});
+}
+
+/**Hashes each line of a file, the text after its last newline included;
+   returns false if it can't be read or token is cancelled*/
+static bool hash_file(const char *filename, const CancelToken &token,
+                      DiffGutter::Hashes &hashes)
+{
+    std::vector<char> contents;
+    if(!read_file(filename, contents))
+        return false;
+    const char *pos = contents.data();
+    const char *end = pos + contents.size();
+    while(true) {
+        if(hashes.size() % CancelCheckInterval == 0 && token.cancelled())
+            return false;
+        const auto newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        if(newline == nullptr)
+            break;
+        hashes.push_back(hash_row(pos, newline));
+        pos = newline + 1;
+    }
+    hashes.push_back(hash_row(pos, end));
+    return true;
+}
+
+/**Appends the hunks that turn old rows [old_first, old_last) into new rows
+   [new_first, new_last). Long stretches are lined up at the lines found
+   exactly once in both (as patience diff does), then the stretches between
+   those are diffed in turn; returns false once token is cancelled*/
+static bool diff_range(const DiffGutter::Hashes &old_rows, std::size_t old_first,
+                       std::size_t old_last, const DiffGutter::Hashes &new_rows,
+                       std::size_t new_first, std::size_t new_last,
+                       const CancelToken &token, std::vector<DiffHunk> &hunks)
+{
+    if(token.cancelled())
+        return false;
+    while(old_first < old_last && new_first < new_last
+          && old_rows[old_first] == new_rows[new_first]) {
+        ++old_first;
+        ++new_first;
+    }
+    while(old_first < old_last && new_first < new_last
+          && old_rows[old_last - 1] == new_rows[new_last - 1]) {
+        --old_last;
+        --new_last;
+    }
+    const std::size_t old_count = old_last - old_first;
+    const std::size_t new_count = new_last - new_first;
+    if(old_count == 0 && new_count == 0)
+        return true;
+    const auto diff_rows_of = [&](std::size_t max_changes) {
+        const DiffGutter::Hashes old_part(old_rows.begin() + old_first,
+                                          old_rows.begin() + old_last);
+        const DiffGutter::Hashes new_part(new_rows.begin() + new_first,
+                                          new_rows.begin() + new_last);
+        for(auto hunk : diff_rows(old_part, new_part, max_changes)) {
+            hunk.old_first += old_first;
+            hunk.new_first += new_first;
+            hunks.push_back(hunk);
+        }
+        return true;
+    };
+    if(old_count == 0 || new_count == 0 || old_count + new_count <= MaxMyersRows)
+        // Short enough to line up every row, however different
+        return diff_rows_of(old_count + new_count);
+
+    // How often each line is found on either side, and where (last)
+    struct Seen {
+        std::size_t old_count = 0;
+        std::size_t new_count = 0;
+        std::size_t old_row = 0;
+    };
+    std::unordered_map<std::uint64_t, Seen> seen;
+    seen.reserve(old_count + new_count);
+    for(auto row = old_first; row < old_last; ++row) {
+        auto &line = seen[old_rows[row]];
+        ++line.old_count;
+        line.old_row = row;
+    }
+    // Each new row's line (which stays put as more are added)
+    std::vector<const Seen*> new_lines;
+    new_lines.reserve(new_count);
+    for(auto row = new_first; row < new_last; ++row) {
+        auto &line = seen[new_rows[row]];
+        ++line.new_count;
+        new_lines.push_back(&line);
+    }
+    if(token.cancelled())
+        return false;
+    // The unique lines, in new row order, that can all be kept in order on
+    // the old side too (the longest increasing run of their old rows)
+    std::vector<std::pair<std::size_t, std::size_t>> unique;
+    bool shared = false;
+    for(std::size_t i = 0; i < new_count; ++i) {
+        const auto &line = *new_lines[i];
+        shared = shared || line.old_count > 0;
+        if(line.old_count == 1 && line.new_count == 1)
+            unique.emplace_back(line.old_row, new_first + i);
+    }
+    if(!shared) {
+        // Nothing to line up
+        hunks.push_back({old_first, old_count, new_first, new_count});
+        return true;
+    }
+    if(unique.empty())
+        return diff_rows_of(MaxDiffChanges);
+    // tails[i] is the index in unique of the smallest old row ending a run
+    // of i + 1; before[j] is the entry before unique[j] in its run
+    std::vector<std::size_t> tails;
+    std::vector<std::size_t> before(unique.size());
+    for(std::size_t j = 0; j < unique.size(); ++j) {
+        const auto at = std::lower_bound(
+            tails.begin(), tails.end(), unique[j].first,
+            [&unique](std::size_t i, std::size_t row) { return unique[i].first < row; });
+        before[j] = at == tails.begin() ? j : *std::prev(at);
+        if(at == tails.end())
+            tails.push_back(j);
+        else
+            *at = j;
+    }
+    std::vector<std::pair<std::size_t, std::size_t>> anchors;
+    for(auto j = tails.back();; j = before[j]) {
+        anchors.push_back(unique[j]);
+        if(before[j] == j)
+            break;
+    }
+    std::reverse(anchors.begin(), anchors.end());
+    for(const auto &[old_row, new_row] : anchors) {
+        if(!diff_range(old_rows, old_first, old_row, new_rows, new_first, new_row, token,
+                       hunks))
+            return false;
+        old_first = old_row + 1;
+        new_first = new_row + 1;
+    }
+    return diff_range(old_rows, old_first, old_last, new_rows, new_first, new_last, token,
+                      hunks);
+}
+
+bool DiffGutter::scan(const char *filename, const Snapshot &rows, const CancelToken &token,
+                      Contents &contents)
+{
+    auto file_rows = std::make_shared<Hashes>();
+    if(!hash_file(filename, token, *file_rows))
+        return false;
+    Hashes buffer_rows;
+    buffer_rows.reserve(rows.size());
+    const bool done = rows.for_each_row([&](const RowText &text) {
+        if(buffer_rows.size() % CancelCheckInterval == 0 && token.cancelled())
+            return false;
+        buffer_rows.push_back(hash_row(text.data(), text.data() + text.size()));
+        return true;
+    });
+    if(!done)
+        return false;
+    contents.hunks.clear();
+    if(!diff_range(*file_rows, 0, file_rows->size(), buffer_rows, 0, buffer_rows.size(),
+                   token, contents.hunks))
+        return false;
+    contents.file_rows = std::move(file_rows);
+    return true;
+}
+
+bool DiffGutter::build(Contents contents)
+{
+    if(m_built || contents.generation < m_pending_from)
+        return false;
+    m_file_rows = std::move(contents.file_rows);
+    m_hunks.clear();
+    for(const auto &hunk : contents.hunks)
+        m_hunks.emplace_back(hunk, false);
+    m_dirty_count = 0;
+    m_built = true;
+    // The edits made while it was scanned (to be diffed again like any other)
+    for(auto i = contents.generation - m_pending_from; i < m_pending.size(); ++i)
+        widen(m_pending[i].first, m_pending[i].second);
+    m_pending.clear();
+    return true;
+}
+
+void DiffGutter::clear()
+{
+    m_file_rows.reset();
+    m_hunks.clear();
+    m_dirty_count = 0;
+    m_built = false;
+    m_pending.clear();
+    m_pending_from = m_generation;
+}
+
+void DiffGutter::saved(const Buffer &buffer)
+{
+    if(!m_built) {
+        clear();
+        return;
+    }
+    // Results worked out against the old file are no use now
+    ++m_generation;
+    auto file_rows = std::make_shared<Hashes>();
+    file_rows->reserve(buffer.size());
+    auto row_it = buffer.begin();
+    std::size_t row = 0;
+    std::size_t old_row = 0;
+    for(const auto &hunk : m_hunks) {
+        file_rows->insert(file_rows->end(), m_file_rows->begin() + old_row,
+                          m_file_rows->begin() + hunk.old_first);
+        std::advance(row_it, hunk.new_first - row);
+        for(row = hunk.new_first; row < hunk.new_end(); ++row, ++row_it)
+            file_rows->push_back(hash_row(row_it->begin(), row_it->end()));
+        old_row = hunk.old_end();
+    }
+    file_rows->insert(file_rows->end(), m_file_rows->begin() + old_row, m_file_rows->end());
+    m_file_rows = std::move(file_rows);
+    m_hunks.clear();
+    m_dirty_count = 0;
+}
+
+void DiffGutter::update(Buffer::RowChange change, std::size_t row)
+{
+    if(!m_built) {
+        // Kept for the scan being done (if any) to catch up on; past too
+        // many, scans from before them are dropped instead
+        if(m_pending.size() < MaxPendingEdits) {
+            m_pending.emplace_back(change, row);
+        } else {
+            m_pending.clear();
+            m_pending_from = m_generation + 1;
+        }
+        ++m_generation;
+        return;
+    }
+    ++m_generation;
+    widen(change, row);
+}
+
+void DiffGutter::widen(Buffer::RowChange change, std::size_t row)
+{
+    // The edit replaces removed rows at row with added ones
+    const std::size_t removed = change != Buffer::RowChange::Inserted ? 1 : 0;
+    const std::size_t added = change != Buffer::RowChange::Erased ? 1 : 0;
+    const auto touching = [row](const Hunk &hunk, std::size_t) {
+        return hunk.new_end() < row;
+    };
+    // Big hunks next to it are cut down to the part near it first
+    std::size_t index = std::lower_bound(m_hunks.begin(), m_hunks.end(), row, touching)
+        - m_hunks.begin();
+    for(; index < m_hunks.size() && m_hunks[index].new_first <= row + removed; ++index) {
+        const auto &hunk = m_hunks[index];
+        if(hunk.old_count + hunk.new_count <= MaxMergedRows)
+            continue;
+        const auto near_end = row + removed + SplitContext;
+        if(near_end > hunk.new_first && near_end < hunk.new_end())
+            split(index, near_end);
+        const auto near_first = row - std::min(row, SplitContext);
+        if(near_first > m_hunks[index].new_first && near_first < m_hunks[index].new_end())
+            split(index++, near_first);
+    }
+    // The hunks it overlaps or is right next to are merged into one
+    const auto first = std::lower_bound(m_hunks.begin(), m_hunks.end(), row, touching);
+    auto last = first;
+    for(; last != m_hunks.end() && last->new_first <= row + removed; ++last) {
+        if(last->dirty)
+            --m_dirty_count;
+    }
+    // Outside of hunks, rows are offset from where they are in the file by
+    // the rows the hunks before them added or removed
+    const auto offset = [](const Hunk &hunk) {
+        return std::ptrdiff_t(hunk.new_end()) - std::ptrdiff_t(hunk.old_end());
+    };
+    const std::ptrdiff_t offset_before = first == m_hunks.begin() ? 0
+        : offset(*std::prev(first));
+    const std::ptrdiff_t offset_after = first == last ? offset_before
+        : offset(*std::prev(last));
+    std::size_t new_first = row;
+    std::size_t new_end = row + removed;
+    if(first != last) {
+        new_first = std::min(new_first, first->new_first);
+        new_end = std::max(new_end, std::prev(last)->new_end());
+    }
+    const std::size_t old_first = new_first - offset_before;
+    const std::size_t old_end = new_end - offset_after;
+    const Hunk merged({old_first, old_end - old_first, new_first,
+                       new_end - new_first + added - removed}, true);
+    const auto next = m_hunks.insert(m_hunks.erase(first, last), merged) + 1;
+    ++m_dirty_count;
+    if(added != removed) {
+        for(auto hunk = next; hunk != m_hunks.end(); ++hunk)
+            hunk->new_first = hunk->new_first + added - removed;
+    }
+}
+
+void DiffGutter::split(std::size_t index, std::size_t row)
+{
+    // Any way of sharing out a hunk's rows keeps it turning the file's rows
+    // into the buffer's; rows are paired off from the start
+    auto &hunk = m_hunks[index];
+    const auto new_count = row - hunk.new_first;
+    const auto old_count = std::min(hunk.old_count, new_count);
+    const Hunk rest({hunk.old_first + old_count, hunk.old_count - old_count, row,
+                     hunk.new_count - new_count}, hunk.dirty);
+    hunk.old_count = old_count;
+    hunk.new_count = new_count;
+    if(rest.dirty)
+        ++m_dirty_count;
+    m_hunks.insert(m_hunks.begin() + index + 1, rest);
+}
+
+DiffGutter::Refinement DiffGutter::dirty_hunks() const
+{
+    Refinement work;
+    work.file_rows = m_file_rows;
+    work.generation = m_generation;
+    for(const auto &hunk : m_hunks) {
+        if(hunk.dirty)
+            work.dirty.push_back(hunk);
+    }
+    return work;
+}
+
+bool DiffGutter::refine(const Snapshot &rows, const CancelToken &token, Refinement &work)
+{
+    // Only the new rows are hashed; they are numbered from 0 in new_rows
+    Hashes new_rows;
+    work.narrowed.clear();
+    for(const auto &hunk : work.dirty) {
+        new_rows.clear();
+        for(std::size_t row = hunk.new_first; row < hunk.new_first + hunk.new_count; ++row) {
+            if(new_rows.size() % CancelCheckInterval == 0 && token.cancelled())
+                return false;
+            const auto &text = rows.row(row);
+            new_rows.push_back(hash_row(text.data(), text.data() + text.size()));
+        }
+        std::vector<DiffHunk> narrowed;
+        if(!diff_range(*work.file_rows, hunk.old_first, hunk.old_first + hunk.old_count,
+                       new_rows, 0, new_rows.size(), token, narrowed))
+            return false;
+        for(auto &part : narrowed)
+            part.new_first += hunk.new_first;
+        work.narrowed.push_back(std::move(narrowed));
+    }
+    return true;
+}
+
+bool DiffGutter::apply(Refinement work)
+{
+    if(!m_built || work.generation != m_generation)
+        return false;
+    std::vector<Hunk> hunks;
+    hunks.reserve(m_hunks.size());
+    auto narrowed = work.narrowed.begin();
+    for(const auto &hunk : m_hunks) {
+        if(!hunk.dirty) {
+            hunks.push_back(hunk);
+            continue;
+        }
+        for(const auto &part : *narrowed)
+            hunks.emplace_back(part, false);
+        ++narrowed;
+    }
+    m_hunks = std::move(hunks);
+    m_dirty_count = 0;
+    return true;
+}
+
+DiffGutter::Mark DiffGutter::mark(std::size_t row) const
+{
+    if(row == 0 && !m_hunks.empty() && m_hunks.front().new_first == 0
+       && m_hunks.front().new_count == 0)
+        return Mark::RemovedAbove;
+    // The first hunk that ends after the row
+    const auto hunk = std::upper_bound(
+        m_hunks.begin(), m_hunks.end(), row,
+        [](std::size_t row, const Hunk &hunk) { return row < hunk.new_end(); });
+    if(hunk == m_hunks.end())
+        return Mark::None;
+    if(hunk->new_first <= row)
+        return row - hunk->new_first < hunk->old_count ? Mark::Changed : Mark::Added;
+    if(hunk->new_count == 0 && hunk->new_first == row + 1)
+        return Mark::RemovedBelow;
+    return Mark::None;
+}
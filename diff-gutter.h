@@ -0,0 +1,109 @@
+#ifndef DIFF_GUTTER_H
+#define DIFF_GUTTER_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "buffer.h"
+#include "diff.h"
+#include "jobs.h"
+
+/**Which rows of the buffer differ from the file as it was when last loaded
+   or saved, to be marked beside the text. This is kept as the hunks that
+   turn the file's rows into the buffer's (rows being compared by a hash of
+   their text). Each edit straight away widens the hunk around the row it
+   touches (or adds one), which may take in rows that are actually the same
+   but is never wrong, and marks the hunk dirty; only the part of a big hunk
+   near the edit is taken in. Only dirty hunks are diffed again, in the
+   background, to narrow them back down, so an edit never costs a diff of
+   the whole file*/
+class DiffGutter {
+public:
+    enum class Mark : char {
+        None, Added, Changed,
+        // Rows of the file were removed just below/above this one
+        RemovedBelow, RemovedAbove
+    };
+    using Hashes = std::vector<std::uint64_t>;
+
+    /**The diff between the file and the buffer, worked out from scratch*/
+    struct Contents {
+        std::shared_ptr<const Hashes> file_rows;
+        std::vector<DiffHunk> hunks;
+        // Edits made to the buffer before the snapshot diffed was taken
+        std::uint64_t generation = 0;
+    };
+
+    /**Hunks to be diffed again, and (once refine() is done) what each of
+       them narrows down to*/
+    struct Refinement {
+        std::shared_ptr<const Hashes> file_rows;
+        std::vector<DiffHunk> dirty;
+        std::vector<std::vector<DiffHunk>> narrowed;
+        std::uint64_t generation = 0;
+    };
+
+    bool built() const { return m_built; }
+    bool dirty() const { return m_dirty_count > 0; }
+    /**Edits made to the buffer so far; results worked out from the buffer
+       as it was before the last of them are dropped*/
+    std::uint64_t generation() const { return m_generation; }
+
+    /**Diffs the file on disk against a snapshot of the buffer, for build();
+       gives up and returns false once token is cancelled (or if the file
+       can't be read)*/
+    static bool scan(const char *filename, const Snapshot &rows, const CancelToken &token,
+                     Contents &contents);
+    /**Takes on a diff from scan(), then the edits made to the buffer since
+       its snapshot was taken; returns false (dropping it) if there were too
+       many of them to keep*/
+    bool build(Contents contents);
+    /**Forgets the diff (e.g. once the file has been reloaded), until it is
+       built again*/
+    void clear();
+    /**Once the buffer has been saved, makes it the file, with no rows
+       differing. Only the rows in hunks are hashed again; the file's other
+       rows are the buffer's already*/
+    void saved(const Buffer &buffer);
+
+    /**Keeps the hunks up to date with an edit to a row, as an on_change()
+       handler of the buffer*/
+    void update(Buffer::RowChange change, std::size_t row);
+
+    /**The dirty hunks, for refine()*/
+    Refinement dirty_hunks() const;
+    /**Diffs each dirty hunk's rows against a snapshot of the buffer taken
+       along with it; gives up and returns false once token is cancelled*/
+    static bool refine(const Snapshot &rows, const CancelToken &token, Refinement &work);
+    /**Swaps the dirty hunks for what refine() narrowed them down to, unless
+       the buffer was edited since; returns whether it was*/
+    bool apply(Refinement work);
+
+    Mark mark(std::size_t row) const;
+private:
+    struct Hunk : DiffHunk {
+        bool dirty = false;
+
+        Hunk(const DiffHunk &hunk, bool is_dirty) : DiffHunk(hunk), dirty(is_dirty) {}
+        std::size_t old_end() const { return old_first + old_count; }
+        std::size_t new_end() const { return new_first + new_count; }
+    };
+
+    std::shared_ptr<const Hashes> m_file_rows;
+    // In order; rows between them are the same in the file and the buffer
+    std::vector<Hunk> m_hunks;
+    std::size_t m_dirty_count = 0;
+    std::uint64_t m_generation = 0;
+    bool m_built = false;
+    // Until built, the edits made since generation m_pending_from, to take
+    // into the hunks of a scan of the buffer as it was before them
+    std::vector<std::pair<Buffer::RowChange, std::size_t>> m_pending;
+    std::uint64_t m_pending_from = 0;
+
+    /**Widens the hunks to take in an edit to a row*/
+    void widen(Buffer::RowChange change, std::size_t row);
+    /**Splits a hunk in two where a new row (inside it) is*/
+    void split(std::size_t index, std::size_t row);
+};
+#endif
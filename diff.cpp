@@ -0,0 +1,146 @@
+#include "diff.h"
+#include <algorithm>
+#include <cstddef>
+
+/**Picks the move onto diagonal k (where old row - new row == k) that gets
+   furthest along the old rows in round d, given how far the previous
+   round's paths got along each diagonal (at(k), or -1 for none). Returns
+   the old row the move lands on (-1 if both would leave the grid of n old
+   rows by m new rows); down is set if the move adds a new row rather than
+   removing an old one*/
+template<typename At>
+static std::ptrdiff_t step(const At &at, std::ptrdiff_t d, std::ptrdiff_t k,
+                           std::ptrdiff_t n, std::ptrdiff_t m, bool &down)
+{
+    std::ptrdiff_t x = -1;
+    if(k < d && at(k + 1) >= 0 && at(k + 1) - k <= m) {
+        x = at(k + 1);
+        down = true;
+    }
+    if(k > -d && at(k - 1) >= 0 && at(k - 1) < n && at(k - 1) + 1 > x) {
+        x = at(k - 1) + 1;
+        down = false;
+    }
+    return x;
+}
+
+/**Adds a move (removing the old row at old_pos, or adding the new row at
+   new_pos) to the hunks, as part of the last hunk if it carries straight
+   on from it*/
+static void add_move(std::vector<DiffHunk> &hunks, std::size_t old_pos,
+                     std::size_t new_pos, bool removed)
+{
+    if(hunks.empty() || hunks.back().old_first + hunks.back().old_count != old_pos
+       || hunks.back().new_first + hunks.back().new_count != new_pos)
+        hunks.push_back({old_pos, 0, new_pos, 0});
+    if(removed)
+        ++hunks.back().old_count;
+    else
+        ++hunks.back().new_count;
+}
+
+std::vector<DiffHunk> diff_rows(const std::vector<std::uint64_t> &old_rows,
+                                const std::vector<std::uint64_t> &new_rows,
+                                std::size_t max_changes)
+{
+    std::vector<DiffHunk> hunks;
+    // Rows that are the same at the start and end are left out of the search
+    std::size_t start = 0;
+    std::size_t old_end = old_rows.size();
+    std::size_t new_end = new_rows.size();
+    while(start < old_end && start < new_end && old_rows[start] == new_rows[start])
+        ++start;
+    while(old_end > start && new_end > start
+          && old_rows[old_end - 1] == new_rows[new_end - 1]) {
+        --old_end;
+        --new_end;
+    }
+    const std::ptrdiff_t n = old_end - start;
+    const std::ptrdiff_t m = new_end - start;
+    if(n == 0 && m == 0)
+        return hunks;
+    const auto *a = old_rows.data() + start;
+    const auto *b = new_rows.data() + start;
+
+    // Round d finds the paths with d moves that get furthest along each
+    // diagonal, following rows that are the same for free after each move
+    const std::ptrdiff_t limit = std::min<std::ptrdiff_t>(n + m, max_changes);
+    std::vector<std::ptrdiff_t> furthest(2 * limit + 1, -1);
+    const auto x = [&](std::ptrdiff_t k) -> std::ptrdiff_t& { return furthest[k + limit]; };
+    // What furthest held for diagonals -d to d before each round d, to
+    // retrace the path with
+    std::vector<std::vector<std::ptrdiff_t>> rounds;
+    std::ptrdiff_t cost = -1;
+    for(std::ptrdiff_t d = 0; d <= limit && cost < 0; ++d) {
+        rounds.emplace_back(&x(-d), &x(d) + 1);
+        // A round only changes diagonals of its own parity, so it reads
+        // what the round before left
+        for(std::ptrdiff_t k = -d; k <= d; k += 2) {
+            bool down;
+            std::ptrdiff_t pos = d == 0 ? 0 : step(x, d, k, n, m, down);
+            if(pos < 0) {
+                x(k) = -1;
+                continue;
+            }
+            std::ptrdiff_t y = pos - k;
+            while(pos < n && y < m && a[pos] == b[y]) {
+                ++pos;
+                ++y;
+            }
+            x(k) = pos;
+            if(pos == n && y == m) {
+                cost = d;
+                break;
+            }
+        }
+    }
+    if(cost < 0) {
+        // Too different to be worth lining up row by row
+        hunks.push_back({start, static_cast<std::size_t>(n),
+                         start, static_cast<std::size_t>(m)});
+        return hunks;
+    }
+
+    // Retrace the path from the end, one move per round
+    struct Move {
+        std::ptrdiff_t x;
+        std::ptrdiff_t y;
+        bool down;
+    };
+    std::vector<Move> moves;
+    std::ptrdiff_t pos_x = n;
+    std::ptrdiff_t pos_y = m;
+    for(std::ptrdiff_t d = cost; d > 0; --d) {
+        const auto &before = rounds[d];
+        const auto at = [&](std::ptrdiff_t k) { return before[k + d]; };
+        const std::ptrdiff_t k = pos_x - pos_y;
+        bool down = false;
+        step(at, d, k, n, m, down);
+        // Back to where the move started
+        pos_x = down ? at(k + 1) : at(k - 1);
+        pos_y = pos_x - (down ? k + 1 : k - 1);
+        moves.push_back({pos_x, pos_y, down});
+    }
+    for(auto move = moves.rbegin(); move != moves.rend(); ++move)
+        add_move(hunks, start + move->x, start + move->y, !move->down);
+    return hunks;
+}
+
+std::size_t row_after(const std::vector<DiffHunk> &hunks, std::size_t row)
+{
+    // Rows past a hunk move along with the end of it
+    std::size_t old_end = 0;
+    std::size_t new_end = 0;
+    for(const auto &hunk : hunks) {
+        if(row < hunk.old_first)
+            break;
+        if(row < hunk.old_first + hunk.old_count) {
+            const auto offset = row - hunk.old_first;
+            return hunk.new_first
+                + (hunk.new_count == 0 ? 0 : std::min(offset, hunk.new_count - 1));
+        }
+        old_end = hunk.old_first + hunk.old_count;
+        new_end = hunk.new_first + hunk.new_count;
+    }
+    return row - old_end + new_end;
+}
@@ -0,0 +1,29 @@
+#ifndef DIFF_H
+#define DIFF_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**A run of rows that differs between two versions of a text: old rows
+   [old_first, old_first + old_count) were replaced by new rows
+   [new_first, new_first + new_count)*/
+struct DiffHunk {
+    std::size_t old_first;
+    std::size_t old_count;
+    std::size_t new_first;
+    std::size_t new_count;
+};
+
+/**The hunks (in order) that turn old_rows into new_rows, where each row is
+   given by a hash of its text, changing as few rows as possible (Myers'
+   O(ND) algorithm). If that takes more than max_changes rows, all of the
+   rows between the first and last difference make up a single hunk*/
+std::vector<DiffHunk> diff_rows(const std::vector<std::uint64_t> &old_rows,
+                                const std::vector<std::uint64_t> &new_rows,
+                                std::size_t max_changes);
+
+/**Where an old row ended up once the hunks were applied; a row that was
+   replaced goes to the row that took its place (or the row after, if it
+   was removed outright)*/
+std::size_t row_after(const std::vector<DiffHunk> &hunks, std::size_t row);
+#endif
@@ -0,0 +1,132 @@
+#include "editing.h"
+#include "columns.h"
+#include <iterator>
+
+Position insert_text(Buffer &buffer, Journal *journal, const Position &place,
+                     std::string_view text)
+{
+    if(journal != nullptr)
+        journal->insert(place.row, place.col, text.data(), text.size());
+    buffer.insert(place.row_it, place.row, place.row_it->begin() + place.col,
+                  text.begin(), text.end());
+    return {place.row_it, place.row, place.col + text.size()};
+}
+
+Position split_row(Buffer &buffer, Journal *journal, const Position &place)
+{
+    if(journal != nullptr)
+        journal->split(place.row, place.col);
+    const auto next_row = buffer.insert_row(std::next(place.row_it), place.row + 1);
+    buffer.insert(next_row, place.row + 1, next_row->end(),
+                  place.row_it->begin() + place.col, place.row_it->end());
+    buffer.erase(place.row_it, place.row, place.row_it->begin() + place.col,
+                 place.row_it->end());
+    return {next_row, place.row + 1, 0};
+}
+
+Position erase_char_before(Buffer &buffer, Journal *journal, const Position &place,
+                           std::string &erased)
+{
+    erased.clear();
+    if(place.col > 0) {
+        const auto start = prev_char(place.row_it->data(), place.col);
+        erased.assign(place.row_it->data() + start, place.col - start);
+        if(journal != nullptr)
+            journal->erase(place.row, start, erased.size());
+        buffer.erase(place.row_it, place.row, place.row_it->begin() + start,
+                     place.row_it->begin() + place.col);
+        return {place.row_it, place.row, start};
+    }
+    if(place.row == 0)
+        return place;
+    // Move the row's text onto the end of the row before
+    erased = "\n";
+    if(journal != nullptr)
+        journal->join(place.row);
+    const auto prior_row = std::prev(place.row_it);
+    const auto join_col = prior_row->size();
+    buffer.insert(prior_row, place.row - 1, prior_row->end(), place.row_it->begin(),
+                  place.row_it->end());
+    buffer.erase_row(place.row_it, place.row);
+    return {prior_row, place.row - 1, join_col};
+}
+
+Position cut_region(Buffer &buffer, Journal *journal, Buffer::iterator first_row_it,
+                    const Region &region)
+{
+    if(journal != nullptr)
+        journal->cut(region);
+    erase_region(buffer, first_row_it, region);
+    return {first_row_it, region.first_row, region.first_col};
+}
+
+Position insert_clip(Buffer &buffer, Journal *journal, const Position &place,
+                     const Clip &clip)
+{
+    if(journal != nullptr)
+        journal->paste(place.row, place.col, clip);
+    const auto region = paste(buffer, place.row_it, place.row, place.col, clip);
+    return {std::next(place.row_it, region.last_row - region.first_row),
+            region.last_row, region.last_col};
+}
+
+/**Moves to the row below/above, over any rows folded away*/
+static bool step_row(const Buffer &buffer, const Folds *folds, Position &place,
+                     bool down)
+{
+    if(down) {
+        const auto last = folds != nullptr ? folds->fold_end(place.row_it) : place.row_it;
+        if(std::next(last) == buffer.end())
+            return false;
+        if(folds != nullptr) {
+            folds->step_down(place.row_it, place.row);
+        } else {
+            ++place.row_it;
+            ++place.row;
+        }
+    } else {
+        if(place.row_it == buffer.begin())
+            return false;
+        if(folds != nullptr) {
+            folds->step_up(place.row_it, place.row);
+        } else {
+            --place.row_it;
+            --place.row;
+        }
+    }
+    return true;
+}
+
+bool move_left(const Buffer &buffer, const Folds *folds, Position &place)
+{
+    if(place.col > 0) {
+        place.col = prev_char(place.row_it->data(), place.col);
+        return true;
+    }
+    if(!step_row(buffer, folds, place, false))
+        return false;
+    place.col = place.row_it->size();
+    return true;
+}
+
+bool move_right(const Buffer &buffer, const Folds *folds, Position &place)
+{
+    const auto size = place.row_it->size();
+    if(place.col < size) {
+        place.col += glyph_at(place.row_it->data() + place.col, size - place.col, 0).len;
+        return true;
+    }
+    if(!step_row(buffer, folds, place, true))
+        return false;
+    place.col = 0;
+    return true;
+}
+
+bool move_vertically(const Buffer &buffer, const Folds *folds, Position &place,
+                     bool down, std::size_t column)
+{
+    if(!step_row(buffer, folds, place, down))
+        return false;
+    place.col = place.row_it->byte_at_column(column);
+    return true;
+}
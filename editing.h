@@ -0,0 +1,52 @@
+#ifndef EDITING_H
+#define EDITING_H
+#include <string>
+#include <string_view>
+#include "buffer.h"
+#include "folds.h"
+#include "journal.h"
+#include "kill-ring.h"
+#include "search.h"
+
+// The edits and moves that keypresses make at the cursor, apart from
+// anything to do with the screen or the undo history, so that the editor
+// and batch mode (which has no terminal) make them the same way. Each edit
+// is journaled if given a journal, and returns where the cursor ends up;
+// each move steps over folded rows if given folds, and returns false if
+// there is nowhere to go
+
+/**Puts text (which mustn't hold any newlines) in at place*/
+Position insert_text(Buffer &buffer, Journal *journal, const Position &place,
+                     std::string_view text);
+
+/**Splits place's row in two there, i.e. puts in a newline*/
+Position split_row(Buffer &buffer, Journal *journal, const Position &place);
+
+/**Erases the character (all of its bytes) before place or, at the start of
+   a row, the newline before it, joining the row onto the one before. erased
+   is set to what was taken out, which is nothing at the start of the
+   buffer*/
+Position erase_char_before(Buffer &buffer, Journal *journal, const Position &place,
+                           std::string &erased);
+
+/**Takes the region's text out, first_row_it being the row it starts on*/
+Position cut_region(Buffer &buffer, Journal *journal, Buffer::iterator first_row_it,
+                    const Region &region);
+
+/**Puts the clip's text in at place, ending up after it*/
+Position insert_clip(Buffer &buffer, Journal *journal, const Position &place,
+                     const Clip &clip);
+
+/**Moves place one character left, onto the end of the row above at the
+   start of a row*/
+bool move_left(const Buffer &buffer, const Folds *folds, Position &place);
+
+/**Moves place one character right, onto the start of the row below at the
+   end of a row*/
+bool move_right(const Buffer &buffer, const Folds *folds, Position &place);
+
+/**Moves place to the row above/below, onto the character shown at column
+   (or the end of the row, if it is shorter)*/
+bool move_vertically(const Buffer &buffer, const Folds *folds, Position &place,
+                     bool down, std::size_t column);
+#endif
@@ -0,0 +1,201 @@
+#include "event-loop.h"
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Bytes written to the self-pipe, saying why the loop was woken up
+constexpr char ResizeEvent = 'r';
+constexpr char PostEvent = 'p';
+
+// The pipe of the innermost running loop, for the SIGWINCH handler
+static volatile sig_atomic_t resize_pipe = -1;
+// How SIGWINCH was handled before any loop existed (i.e. by ncurses)
+static struct sigaction old_resize_action;
+
+static void on_resize_signal(int)
+{
+    const int saved_errno = errno;
+    if(resize_pipe != -1) {
+        // If the pipe is full, the loop is going to wake up anyway
+        [[maybe_unused]] const auto result = write(resize_pipe, &ResizeEvent, 1);
+    }
+    errno = saved_errno;
+}
+
+EventLoop::EventLoop(Screen &window)
+    : m_window(window), m_start(Clock::now())
+{
+    if(pipe(m_pipe) == 0) {
+        for(const int fd : m_pipe) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    } else {
+        m_pipe[0] = m_pipe[1] = -1;
+    }
+    m_outer_pipe = resize_pipe;
+    resize_pipe = m_pipe[1];
+    if(m_outer_pipe == -1) {
+        struct sigaction action{};
+        action.sa_handler = on_resize_signal;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGWINCH, &action, &old_resize_action);
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    resize_pipe = m_outer_pipe;
+    if(m_outer_pipe == -1)
+        sigaction(SIGWINCH, &old_resize_action, nullptr);
+    for(const int fd : m_pipe) {
+        if(fd != -1)
+            close(fd);
+    }
+}
+
+EventLoop::TimerId EventLoop::add_timer(unsigned int ms, Callback callback)
+{
+    const std::uint64_t ticks = std::max<std::uint64_t>(
+        1, (std::chrono::milliseconds(ms) + Tick - std::chrono::milliseconds(1)) / Tick);
+    const auto id = m_next_timer++;
+    m_wheel[(m_tick + ticks) % WheelSize].push_back(
+        {id, static_cast<std::size_t>((ticks - 1) / WheelSize), std::move(callback)});
+    ++m_timer_count;
+    return id;
+}
+
+void EventLoop::cancel_timer(TimerId id)
+{
+    for(auto &slot : m_wheel) {
+        for(auto timer = slot.begin(); timer != slot.end(); ++timer) {
+            if(timer->id == id) {
+                slot.erase(timer);
+                --m_timer_count;
+                return;
+            }
+        }
+    }
+}
+
+void EventLoop::post(Callback callback)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_posted_mutex);
+        m_posted.push_back(std::move(callback));
+    }
+    [[maybe_unused]] const auto result = write(m_pipe[1], &PostEvent, 1);
+}
+
+int EventLoop::next_timeout() const
+{
+    if(m_timer_count == 0)
+        return -1;
+    // Look for the first slot with something in it; a timer there may be
+    // due in a later round, but then the loop just wakes up a bit early
+    std::size_t ticks = 1;
+    while(ticks < WheelSize && m_wheel[(m_tick + ticks) % WheelSize].empty())
+        ++ticks;
+    const auto due = m_start + Tick * (m_tick + ticks);
+    const auto wait = std::chrono::ceil<std::chrono::milliseconds>(due - Clock::now());
+    return std::max<int>(0, wait.count());
+}
+
+/**Moves the wheel's hand up to the present, calling each timer that is due*/
+void EventLoop::run_timers()
+{
+    const std::uint64_t now_tick = (Clock::now() - m_start) / Tick;
+    if(m_timer_count == 0) {
+        m_tick = now_tick;
+        return;
+    }
+    std::vector<Callback> due;
+    for(; m_tick < now_tick && m_timer_count > 0; ++m_tick) {
+        auto &slot = m_wheel[(m_tick + 1) % WheelSize];
+        for(auto timer = slot.begin(); timer != slot.end();) {
+            if(timer->rounds > 0) {
+                --timer->rounds;
+                ++timer;
+            } else {
+                due.push_back(std::move(timer->callback));
+                timer = slot.erase(timer);
+                --m_timer_count;
+            }
+        }
+    }
+    m_tick = now_tick;
+    // Called last, since they may add or cancel timers
+    for(auto &callback : due)
+        callback();
+}
+
+void EventLoop::read_pipe()
+{
+    char events[64];
+    bool resized = false;
+    ssize_t count;
+    while((count = read(m_pipe[0], events, sizeof(events))) > 0) {
+        for(ssize_t i = 0; i < count; ++i)
+            resized = resized || events[i] == ResizeEvent;
+    }
+    if(resized) {
+        m_window.resize();
+        if(m_on_resize)
+            m_on_resize();
+    }
+    std::vector<Callback> posted;
+    {
+        std::lock_guard<std::mutex> lock(m_posted_mutex);
+        posted.swap(m_posted);
+    }
+    for(auto &callback : posted)
+        callback();
+}
+
+/**Hands each keypress that has come in to the key handler*/
+void EventLoop::read_keys()
+{
+    // A handler may have run a prompt that left the input blocking
+    m_window.set_input_timeout(0);
+    int key;
+    while(m_running && (key = m_window.get_input()) != ErrCode) {
+        // Resizing queues one of these; the resize was handled already
+        if(key != Key_Resize && m_on_key)
+            m_on_key(key);
+        m_window.set_input_timeout(0);
+    }
+}
+
+void EventLoop::run()
+{
+    m_running = true;
+    // Keys typed before the loop started are already waiting in ncurses
+    read_keys();
+    while(m_running) {
+        std::vector<pollfd> fds{{STDIN_FILENO, POLLIN, 0}, {m_pipe[0], POLLIN, 0}};
+        for(const auto &watched : m_watched)
+            fds.push_back({watched.first, POLLIN, 0});
+        const int timeout = m_on_idle ? 0 : next_timeout();
+        if(poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR)
+            break;
+        if(fds[1].revents & POLLIN)
+            read_pipe();
+        if(m_running && (fds[0].revents & POLLIN))
+            read_keys();
+        for(std::size_t i = 2; m_running && i < fds.size(); ++i) {
+            if(fds[i].revents & POLLIN)
+                m_watched[i - 2].second();
+        }
+        if(m_running)
+            run_timers();
+        if(m_running && m_on_idle) {
+            // Copied, since it may replace itself
+            const auto on_idle = m_on_idle;
+            on_idle();
+        }
+    }
+    m_window.set_input_timeout(-1);
+}
@@ -0,0 +1,90 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+#include <vector>
+#include <utility>
+#include <functional>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include "screen.h"
+
+/**Waits for and dispatches everything the UI thread reacts to: keypresses,
+   terminal resizes, timers, and callbacks posted from other threads. It
+   sleeps in poll() on the terminal, any watched descriptors, and a
+   self-pipe, which the SIGWINCH handler and post() write to, so background
+   work can wake it up (and update the screen) without a keypress. Loops
+   can be nested, e.g. a loop's key handler may run another loop until that
+   one is stopped*/
+class EventLoop {
+public:
+    using Callback = std::function<void()>;
+    using TimerId = std::uint64_t;
+    // Never the id of an actual timer
+    static constexpr TimerId NoTimer = 0;
+
+    explicit EventLoop(Screen &window);
+    ~EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    void on_key(std::function<void(int)> handler) { m_on_key = std::move(handler); }
+    /**Called after the screen has been resized to fit the terminal*/
+    void on_resize(Callback handler) { m_on_resize = std::move(handler); }
+    /**Called over and over while nothing else is waiting (the loop doesn't
+       sleep while this is set); pass nullptr to stop*/
+    void on_idle(Callback handler) { m_on_idle = std::move(handler); }
+    /**Calls handler whenever fd (e.g. an inotify descriptor) has something
+       to be read; the handler has to read it*/
+    void watch(int fd, Callback handler) { m_watched.push_back({fd, std::move(handler)}); }
+
+    /**Calls callback once, ms milliseconds from now (give or take a tick)*/
+    TimerId add_timer(unsigned int ms, Callback callback);
+    void cancel_timer(TimerId id);
+    /**Has callback run on the loop's thread soon; safe from any thread*/
+    void post(Callback callback);
+
+    /**Dispatches events until stop() is called*/
+    void run();
+    void stop() { m_running = false; }
+private:
+    using Clock = std::chrono::steady_clock;
+    // Length of a tick of the timer wheel, and how many slots it has
+    static constexpr auto Tick = std::chrono::milliseconds(10);
+    static constexpr std::size_t WheelSize = 256;
+
+    struct Timer {
+        TimerId id;
+        // How many more times the wheel must come around before it is due
+        std::size_t rounds;
+        Callback callback;
+    };
+
+    Screen &m_window;
+    // Read end, then write end
+    int m_pipe[2];
+    // What the SIGWINCH handler wrote to before this loop was made
+    int m_outer_pipe;
+    std::function<void(int)> m_on_key;
+    Callback m_on_resize;
+    Callback m_on_idle;
+    std::vector<std::pair<int, Callback>> m_watched;
+    bool m_running = false;
+
+    // Each slot holds the timers due when the wheel's hand comes round to it
+    std::vector<Timer> m_wheel[WheelSize];
+    std::size_t m_timer_count = 0;
+    TimerId m_next_timer = NoTimer + 1;
+    // Ticks since m_start that the hand has gone past
+    std::uint64_t m_tick = 0;
+    Clock::time_point m_start;
+
+    std::mutex m_posted_mutex;
+    std::vector<Callback> m_posted;
+
+    /**Milliseconds until the next timer is due, or -1 if none are set*/
+    int next_timeout() const;
+    void run_timers();
+    void read_pipe();
+    void read_keys();
+};
+#endif
@@ -0,0 +1,39 @@
+#include "file-io.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Most bytes asked for in one read; some systems refuse reads of 2GiB or more
+constexpr std::size_t MaxReadChunk = std::size_t(1) << 30;
+
+bool read_at(int fd, off_t offset, std::size_t len, char *out)
+{
+    while(len > 0) {
+        const ssize_t count = pread(fd, out, std::min(len, MaxReadChunk), offset);
+        if(count == -1 && errno == EINTR)
+            continue;
+        if(count <= 0)
+            return false;
+        out += count;
+        offset += count;
+        len -= count;
+    }
+    return true;
+}
+
+bool read_file(const char *filename, std::vector<char> &contents)
+{
+    const int fd = open(filename, O_RDONLY);
+    if(fd == -1)
+        return false;
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0;
+    if(ok) {
+        contents.resize(info.st_size);
+        ok = read_at(fd, 0, contents.size(), contents.data());
+    }
+    close(fd);
+    return ok;
+}
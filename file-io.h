@@ -0,0 +1,14 @@
+#ifndef FILE_IO_H
+#define FILE_IO_H
+#include <cstddef>
+#include <vector>
+#include <sys/types.h>
+
+/**Reads the len bytes at offset in the file, a chunk at a time (so files
+   of any size can be read) and going on when a read is interrupted; false
+   if the file ends before that or can't be read*/
+bool read_at(int fd, off_t offset, std::size_t len, char *out);
+
+/**Reads the whole of a file; false if it can't be read*/
+bool read_file(const char *filename, std::vector<char> &contents);
+#endif
@@ -0,0 +1,295 @@
+#include "file-watch.h"
+#include "file-io.h"
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <functional>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+// Most rows the diff lines up one by one; past that, every row between the
+// first and last difference is replaced
+constexpr std::size_t MaxDiffChanges = 1024;
+// Bytes of the file read at a time when it is diffed against the buffer
+constexpr std::size_t ReadWindow = 1 << 20;
+
+FileVersion FileVersion::of(const char *filename)
+{
+    FileVersion version;
+    struct stat info;
+    if(stat(filename, &info) == 0) {
+        version.device = info.st_dev;
+        version.inode = info.st_ino;
+        version.size = info.st_size;
+        version.modified = info.st_mtim;
+    }
+    return version;
+}
+
+bool FileVersion::operator==(const FileVersion &other) const
+{
+    return device == other.device && inode == other.inode && size == other.size
+        && modified.tv_sec == other.modified.tv_sec
+        && modified.tv_nsec == other.modified.tv_nsec;
+}
+
+FileWatch::FileWatch(const char *filename)
+{
+    const std::string path(filename);
+    const auto slash = path.rfind('/');
+    std::string directory(".");
+    if(slash != std::string::npos)
+        directory = slash == 0 ? "/" : path.substr(0, slash);
+    m_name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(m_fd != -1 && inotify_add_watch(m_fd, directory.c_str(),
+                                       IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE
+                                       | IN_MOVED_FROM | IN_MOVED_TO) == -1) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+FileWatch::~FileWatch()
+{
+    if(m_fd != -1)
+        close(m_fd);
+}
+
+bool FileWatch::changed()
+{
+    alignas(inotify_event) char events[4096];
+    bool about_file = false;
+    ssize_t count;
+    while((count = read(m_fd, events, sizeof(events))) > 0) {
+        for(const char *pos = events; pos < events + count;) {
+            const auto *event = reinterpret_cast<const inotify_event*>(pos);
+            // If events were dropped, any of them could have been about it
+            about_file = about_file || (event->mask & IN_Q_OVERFLOW)
+                || (event->len > 0 && m_name == event->name);
+            pos += sizeof(inotify_event) + event->len;
+        }
+    }
+    return about_file;
+}
+
+static bool same_text(const BufferRow &row, std::string_view text)
+{
+    return row.size() == text.size()
+        && (row.empty() || std::memcmp(row.data(), text.data(), row.size()) == 0);
+}
+
+/**Whether the file has only had bytes added at its end since version
+   loaded: it is the same file, bigger, and its first and last rows are
+   still where they were. Checking the rows in between too would mean
+   reading the whole file*/
+static bool only_grew(int fd, const Buffer &buffer, const FileVersion &loaded,
+                      const FileVersion &current)
+{
+    if(current.device != loaded.device || current.inode != loaded.inode
+       || current.size <= loaded.size || buffer.empty()
+       || buffer.back().origin() == BufferRow::NoOrigin
+       || buffer.back().origin() + static_cast<off_t>(buffer.back().size()) != loaded.size)
+        return false;
+    std::vector<char> text;
+    for(const auto *row : {&*buffer.begin(), &buffer.back()}) {
+        if(row->origin() == BufferRow::NoOrigin)
+            return false;
+        text.resize(row->size());
+        if(!read_at(fd, row->origin(), text.size(), text.data())
+           || !same_text(*row, {text.data(), text.size()}))
+            return false;
+    }
+    return true;
+}
+
+/**Adds the bytes the file grew by to the end of the buffer: up to the first
+   newline they carry on the last row, then each line is a new row*/
+static Reload append_rows(int fd, Buffer &buffer, const FileVersion &loaded,
+                          const FileVersion &current)
+{
+    Reload result;
+    std::vector<char> added(current.size - loaded.size);
+    if(!read_at(fd, loaded.size, added.size(), added.data()))
+        return result;
+    result.ok = true;
+    result.appended = true;
+    const char *end = added.data() + added.size();
+    const char *pos = added.data();
+    auto *newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+    const char *row_end = newline != nullptr ? newline : end;
+    if(row_end > pos) {
+        auto last = std::prev(buffer.end());
+        // Still all in one piece on disk
+        const auto origin = last->origin();
+        buffer.insert(last, buffer.size() - 1, last->end(), pos, row_end);
+        buffer.set_origin(last, origin);
+        ++result.rows_changed;
+    }
+    while(newline != nullptr) {
+        pos = newline + 1;
+        newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        row_end = newline != nullptr ? newline : end;
+        buffer.append(pos, row_end, loaded.size + (pos - added.data()));
+        ++result.rows_changed;
+    }
+    return result;
+}
+
+/**Lines of a file, read a window of bytes at a time rather than all at
+   once. The window is refilled from a line onward, or going backward up to
+   a line, so reading lines in order only reads each byte once*/
+class FileLines {
+public:
+    /**starts is where each line starts, plus where a line after the last
+       would (one past the end of the file)*/
+    FileLines(int fd, const std::vector<std::size_t> &starts) : m_fd(fd), m_starts(starts) {}
+
+    /**The text of a line (without its newline), only valid until the next
+       call; empty once reading has failed*/
+    std::string_view text(std::size_t line, bool backward = false)
+    {
+        const std::size_t first = m_starts[line];
+        const std::size_t last = m_starts[line + 1] - 1;
+        if(first < m_offset || last > m_offset + m_window.size()) {
+            const std::size_t size = m_starts.back() - 1;
+            const std::size_t len = std::min(std::max(ReadWindow, last - first), size);
+            m_offset = backward ? std::max(last, len) - len : std::min(first, size - len);
+            m_window.resize(len);
+            if(m_failed || !read_at(m_fd, m_offset, len, m_window.data())) {
+                m_failed = true;
+                m_window.clear();
+                return {};
+            }
+        }
+        return {m_window.data() + (first - m_offset), last - first};
+    }
+    /**Whether the file couldn't be read (e.g. it was cut short meanwhile)*/
+    bool failed() const { return m_failed; }
+private:
+    int m_fd;
+    const std::vector<std::size_t> &m_starts;
+    std::vector<char> m_window;
+    // Where in the file the window starts
+    std::size_t m_offset = 0;
+    bool m_failed = false;
+};
+
+/**Reads the file, replacing the rows that differ from its lines*/
+static Reload replace_changed_rows(int fd, Buffer &buffer, const FileVersion &current)
+{
+    Reload result;
+    const std::size_t size = current.size;
+    // Where each line starts, plus where a line after the last would
+    std::vector<std::size_t> starts;
+    // Most likely about as many lines as before
+    starts.reserve(buffer.size() + 2);
+    starts.push_back(0);
+    std::vector<char> window(std::min(size, ReadWindow));
+    for(std::size_t offset = 0; offset < size; offset += window.size()) {
+        const std::size_t len = std::min(window.size(), size - offset);
+        if(!read_at(fd, offset, len, window.data()))
+            return result;
+        const char *data = window.data();
+        const char *end = data + len;
+        for(const char *pos = data; pos < end; ++pos) {
+            pos = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+            if(pos == nullptr)
+                break;
+            starts.push_back(offset + (pos + 1 - data));
+        }
+    }
+    std::vector<char>().swap(window);
+    const std::size_t line_count = starts.size();
+    starts.push_back(size + 1);
+    FileLines lines(fd, starts);
+
+    // Rows that are the same at the start and end aren't diffed, which
+    // leaves little to do for most changes
+    std::size_t prefix = 0;
+    auto row = buffer.begin();
+    for(; prefix < line_count && row != buffer.end()
+            && same_text(*row, lines.text(prefix)); ++prefix, ++row)
+        buffer.set_origin(row, starts[prefix]);
+    std::size_t suffix = 0;
+    auto suffix_start = buffer.end();
+    while(suffix < line_count - prefix && suffix < buffer.size() - prefix
+          && same_text(*std::prev(suffix_start), lines.text(line_count - suffix - 1, true))) {
+        --suffix_start;
+        ++suffix;
+        buffer.set_origin(suffix_start, starts[line_count - suffix]);
+    }
+    if(lines.failed())
+        return result;
+
+    const std::hash<std::string_view> hash;
+    std::vector<std::uint64_t> old_rows;
+    std::vector<std::uint64_t> new_rows;
+    for(auto old_row = row; old_row != suffix_start; ++old_row)
+        old_rows.push_back(hash({old_row->data(), old_row->size()}));
+    for(auto line = prefix; line < line_count - suffix; ++line)
+        new_rows.push_back(hash(lines.text(line)));
+    if(lines.failed())
+        return result;
+    result.ok = true;
+    result.hunks = diff_rows(old_rows, new_rows, MaxDiffChanges);
+
+    // Rows are numbered as in the new file, since everything before the
+    // current one has been brought up to date
+    std::size_t line = prefix;
+    const auto replace = [&] {
+        const auto text = lines.text(line);
+        buffer.assign(row, line, RowText(text.data(), text.data() + text.size()));
+        buffer.set_origin(row, starts[line]);
+        ++row;
+        ++line;
+    };
+    // Rows the diff lined up only have matching hashes, so they are checked
+    const auto keep = [&] {
+        if(same_text(*row, lines.text(line))) {
+            buffer.set_origin(row, starts[line]);
+            ++row;
+            ++line;
+        } else {
+            ++result.rows_changed;
+            replace();
+        }
+    };
+    for(auto &hunk : result.hunks) {
+        hunk.old_first += prefix;
+        hunk.new_first += prefix;
+        while(line < hunk.new_first)
+            keep();
+        const auto replaced = std::min(hunk.old_count, hunk.new_count);
+        for(std::size_t i = 0; i < replaced; ++i)
+            replace();
+        for(std::size_t i = replaced; i < hunk.old_count; ++i)
+            row = buffer.erase_row(row, line);
+        for(std::size_t i = replaced; i < hunk.new_count; ++i) {
+            row = buffer.insert_row(row, line);
+            replace();
+        }
+        result.rows_changed += std::max(hunk.old_count, hunk.new_count);
+    }
+    while(line < line_count - suffix)
+        keep();
+    // Cut short while being replaced; reloading again catches up
+    result.ok = !lines.failed();
+    return result;
+}
+
+Reload reload(Buffer &buffer, const char *filename, const FileVersion &loaded,
+              const FileVersion &current)
+{
+    const int fd = open(filename, O_RDONLY);
+    if(fd == -1)
+        return {};
+    auto result = only_grew(fd, buffer, loaded, current)
+        ? append_rows(fd, buffer, loaded, current) : replace_changed_rows(fd, buffer, current);
+    close(fd);
+    return result;
+}
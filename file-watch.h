@@ -0,0 +1,71 @@
+#ifndef FILE_WATCH_H
+#define FILE_WATCH_H
+#include <string>
+#include <vector>
+#include <ctime>
+#include <sys/types.h>
+#include "buffer.h"
+#include "diff.h"
+
+/**Identifies what a file held at some point: if any of these differ, the
+   file has been written to (or replaced) since*/
+struct FileVersion {
+    dev_t device = 0;
+    ino_t inode = 0;
+    // -1 if the file couldn't be found
+    off_t size = -1;
+    timespec modified{};
+
+    /**The version of the file on disk now*/
+    static FileVersion of(const char *filename);
+    bool operator==(const FileVersion &other) const;
+    bool operator!=(const FileVersion &other) const { return !(*this == other); }
+};
+
+/**Notices when a file is changed by another process, using inotify. The
+   file's directory is watched rather than the file itself, so the file
+   being replaced (the way most editors, this one included, save it) is
+   seen too, and its replacement goes on being watched*/
+class FileWatch {
+public:
+    explicit FileWatch(const char *filename);
+    ~FileWatch();
+    FileWatch(const FileWatch&) = delete;
+    FileWatch& operator=(const FileWatch&) = delete;
+
+    /**Readable when there are events to look at; -1 if the file can't be
+       watched*/
+    int fd() const { return m_fd; }
+    /**Reads every event waiting on fd(); returns true if any of them were
+       about the file*/
+    bool changed();
+private:
+    // The file's name within its directory
+    std::string m_name;
+    int m_fd = -1;
+};
+
+/**What reload() did to the buffer*/
+struct Reload {
+    // False if the file couldn't be read. The buffer is left alone then,
+    // unless the file was cut short while its rows were being replaced
+    // (most likely by being written again), which reloading again finishes
+    bool ok = false;
+    // Whether the file had only grown, so its new rows were just added on
+    bool appended = false;
+    // How many rows were added, removed or replaced
+    std::size_t rows_changed = 0;
+    // Which rows were replaced by which, for keeping the cursor in place
+    // (left empty when appending)
+    std::vector<DiffHunk> hunks;
+};
+
+/**Brings a buffer without unsaved edits, whose rows were read from version
+   loaded of the file, up to date with version current on disk. If the
+   file grew in place with its old first and last rows still there, as logs
+   do, only the new bytes are read and added as rows. Otherwise the file is
+   read and diffed against the buffer, and only rows that differ are
+   replaced. Either way the rows' origins end up pointing into the new file*/
+Reload reload(Buffer &buffer, const char *filename, const FileVersion &loaded,
+              const FileVersion &current);
+#endif
@@ -0,0 +1,236 @@
+#include "folds.h"
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+void Folds::fold(const Buffer &buffer, Buffer::iterator header, std::size_t row,
+                 std::size_t count)
+{
+    if(!m_built) {
+        m_rows.assign(std::vector<ShownRows>(buffer.size(), ShownRows{1}));
+        m_built = true;
+    }
+    reveal(header, row);
+    std::size_t last = std::min(row + count, buffer.size() - 1);
+    auto row_it = header;
+    for(std::size_t i = row; i <= last; ++i, ++row_it) {
+        if(i > row)
+            m_rows.set(i, {0});
+        const auto inner = m_folds.find(&*row_it);
+        if(inner == m_folds.end())
+            continue;
+        // Its rows are hidden already; skip over them
+        const auto inner_fold = inner->second;
+        m_headers.erase(&*inner_fold.last);
+        m_folds.erase(inner);
+        last = std::max(last, i + inner_fold.count);
+        i += inner_fold.count;
+        row_it = inner_fold.last;
+    }
+    const auto last_it = std::prev(row_it);
+    m_folds[&*header] = {last_it, last - row};
+    m_headers[&*last_it] = header;
+}
+
+bool Folds::unfold(Buffer::iterator header, std::size_t row)
+{
+    const auto found = m_folds.find(&*header);
+    if(found == m_folds.end())
+        return false;
+    for(std::size_t i = row + 1; i <= row + found->second.count; ++i)
+        m_rows.set(i, {1});
+    m_headers.erase(&*found->second.last);
+    m_folds.erase(found);
+    m_changed = true;
+    return true;
+}
+
+void Folds::unfold_all()
+{
+    if(!m_folds.empty())
+        m_changed = true;
+    m_rows = RowTree<ShownRows>();
+    m_built = false;
+    m_folds.clear();
+    m_headers.clear();
+}
+
+void Folds::reveal(Buffer::iterator row_it, std::size_t row)
+{
+    if(!hidden(row))
+        return;
+    const auto header = header_of(row);
+    unfold(std::prev(row_it, row - header), header);
+}
+
+bool Folds::take_changed()
+{
+    const bool changed = m_changed;
+    m_changed = false;
+    return changed;
+}
+
+bool Folds::hidden(std::size_t row) const
+{
+    return m_built && row < m_rows.size() && m_rows.row(row).count == 0;
+}
+
+std::size_t Folds::hidden_after(Buffer::iterator row_it) const
+{
+    const auto found = m_folds.find(&*row_it);
+    return found != m_folds.end() ? found->second.count : 0;
+}
+
+Buffer::iterator Folds::fold_end(Buffer::iterator row_it) const
+{
+    const auto found = m_folds.find(&*row_it);
+    return found != m_folds.end() ? found->second.last : row_it;
+}
+
+void Folds::step_down(Buffer::iterator &row_it, std::size_t &row) const
+{
+    const auto found = m_folds.find(&*row_it);
+    if(found != m_folds.end()) {
+        row_it = found->second.last;
+        row += found->second.count;
+    }
+    ++row_it;
+    ++row;
+}
+
+void Folds::step_up(Buffer::iterator &row_it, std::size_t &row) const
+{
+    --row_it;
+    --row;
+    const auto found = m_headers.find(&*row_it);
+    if(found != m_headers.end()) {
+        row -= m_folds.at(&*found->second).count;
+        row_it = found->second;
+    }
+}
+
+std::size_t Folds::shown_before(std::size_t row) const
+{
+    return m_built ? m_rows.prefix(row).count : row;
+}
+
+std::size_t Folds::shown_row(std::size_t index) const
+{
+    if(!m_built)
+        return index;
+    const auto row = m_rows.find_next(0, [index](ShownRows before, ShownRows run) {
+        return before.count + run.count > index;
+    });
+    return row != m_rows.NoRow ? row : shown_above(m_rows.size());
+}
+
+std::size_t Folds::shown_above(std::size_t row) const
+{
+    if(!m_built)
+        return row > 0 ? row - 1 : row;
+    const auto above = m_rows.find_prev(row, [](ShownRows, ShownRows run) {
+        return run.count > 0;
+    });
+    return above != m_rows.NoRow ? above : row;
+}
+
+std::size_t Folds::shown_below(std::size_t row) const
+{
+    if(!m_built)
+        return row + 1;
+    const auto below = m_rows.find_next(row + 1, [](ShownRows, ShownRows run) {
+        return run.count > 0;
+    });
+    return below != m_rows.NoRow ? below : row;
+}
+
+std::size_t Folds::header_of(std::size_t row) const
+{
+    return shown_above(row);
+}
+
+void Folds::update(Buffer::RowChange change, std::size_t row, Buffer::iterator row_it)
+{
+    if(!m_built)
+        return;
+    switch(change) {
+    case Buffer::RowChange::Inserted:
+        // Rows going in among a fold's rows (before a hidden one) open it
+        reveal(row_it, row);
+        m_rows.insert(row, {1});
+        break;
+    case Buffer::RowChange::Changed:
+        reveal(row_it, row);
+        break;
+    case Buffer::RowChange::Erased:
+        reveal(row_it, row);
+        unfold(row_it, row);
+        m_rows.erase(row);
+        break;
+    }
+}
+
+/**The section started by the nearest heading at or above row*/
+static bool find_section(const HighlightMode &mode, const Snapshot &rows, std::size_t row,
+                         std::size_t &header, std::size_t &last)
+{
+    const auto level_of = [&](std::size_t index) {
+        const auto &text = rows.row(index);
+        return mode.heading(text.data(), text.data() + text.size());
+    };
+    int level = 0;
+    for(header = row + 1; header-- > 0;) {
+        level = level_of(header);
+        if(level > 0)
+            break;
+    }
+    if(level == 0)
+        return false;
+    for(last = header + 1; last < rows.size(); ++last) {
+        const int next = level_of(last);
+        if(next > 0 && next <= level)
+            break;
+    }
+    --last;
+    return true;
+}
+
+/**The block opened by the first '{' on row closed on a later one, or else
+   the innermost block around the row; the row with its closing brace is
+   left showing*/
+static bool find_block(const BracketIndex &brackets, const Snapshot &rows, std::size_t row,
+                       std::size_t &header, std::size_t &last)
+{
+    BracketIndex::Place opener, closer;
+    if(!brackets.find_block(rows, row, opener, closer)) {
+        opener = {row, 0};
+        do {
+            if(!brackets.find_enclosing(rows, opener.row, opener.col, opener))
+                return false;
+        } while(rows.row(opener.row).data()[opener.col] != '{');
+        bool mismatched;
+        brackets.find_match(rows, opener.row, opener.col, closer, mismatched);
+    }
+    header = opener.row;
+    last = closer.row > 0 ? closer.row - 1 : 0;
+    return true;
+}
+
+bool find_fold(const HighlightMode &mode, const BracketIndex &brackets, const Snapshot &rows,
+               std::size_t row, std::size_t &header, std::size_t &count)
+{
+    std::size_t last;
+    if(mode.heading != nullptr) {
+        if(!find_section(mode, rows, row, header, last))
+            return false;
+    } else if(brackets.enabled()) {
+        if(!find_block(brackets, rows, row, header, last))
+            return false;
+    } else {
+        return false;
+    }
+    if(last <= header)
+        return false;
+    count = last - header;
+    return true;
+}
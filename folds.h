@@ -0,0 +1,92 @@
+#ifndef FOLDS_H
+#define FOLDS_H
+#include <cstddef>
+#include <unordered_map>
+#include "buffer.h"
+#include "brackets.h"
+#include "row-tree.h"
+
+/**How many rows in a run of rows are shown (rather than folded away)*/
+struct ShownRows {
+    std::size_t count = 0;
+
+    friend ShownRows operator+(ShownRows first, ShownRows second)
+    {
+        return {first.count + second.count};
+    }
+};
+
+/**Runs of rows folded out of sight, each shown as just the row before it
+   (its header). Which rows are hidden is kept in a RowTree, so that the
+   screen rows between two rows can be counted, and the row some number of
+   screen rows down found, in O(log n) however many folds there are; each
+   fold also remembers its last row, so that moving past it is O(1). A
+   fold is opened again if any of its rows are edited, inserted between or
+   erased (including its header), so its rows never change while folded.
+   Nothing is kept until the first fold is made*/
+class Folds {
+public:
+    /**Hides the count rows after header (at index row). Folds within them
+       are merged into this one, and it grows to cover any fold that it
+       would cut in half*/
+    void fold(const Buffer &buffer, Buffer::iterator header, std::size_t row,
+              std::size_t count);
+    /**Shows the rows folded away after header; false if there were none*/
+    bool unfold(Buffer::iterator header, std::size_t row);
+    void unfold_all();
+    /**Opens the fold hiding a row (if any), so that it can be shown*/
+    void reveal(Buffer::iterator row_it, std::size_t row);
+    /**Whether folds have been opened since the last time this was asked,
+       e.g. by edits, so that the rows onscreen may have moved*/
+    bool take_changed();
+
+    bool empty() const { return m_folds.empty(); }
+    bool hidden(std::size_t row) const;
+    /**How many rows the fold after row_it hides (0 if it isn't a header)*/
+    std::size_t hidden_after(Buffer::iterator row_it) const;
+    /**The last row of the fold after row_it, or row_it if it isn't a header*/
+    Buffer::iterator fold_end(Buffer::iterator row_it) const;
+    /**Moves to the next/previous row that is shown (which may be the end)*/
+    void step_down(Buffer::iterator &row_it, std::size_t &row) const;
+    void step_up(Buffer::iterator &row_it, std::size_t &row) const;
+
+    /**How many rows shown there are before row (the screen row it is on,
+       when not wrapping, if the top of the buffer is at the top)*/
+    std::size_t shown_before(std::size_t row) const;
+    /**The row shown the given number of rows shown from the top; the last
+       row shown if there are fewer*/
+    std::size_t shown_row(std::size_t index) const;
+    /**The row shown just above/below row (or row, at the top/bottom)*/
+    std::size_t shown_above(std::size_t row) const;
+    std::size_t shown_below(std::size_t row) const;
+
+    /**Keeps the folds in place as the buffer changes; given to
+       Buffer::on_change()*/
+    void update(Buffer::RowChange change, std::size_t row, Buffer::iterator row_it);
+private:
+    struct Fold {
+        Buffer::iterator last;
+        std::size_t count;
+    };
+
+    // Each row's count is 1 if it is shown, 0 if not; empty until there
+    // are folds
+    RowTree<ShownRows> m_rows;
+    bool m_built = false;
+    // Folds by their headers, and headers by the last rows of their folds
+    std::unordered_map<const BufferRow*, Fold> m_folds;
+    std::unordered_map<const BufferRow*, Buffer::iterator> m_headers;
+    bool m_changed = false;
+
+    /**The header of the fold hiding a row*/
+    std::size_t header_of(std::size_t row) const;
+};
+
+/**Finds what to fold at a row: the first block opened with '{' on it
+   where the mode matches brackets, or the section started by a heading on
+   it; failing that, the innermost one around it. Sets header to the row
+   left showing and count to how many rows after it to hide; false if
+   there is nothing to fold (or nothing but the header to it)*/
+bool find_fold(const HighlightMode &mode, const BracketIndex &brackets, const Snapshot &rows,
+               std::size_t row, std::size_t &header, std::size_t &count);
+#endif
@@ -0,0 +1,127 @@
+#include "grep.h"
+#include "search.h"
+#include <cstring>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// How much of each match's line is kept
+constexpr std::size_t MaxLineLength = 256;
+// Files with a zero byte this close to the start are taken to be binary
+constexpr std::size_t BinaryCheckLength = 1024;
+
+ProjectSearch::ProjectSearch(const std::string &directory, std::string text)
+    : m_text(std::move(text))
+{
+    if(m_text.empty())
+        return;
+    m_pool.push([this, directory] { walk(directory); });
+}
+
+ProjectSearch::~ProjectSearch()
+{
+    m_stopping = true;
+    m_pool.stop();
+}
+
+void ProjectSearch::take_matches(std::vector<GrepMatch> &out)
+{
+    std::lock_guard<std::mutex> lock(m_matches_mutex);
+    std::move(m_matches.begin(), m_matches.end(), std::back_inserter(out));
+    m_matches.clear();
+}
+
+/**Queues a task for each file and subdirectory of a directory*/
+void ProjectSearch::walk(const std::string &directory)
+{
+    DIR *dir = opendir(directory.c_str());
+    if(dir == nullptr)
+        return;
+    while(const dirent *entry = readdir(dir)) {
+        if(m_stopping)
+            break;
+        // Skips . and .. along with hidden files
+        if(entry->d_name[0] == '.')
+            continue;
+        std::string path = directory + '/' + entry->d_name;
+        auto type = entry->d_type;
+        if(type == DT_UNKNOWN) {
+            // Not every file system fills in d_type
+            struct stat info;
+            if(lstat(path.c_str(), &info) != 0)
+                continue;
+            type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_LNK;
+        }
+        if(type == DT_DIR)
+            m_pool.push([this, path] { walk(path); });
+        else if(type == DT_REG)
+            m_pool.push([this, path] { search(path); });
+    }
+    closedir(dir);
+}
+
+void ProjectSearch::search(const std::string &path)
+{
+    if(m_stopping)
+        return;
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd == -1)
+        return;
+    struct stat info;
+    const char *data = nullptr;
+    std::size_t size = 0;
+    if(fstat(fd, &info) == 0 && info.st_size > 0) {
+        size = info.st_size;
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapping != MAP_FAILED) {
+            data = static_cast<const char*>(mapping);
+            madvise(mapping, size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+    ++m_files_searched;
+    if(data == nullptr)
+        return;
+
+    std::vector<GrepMatch> matches;
+    if(std::memchr(data, '\0', std::min(size, BinaryCheckLength)) == nullptr) {
+        // Count lines only up to each match, rather than splitting the file up
+        const char *end = data + size;
+        const char *counted = data;
+        std::size_t line = 0;
+        const char *found = data;
+        while((found = find_literal(found, end - found, m_text)) != nullptr) {
+            line += std::count(counted, found, '\n');
+            const char *line_start = found;
+            while(line_start != data && line_start[-1] != '\n')
+                --line_start;
+            auto *line_end = static_cast<const char*>(std::memchr(found, '\n', end - found));
+            if(line_end == nullptr)
+                line_end = end;
+            matches.push_back({path, line, std::string(
+                line_start, std::min<std::size_t>(line_end - line_start, MaxLineLength))});
+            // One match per line is enough
+            counted = found;
+            found = line_end;
+        }
+    }
+    munmap(const_cast<char*>(data), size);
+    if(!matches.empty())
+        add_matches(matches);
+}
+
+void ProjectSearch::add_matches(std::vector<GrepMatch> &matches)
+{
+    std::lock_guard<std::mutex> lock(m_matches_mutex);
+    const auto room = MaxMatches - m_match_count;
+    if(matches.size() >= room) {
+        matches.resize(room);
+        // That's all the matches anyone will look through
+        m_stopping = true;
+    }
+    m_match_count += matches.size();
+    std::move(matches.begin(), matches.end(), std::back_inserter(m_matches));
+}
@@ -0,0 +1,51 @@
+#ifndef GREP_H
+#define GREP_H
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "work-pool.h"
+
+/**A line of some file that contains the text searched for*/
+struct GrepMatch {
+    std::string path;
+    // Counting from 0
+    std::size_t line;
+    // The start of the line (enough of it to fill a screen row)
+    std::string text;
+};
+
+/**Searches every file under a directory for some text in the background.
+   Walking each directory and searching each file are separate tasks on a
+   WorkPool, so files are searched while the walk is still going. Files are
+   mapped into memory rather than read; hidden files/directories, symbolic
+   links and files that look binary are skipped*/
+class ProjectSearch {
+public:
+    ProjectSearch(const std::string &directory, std::string text);
+    ~ProjectSearch();
+    ProjectSearch(const ProjectSearch&) = delete;
+    ProjectSearch& operator=(const ProjectSearch&) = delete;
+
+    /**Appends the matches found since the last call to out*/
+    void take_matches(std::vector<GrepMatch> &out);
+    std::size_t files_searched() const { return m_files_searched; }
+    /**True once every file has been searched (or MaxMatches were found)*/
+    bool done() const { return m_pool.idle(); }
+    /**Most matches kept; the search stops once this many are found*/
+    static constexpr std::size_t MaxMatches = 100000;
+private:
+    const std::string m_text;
+    std::mutex m_matches_mutex;
+    std::vector<GrepMatch> m_matches;
+    std::size_t m_match_count = 0;
+    std::atomic<std::size_t> m_files_searched{0};
+    std::atomic<bool> m_stopping{false};
+    // Last, so its threads stop before anything they use is destroyed
+    WorkPool m_pool;
+
+    void walk(const std::string &directory);
+    void search(const std::string &path);
+    void add_matches(std::vector<GrepMatch> &matches);
+};
+#endif
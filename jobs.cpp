@@ -0,0 +1,74 @@
+#include "jobs.h"
+
+void CancelToken::cancel()
+{
+    std::unique_lock<std::mutex> lock(m_state->mutex);
+    m_state->cancelled = true;
+    m_state->stopped.wait(lock, [this]{ return m_state->running == 0; });
+}
+
+JobScheduler::JobScheduler(EventLoop &loop)
+    : m_loop(loop)
+{
+    const std::size_t worker_count = std::max(1u, std::thread::hardware_concurrency());
+    for(std::size_t i = 0; i < worker_count; ++i)
+        m_workers.emplace_back(&JobScheduler::run, this);
+}
+
+JobScheduler::~JobScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeup.notify_all();
+    for(auto &worker : m_workers)
+        worker.join();
+}
+
+void JobScheduler::submit(Priority priority, const CancelToken &token, Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push({priority, m_next_sequence++, token, std::move(job)});
+    }
+    m_wakeup.notify_one();
+}
+
+void JobScheduler::run()
+{
+    while(true) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wakeup.wait(lock, [this]{ return m_stopping || !m_queue.empty(); });
+        if(m_stopping)
+            return;
+        // The queue only hands out const references
+        Entry entry = std::move(const_cast<Entry&>(m_queue.top()));
+        m_queue.pop();
+        lock.unlock();
+
+        auto &state = *entry.token.m_state;
+        {
+            // Once cancel() has returned, no more of its jobs may start
+            std::lock_guard<std::mutex> state_lock(state.mutex);
+            if(state.cancelled)
+                continue;
+            ++state.running;
+        }
+        auto deliver = entry.job();
+        entry.job = nullptr;
+        if(deliver && !entry.token.cancelled()) {
+            // Checked again on the loop's thread, in case it was cancelled
+            // in the meantime
+            m_loop.post([token = entry.token, deliver = std::move(deliver)] {
+                if(!token.cancelled())
+                    deliver();
+            });
+        }
+        {
+            std::lock_guard<std::mutex> state_lock(state.mutex);
+            --state.running;
+        }
+        state.stopped.notify_all();
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef JOBS_H
+#define JOBS_H
+#include <vector>
+#include <queue>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "event-loop.h"
+
+/**Which background work runs first when several jobs are waiting*/
+enum class Priority : char {
+    // Needed to draw what is onscreen
+    Visible,
+    // Searching the user is waiting on
+    Search,
+    // Other work on the whole buffer
+    WholeFile,
+    // Reading in the rest of the file
+    Indexing
+};
+
+/**Shared between some jobs and whoever wants to call them off. Jobs check
+   cancelled() every so often and return early once it is set; a job that
+   hasn't started by then never will*/
+class CancelToken {
+public:
+    CancelToken() : m_state(std::make_shared<State>()) {}
+
+    bool cancelled() const { return m_state->cancelled.load(std::memory_order_relaxed); }
+    /**Calls off the jobs, waiting for any that are running to return (so
+       e.g. the buffer can be edited right after); don't call from a job*/
+    void cancel();
+private:
+    friend class JobScheduler;
+    struct State {
+        std::atomic<bool> cancelled{false};
+        // Jobs with this token that are running, guarded by mutex
+        std::size_t running = 0;
+        std::mutex mutex;
+        std::condition_variable stopped;
+    };
+    std::shared_ptr<State> m_state;
+};
+
+/**Runs jobs on a fixed number of worker threads (one per core), highest
+   Priority first and otherwise in the order they were submitted. A job may
+   return a callback, which is run on the event loop's thread as long as its
+   token hasn't been cancelled by then, so results made stale (e.g. by an
+   edit) are never delivered*/
+class JobScheduler {
+public:
+    using Callback = std::function<void()>;
+    using Job = std::function<Callback()>;
+
+    explicit JobScheduler(EventLoop &loop);
+    /**Drops the jobs that haven't started and waits for the rest*/
+    ~JobScheduler();
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    void submit(Priority priority, const CancelToken &token, Job job);
+private:
+    struct Entry {
+        Priority priority;
+        // Breaks ties so that jobs of equal priority run in order
+        std::uint64_t sequence;
+        CancelToken token;
+        Job job;
+
+        bool operator<(const Entry &other) const
+        {
+            // std::priority_queue takes the greatest first
+            if(priority != other.priority)
+                return priority > other.priority;
+            return sequence > other.sequence;
+        }
+    };
+
+    EventLoop &m_loop;
+    std::priority_queue<Entry> m_queue;
+    std::uint64_t m_next_sequence = 0;
+    bool m_stopping = false;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::vector<std::thread> m_workers;
+
+    void run();
+};
+#endif
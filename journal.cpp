@@ -0,0 +1,448 @@
+#include "journal.h"
+#include "file-io.h"
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// How long the commit thread waits for more edits before syncing a batch
+constexpr auto CommitInterval = std::chrono::milliseconds(200);
+constexpr char Magic[] = {'E', 'D', 'J', '1'};
+// Record types
+constexpr char Insert = 'i';
+constexpr char Erase = 'e';
+constexpr char Split = 's';
+constexpr char Join = 'j';
+constexpr char Replace = 'r';
+constexpr char Copy = 'c';
+constexpr char Cut = 'x';
+constexpr char Paste = 'p';
+
+/**Appends value in LEB128 form (7 bits per byte, high bit set if more follow)*/
+static void put_number(std::vector<char> &out, unsigned long long value)
+{
+    while(value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/**Decodes a number written by put_number; returns false if the input
+   ends partway through it*/
+static bool get_number(const char *&pos, const char *end, unsigned long long &value)
+{
+    value = 0;
+    for(int shift = 0; pos < end && shift < 64; shift += 7) {
+        const auto byte = static_cast<unsigned char>(*pos++);
+        value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+Journal::Journal(const char *filename)
+    : m_filename(filename), m_path(m_filename + ".editorial-journal")
+{
+    read_header();
+    m_committer = std::thread(&Journal::commit_loop, this);
+}
+
+Journal::~Journal()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeup.notify_one();
+    m_committer.join();
+    if(m_fd != -1)
+        close(m_fd);
+}
+
+/**The header identifies the version of the file on disk that the edits
+   were made against, so a journal is never replayed over a file that
+   changed in the meantime*/
+void Journal::read_header()
+{
+    struct stat info;
+    m_header.assign(std::begin(Magic), std::end(Magic));
+    if(stat(m_filename.c_str(), &info) == 0) {
+        put_number(m_header, info.st_ino);
+        put_number(m_header, info.st_size);
+        put_number(m_header, info.st_mtime);
+    }
+}
+
+bool Journal::recoverable() const
+{
+    std::vector<char> header(m_header.size());
+    const int fd = open(m_path.c_str(), O_RDONLY);
+    if(fd == -1)
+        return false;
+    const bool matches = read_at(fd, 0, header.size(), header.data())
+        && header == m_header;
+    close(fd);
+    return matches;
+}
+
+std::size_t Journal::replay(Buffer &buffer)
+{
+    std::vector<char> contents;
+    if(!read_file(m_path.c_str(), contents))
+        return 0;
+    if(contents.size() < m_header.size()
+       || !std::equal(m_header.begin(), m_header.end(), contents.begin()))
+        // Left over from a different version of the file; start over
+        return 0;
+
+    // Edits tend to be near each other, so walk to each one from the last
+    auto row_it = buffer.begin();
+    std::size_t curr_row = 0;
+    auto seek = [&](unsigned long long row) {
+        if(row >= buffer.size())
+            return false;
+        while(curr_row < row) { ++row_it; ++curr_row; }
+        while(curr_row > row) { --row_it; --curr_row; }
+        return true;
+    };
+
+    const char *pos = contents.data() + m_header.size();
+    const char *end = contents.data() + contents.size();
+    // End of the last record that was applied in full
+    const char *good_end = pos;
+    std::size_t count = 0;
+    // The clips Copy records took, for Paste records to put back in
+    std::vector<Clip> clips;
+    while(pos < end) {
+        const char op = *pos++;
+        if(op == Replace) {
+            if(!replay_replace(buffer, pos, end))
+                break;
+            good_end = pos;
+            ++count;
+            continue;
+        }
+        if(op == Copy || op == Cut || op == Paste) {
+            if(!replay_clip(op, buffer, pos, end, clips))
+                break;
+            good_end = pos;
+            if(op != Copy)
+                ++count;
+            // Rows may have gone, including the one walked to last
+            row_it = buffer.begin();
+            curr_row = 0;
+            continue;
+        }
+        unsigned long long row, col, len = 0;
+        if(!get_number(pos, end, row) || !get_number(pos, end, col)
+           || ((op == Insert || op == Erase) && !get_number(pos, end, len))
+           || (op == Insert && static_cast<unsigned long long>(end - pos) < len)
+           || !seek(row) || col > row_it->size())
+            // Cut off by a crash or corrupted; keep what came before
+            break;
+
+        const auto col_it = std::next(row_it->begin(), col);
+        if(op == Insert) {
+            buffer.insert(row_it, row, col_it, pos, pos + len);
+            pos += len;
+        } else if(op == Erase && col + len <= row_it->size()) {
+            buffer.erase(row_it, row, col_it, std::next(col_it, len));
+        } else if(op == Split) {
+            auto next_row = buffer.insert_row(std::next(row_it), row + 1);
+            buffer.insert(next_row, row + 1, next_row->end(), col_it, row_it->end());
+            buffer.erase(row_it, row, col_it, row_it->end());
+        } else if(op == Join && row > 0) {
+            auto prior_row = std::prev(row_it);
+            buffer.insert(prior_row, row - 1, prior_row->end(), row_it->begin(),
+                          row_it->end());
+            buffer.erase_row(row_it, row);
+            row_it = prior_row;
+            --curr_row;
+        } else {
+            break;
+        }
+        good_end = pos;
+        ++count;
+    }
+
+    // Keep appending to the recovered journal, minus any partial record
+    std::lock_guard<std::mutex> file_lock(m_file_mutex);
+    m_fd = open(m_path.c_str(), O_WRONLY | O_APPEND);
+    if(m_fd != -1 && ftruncate(m_fd, good_end - contents.data()) == 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_started = true;
+        m_edited = count > 0;
+        m_clips = clips.size();
+    }
+    return count;
+}
+
+/**Applies a Replace record (minus its type byte) starting at pos, moving pos
+   past it; returns false if it is cut off or doesn't fit the buffer.
+   Occurrences are stored as each row's distance from the last row, then the
+   number of occurrences in the row, then each one's distance from the end
+   of the last*/
+bool Journal::replay_replace(Buffer &buffer, const char *&pos, const char *end)
+{
+    unsigned long long len, new_len, row_count;
+    if(!get_number(pos, end, len) || !get_number(pos, end, new_len)
+       || static_cast<unsigned long long>(end - pos) < new_len)
+        return false;
+    const std::string_view replacement(pos, new_len);
+    pos += new_len;
+    if(!get_number(pos, end, row_count))
+        return false;
+
+    MatchList matches;
+    auto row_it = buffer.begin();
+    std::size_t row = 0;
+    for(unsigned long long i = 0; i < row_count; ++i) {
+        unsigned long long row_delta, col_count;
+        if(!get_number(pos, end, row_delta) || !get_number(pos, end, col_count)
+           || row_delta >= buffer.size() - row || (i > 0 && row_delta == 0))
+            return false;
+        row += row_delta;
+        std::advance(row_it, row_delta);
+        matches.push_back({row, {}});
+        std::size_t col = 0;
+        for(unsigned long long j = 0; j < col_count; ++j) {
+            unsigned long long col_delta;
+            if(!get_number(pos, end, col_delta) || col_delta > row_it->size() - col
+               || len > row_it->size() - col - col_delta)
+                return false;
+            matches.back().cols.push_back(col + col_delta);
+            col += col_delta + len;
+        }
+    }
+    replace_at(buffer, matches, len, replacement);
+    return true;
+}
+
+/**Applies a Copy, Cut or Paste record (minus its type byte) starting at pos,
+   moving pos past it; returns false if it is cut off or doesn't fit the
+   buffer. Regions are stored as their first row and column, then how many
+   rows further on they end and the column there. Copy records add to
+   clips, which Paste records refer to by index*/
+bool Journal::replay_clip(char op, Buffer &buffer, const char *&pos, const char *end,
+                          std::vector<Clip> &clips)
+{
+    if(op == Paste) {
+        unsigned long long row, col, index;
+        if(!get_number(pos, end, row) || !get_number(pos, end, col)
+           || !get_number(pos, end, index) || row >= buffer.size() || index >= clips.size())
+            return false;
+        const auto row_it = std::next(buffer.begin(), row);
+        if(col > row_it->size())
+            return false;
+        ::paste(buffer, row_it, row, col, clips[index]);
+        return true;
+    }
+    unsigned long long first_row, first_col, rows, last_col;
+    if(!get_number(pos, end, first_row) || !get_number(pos, end, first_col)
+       || !get_number(pos, end, rows) || !get_number(pos, end, last_col)
+       || first_row >= buffer.size() || rows >= buffer.size() - first_row)
+        return false;
+    const Region region{first_row, first_col, first_row + rows, last_col};
+    const auto first_row_it = std::next(buffer.begin(), first_row);
+    if(first_col > first_row_it->size()
+       || last_col > std::next(first_row_it, rows)->size()
+       || (rows == 0 && last_col < first_col))
+        return false;
+    if(op == Copy)
+        clips.push_back({buffer.snapshot(), region});
+    else
+        erase_region(buffer, first_row_it, region);
+    return true;
+}
+
+void Journal::begin_record(char op)
+{
+    // The journal file always starts with the header
+    if(!m_started) {
+        m_pending.insert(m_pending.end(), m_header.begin(), m_header.end());
+        m_started = true;
+    }
+    if(op != Copy)
+        m_edited = true;
+    m_pending.push_back(op);
+}
+
+void Journal::put_region(const Region &region)
+{
+    put_number(m_pending, region.first_row);
+    put_number(m_pending, region.first_col);
+    put_number(m_pending, region.last_row - region.first_row);
+    put_number(m_pending, region.last_col);
+}
+
+void Journal::record(char op, std::size_t row, std::size_t col,
+                     const char *text, std::size_t len)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        begin_record(op);
+        put_number(m_pending, row);
+        put_number(m_pending, col);
+        if(op == Insert || op == Erase)
+            put_number(m_pending, len);
+        if(text != nullptr)
+            m_pending.insert(m_pending.end(), text, text + len);
+    }
+    m_wakeup.notify_one();
+}
+
+void Journal::insert(std::size_t row, std::size_t col, const char *text, std::size_t len)
+{
+    record(Insert, row, col, text, len);
+}
+
+void Journal::erase(std::size_t row, std::size_t col, std::size_t len)
+{
+    record(Erase, row, col, nullptr, len);
+}
+
+void Journal::split(std::size_t row, std::size_t col) { record(Split, row, col); }
+
+void Journal::join(std::size_t row) { record(Join, row, 0); }
+
+void Journal::replace(const MatchList &matches, std::size_t len, std::string_view replacement)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        begin_record(Replace);
+        put_number(m_pending, len);
+        put_number(m_pending, replacement.size());
+        m_pending.insert(m_pending.end(), replacement.begin(), replacement.end());
+        put_number(m_pending, matches.size());
+        std::size_t row = 0;
+        for(const auto &row_matches : matches) {
+            put_number(m_pending, row_matches.row - row);
+            row = row_matches.row;
+            put_number(m_pending, row_matches.cols.size());
+            std::size_t col = 0;
+            for(const auto match_col : row_matches.cols) {
+                put_number(m_pending, match_col - col);
+                col = match_col + len;
+            }
+        }
+    }
+    m_wakeup.notify_one();
+}
+
+void Journal::copy(Clip &clip)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        begin_record(Copy);
+        put_region(clip.region);
+        clip.journal_generation = m_generation;
+        clip.journal_index = m_clips++;
+    }
+    m_wakeup.notify_one();
+}
+
+void Journal::cut(const Region &region)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        begin_record(Cut);
+        put_region(region);
+    }
+    m_wakeup.notify_one();
+}
+
+void Journal::paste(std::size_t row, std::size_t col, const Clip &clip)
+{
+    bool journaled;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        journaled = clip.journal_generation == m_generation;
+        if(journaled) {
+            begin_record(Paste);
+            put_number(m_pending, row);
+            put_number(m_pending, col);
+            put_number(m_pending, clip.journal_index);
+        }
+    }
+    if(journaled) {
+        m_wakeup.notify_one();
+        return;
+    }
+    // Replaying can only take clips from the buffer as it was since the
+    // reset, so the text goes in a row at a time
+    const auto &region = clip.region;
+    for(auto clip_row = region.first_row; clip_row <= region.last_row; ++clip_row) {
+        const auto &text = clip.rows.row(clip_row);
+        const auto first = clip_row == region.first_row ? region.first_col : 0;
+        const auto last = clip_row == region.last_row ? region.last_col : text.size();
+        if(clip_row > region.first_row) {
+            split(row, col);
+            ++row;
+            col = 0;
+        }
+        if(last > first)
+            insert(row, col, text.data() + first, last - first);
+        col += last - first;
+    }
+}
+
+void Journal::reset()
+{
+    std::lock_guard<std::mutex> file_lock(m_file_mutex);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_generation;
+    m_pending.clear();
+    m_started = false;
+    m_edited = false;
+    m_clips = 0;
+    if(m_fd != -1) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    unlink(m_path.c_str());
+    read_header();
+}
+
+/**Group commit: after the first edit of a batch arrives, wait a little for
+   others so that a burst of typing is written and synced all at once*/
+void Journal::commit_loop()
+{
+    std::vector<char> batch;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(!m_stopping || !m_pending.empty()) {
+        m_wakeup.wait(lock, [this]{ return m_stopping || !m_pending.empty(); });
+        m_wakeup.wait_for(lock, CommitInterval, [this]{ return m_stopping; });
+        if(m_pending.empty())
+            continue;
+        batch.swap(m_pending);
+        const auto generation = m_generation;
+        lock.unlock();
+
+        {
+            std::lock_guard<std::mutex> file_lock(m_file_mutex);
+            if(generation == m_generation) {
+                if(m_fd == -1)
+                    m_fd = open(m_path.c_str(),
+                                O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+                const char *pos = batch.data();
+                std::size_t remaining = batch.size();
+                while(m_fd != -1 && remaining > 0) {
+                    const ssize_t written = write(m_fd, pos, remaining);
+                    if(written <= 0)
+                        break;
+                    pos += written;
+                    remaining -= written;
+                }
+                if(m_fd != -1)
+                    fsync(m_fd);
+            }
+        }
+        batch.clear();
+        lock.lock();
+    }
+}
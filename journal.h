@@ -0,0 +1,87 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+#include <string>
+#include <vector>
+#include <string_view>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sys/types.h>
+#include "buffer.h"
+#include "replace.h"
+#include "kill-ring.h"
+
+/**Append-only log of every edit made to a file's buffer since it was last
+   saved, kept next to the file so a crashed or disconnected session can be
+   recovered. Edits are encoded into memory on the keystroke path; a
+   background thread writes and fsyncs them in batches*/
+class Journal {
+public:
+    explicit Journal(const char *filename);
+    ~Journal();
+    /**True if an earlier session left behind edits to this version of the file*/
+    bool recoverable() const;
+    /**Applies any edits left behind by an earlier session that ended
+       without saving; returns the number of edits recovered*/
+    std::size_t replay(Buffer &buffer);
+
+    void insert(std::size_t row, std::size_t col, const char *text, std::size_t len);
+    void erase(std::size_t row, std::size_t col, std::size_t len);
+    /**Splits the row in two at col (i.e. a newline was inserted)*/
+    void split(std::size_t row, std::size_t col);
+    /**Appends the row to the one before it (i.e. a newline was deleted)*/
+    void join(std::size_t row);
+    /**The len bytes at each of matches were replaced with replacement*/
+    void replace(const MatchList &matches, std::size_t len, std::string_view replacement);
+    /**The clip was just taken from the buffer; it is numbered, so that
+       pasting it can be journaled without its text. Not counted as an edit*/
+    void copy(Clip &clip);
+    /**The region's text was taken out*/
+    void cut(const Region &region);
+    /**The clip's text was put in at (row, col); if it was taken before the
+       journal was last reset, its text has to be journaled after all*/
+    void paste(std::size_t row, std::size_t col, const Clip &clip);
+
+    /**True if edits have been made since the last reset(), i.e. the
+       buffer has unsaved edits*/
+    bool has_edits() const { return m_edited; }
+
+    /**Removes the journal and starts over; call after the buffer has been
+       saved to disk or when quitting without saving*/
+    void reset();
+private:
+    const std::string m_filename;
+    const std::string m_path;
+    // Identity of the on-disk file the journaled edits apply to
+    std::vector<char> m_header;
+    // Encoded edits not yet handed to the commit thread
+    std::vector<char> m_pending;
+    // Whether the header has been queued/written since the last reset
+    bool m_started = false;
+    // Whether any edits have been, too
+    bool m_edited = false;
+    // How many clips have been journaled since the last reset
+    std::size_t m_clips = 0;
+    bool m_stopping = false;
+    // Bumped on reset so batches from before it are never written
+    unsigned long m_generation = 0;
+    int m_fd = -1;
+    std::mutex m_mutex;
+    // Held while touching the journal file itself
+    std::mutex m_file_mutex;
+    std::condition_variable m_wakeup;
+    std::thread m_committer;
+
+    void read_header();
+    /**Starts a record of type op in m_pending; m_mutex must be held*/
+    void begin_record(char op);
+    bool replay_replace(Buffer &buffer, const char *&pos, const char *end);
+    bool replay_clip(char op, Buffer &buffer, const char *&pos, const char *end,
+                     std::vector<Clip> &clips);
+    /**Adds a region to m_pending; m_mutex must be held*/
+    void put_region(const Region &region);
+    void record(char op, std::size_t row, std::size_t col,
+                const char *text = nullptr, std::size_t len = 0);
+    void commit_loop();
+};
+#endif
@@ -0,0 +1,77 @@
+#include "kill-ring.h"
+#include <algorithm>
+#include <iterator>
+
+Region region_between(std::size_t row, std::size_t col, std::size_t other_row,
+                      std::size_t other_col)
+{
+    if(row < other_row || (row == other_row && col <= other_col))
+        return {row, col, other_row, other_col};
+    return {other_row, other_col, row, col};
+}
+
+/**Bytes [first, last) of one text followed by bytes [other_first,
+   other_last) of another. When either part is empty and the other is all
+   of its text, that text is shared rather than copied*/
+static RowText join_text(const RowText &text, std::size_t first, std::size_t last,
+                         const RowText &other, std::size_t other_first,
+                         std::size_t other_last)
+{
+    if(first == last && other_first == 0 && other_last == other.size())
+        return other;
+    if(other_first == other_last && first == 0 && last == text.size())
+        return text;
+    RowText joined;
+    char *out = joined.open(0, (last - first) + (other_last - other_first));
+    out = std::copy(text.data() + first, text.data() + last, out);
+    std::copy(other.data() + other_first, other.data() + other_last, out);
+    return joined;
+}
+
+void erase_region(Buffer &buffer, Buffer::iterator first_row_it, const Region &region)
+{
+    if(region.first_row == region.last_row) {
+        buffer.erase(first_row_it, region.first_row, first_row_it->begin() + region.first_col,
+                     first_row_it->begin() + region.last_col);
+        return;
+    }
+    auto row_it = std::next(first_row_it);
+    for(auto row = region.first_row + 1; row < region.last_row; ++row)
+        row_it = buffer.erase_row(row_it, region.first_row + 1);
+    // What is left of the last row goes on the end of the first
+    buffer.assign(first_row_it, region.first_row,
+                  join_text(first_row_it->text(), 0, region.first_col,
+                            row_it->text(), region.last_col, row_it->size()));
+    buffer.erase_row(row_it, region.first_row + 1);
+}
+
+Region paste(Buffer &buffer, Buffer::iterator row_it, std::size_t row, std::size_t col,
+             const Clip &clip)
+{
+    const auto &region = clip.region;
+    const RowText &first = clip.rows.row(region.first_row);
+    if(region.first_row == region.last_row) {
+        buffer.insert(row_it, row, row_it->begin() + col, first.data() + region.first_col,
+                      first.data() + region.last_col);
+        return {row, col, row, col + region.last_col - region.first_col};
+    }
+    // The text after col ends up after the clip's last row
+    const RowText old_text = row_it->text();
+    buffer.assign(row_it, row, join_text(old_text, 0, col, first, region.first_col,
+                                         first.size()));
+    const auto next = std::next(row_it);
+    std::size_t at = row + 1;
+    for(auto clip_row = region.first_row + 1; clip_row < region.last_row; ++clip_row, ++at)
+        buffer.insert_row(next, at, clip.rows.row(clip_row));
+    const RowText &last = clip.rows.row(region.last_row);
+    buffer.insert_row(next, at, join_text(last, 0, region.last_col, old_text, col,
+                                          old_text.size()));
+    return {row, col, at, region.last_col};
+}
+
+void KillRing::push(Clip clip)
+{
+    m_clips.push_front(std::move(clip));
+    if(m_clips.size() > MaxClips)
+        m_clips.pop_back();
+}
@@ -0,0 +1,72 @@
+#ifndef KILL_RING_H
+#define KILL_RING_H
+#include <cstddef>
+#include <deque>
+#include "buffer.h"
+
+/**The text between two places in the buffer: from byte first_col of row
+   first_row up to (but not including) byte last_col of row last_row, with
+   the newlines between the rows*/
+struct Region {
+    std::size_t first_row = 0;
+    std::size_t first_col = 0;
+    std::size_t last_row = 0;
+    std::size_t last_col = 0;
+
+    bool empty() const { return first_row == last_row && first_col == last_col; }
+    bool operator==(const Region &other) const
+    {
+        return first_row == other.first_row && first_col == other.first_col
+            && last_row == other.last_row && last_col == other.last_col;
+    }
+    bool operator!=(const Region &other) const { return !(*this == other); }
+};
+
+/**The region between two places, whichever comes first*/
+Region region_between(std::size_t row, std::size_t col, std::size_t other_row,
+                      std::size_t other_col);
+
+/**Text cut or copied from the buffer. Rather than the bytes, it holds a
+   snapshot of the rows it came from and where it is in them, so taking one
+   is O(1) however big it is, and its rows are shared with the buffer (and
+   with every row it is pasted into) instead of copied*/
+struct Clip {
+    static constexpr unsigned long NotJournaled = static_cast<unsigned long>(-1);
+
+    Snapshot rows;
+    Region region;
+    // Which clip the journal knows it as (see Journal::copy()), as long as
+    // the journal hasn't been reset since
+    unsigned long journal_generation = NotJournaled;
+    std::size_t journal_index = 0;
+};
+
+/**Takes the region's text out of the buffer, first_row_it being the row it
+   starts on. Rows it runs all the way through are dropped rather than
+   rebuilt*/
+void erase_region(Buffer &buffer, Buffer::iterator first_row_it, const Region &region);
+
+/**Puts the clip's text in at byte col of the given row, returning the region
+   it now takes up. Only the bytes that end up on the same row as text that
+   was already there are copied; every other row shares its text with the
+   clip, so pasting the same clip again and again only costs a row's
+   bookkeeping per row*/
+Region paste(Buffer &buffer, Buffer::iterator row_it, std::size_t row, std::size_t col,
+             const Clip &clip);
+
+/**The last few clips cut or copied, newest first*/
+class KillRing {
+public:
+    // Older clips are dropped beyond this many, so that the snapshots they
+    // keep alive don't pile up
+    static constexpr std::size_t MaxClips = 16;
+
+    bool empty() const { return m_clips.empty(); }
+    std::size_t size() const { return m_clips.size(); }
+    /**The clip index places from the newest (0 is the newest)*/
+    const Clip& at(std::size_t index) const { return m_clips[index]; }
+    void push(Clip clip);
+private:
+    std::deque<Clip> m_clips;
+};
+#endif
@@ -0,0 +1,181 @@
+#include "loader.h"
+#include "file-io.h"
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Size of the pieces of the file indexed by each worker at a time
+constexpr off_t ChunkSize = 1 << 22;
+// Most bytes added to the buffer per call to load_some()
+constexpr off_t SliceSize = 1 << 22;
+
+Loader::Loader(const char *filename, Buffer &buffer, std::size_t first_rows,
+               JobScheduler &jobs)
+    : m_buffer(buffer)
+{
+    const int fd = open(filename, O_RDONLY);
+    if(fd == -1) {
+        // If file doesn't exist, create it
+        close(open(filename, O_WRONLY | O_CREAT, 0644));
+    } else {
+        struct stat info;
+        if(fstat(fd, &info) == 0 && info.st_size > 0) {
+            m_size = info.st_size;
+            void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapping != MAP_FAILED) {
+                m_data = static_cast<const char*>(mapping);
+                m_mapped = true;
+            } else {
+                m_contents.resize(m_size);
+                if(!read_at(fd, 0, m_size, m_contents.data()))
+                    m_size = 0;
+                m_data = m_contents.data();
+            }
+        }
+        close(fd);
+    }
+
+    // Add the first screenful directly, so it can be shown right away
+    while(m_buffer.size() < first_rows && m_row_start < m_size) {
+        auto *newline = static_cast<const char*>(
+            std::memchr(m_data + m_row_start, '\n', m_size - m_row_start));
+        if(newline == nullptr)
+            break;
+        add_row(newline - m_data);
+    }
+
+    m_chunk_count = (m_size + ChunkSize - 1) / ChunkSize;
+    m_chunks.reset(new Chunk[m_chunk_count]);
+    if(m_chunk_count == 0) {
+        finish();
+        return;
+    }
+    // Submitted in file order, which is the order they are needed in
+    for(std::size_t i = 0; i < m_chunk_count; ++i) {
+        jobs.submit(Priority::Indexing, m_indexing, [this, i] {
+            index_chunk(i);
+            return nullptr;
+        });
+    }
+    // The cursor needs at least one row to sit on
+    load_rows(1);
+}
+
+Loader::~Loader()
+{
+    m_indexing.cancel();
+    if(m_mapped)
+        munmap(const_cast<char*>(m_data), m_size);
+}
+
+/**Records the newlines in one chunk of the file*/
+void Loader::index_chunk(std::size_t index)
+{
+    auto &chunk = m_chunks[index];
+    const off_t start = index * ChunkSize;
+    const off_t end = std::min(start + ChunkSize, m_size);
+    const char *pos = m_data + start;
+    const char *chunk_end = m_data + end;
+    while(pos < chunk_end) {
+        auto *newline = static_cast<const char*>(
+            std::memchr(pos, '\n', chunk_end - pos));
+        if(newline == nullptr)
+            break;
+        chunk.newlines.push_back(newline - m_data);
+        pos = newline + 1;
+    }
+    m_indexed_bytes += end - start;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        chunk.ready = true;
+    }
+    m_chunk_ready.notify_all();
+}
+
+int Loader::indexed_percent() const
+{
+    return m_size == 0 ? 100 : m_indexed_bytes * 100 / m_size;
+}
+
+int Loader::loaded_percent() const
+{
+    return m_size == 0 || m_done ? 100 : m_row_start * 100 / m_size;
+}
+
+void Loader::add_row(off_t end)
+{
+    m_buffer.append(m_data + m_row_start, m_data + end, m_row_start);
+    m_row_start = end + 1;
+}
+
+/**Adds the final row (everything after the last newline) and releases
+   the file now that every row has been copied into the buffer*/
+void Loader::finish()
+{
+    m_buffer.append(m_data + m_row_start, m_data + m_size, m_row_start);
+    m_done = true;
+    m_chunks.reset();
+    if(m_mapped)
+        munmap(const_cast<char*>(m_data), m_size);
+    m_mapped = false;
+    std::vector<char>().swap(m_contents);
+}
+
+/**Returns true if the current chunk's newlines are available, waiting for
+   them for a short while (or, if block is set, indefinitely) if not*/
+bool Loader::wait_for_chunk(bool block)
+{
+    auto &chunk = m_chunks[m_curr_chunk];
+    if(chunk.ready)
+        return true;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(block)
+        m_chunk_ready.wait(lock, [&chunk]{ return chunk.ready.load(); });
+    else
+        m_chunk_ready.wait_for(lock, std::chrono::milliseconds(10),
+                               [&chunk]{ return chunk.ready.load(); });
+    return chunk.ready;
+}
+
+void Loader::load_some()
+{
+    if(m_done || !wait_for_chunk(false))
+        return;
+    const off_t slice_end = m_row_start + SliceSize;
+    while(!m_done && m_row_start < slice_end && m_chunks[m_curr_chunk].ready) {
+        auto &newlines = m_chunks[m_curr_chunk].newlines;
+        for(; m_curr_newline < newlines.size() && m_row_start < slice_end;
+            ++m_curr_newline) {
+            // Rows added before indexing started were already taken care of
+            if(newlines[m_curr_newline] >= m_row_start)
+                add_row(newlines[m_curr_newline]);
+        }
+        if(m_curr_newline < newlines.size())
+            break;
+        // Done with this chunk; free its index and move on to the next
+        std::vector<off_t>().swap(newlines);
+        m_curr_newline = 0;
+        if(++m_curr_chunk == m_chunk_count)
+            finish();
+    }
+}
+
+void Loader::load_rows(std::size_t count)
+{
+    while(!m_done && m_buffer.size() < count) {
+        wait_for_chunk(true);
+        load_some();
+    }
+}
+
+void Loader::load_all()
+{
+    while(!m_done) {
+        wait_for_chunk(true);
+        load_some();
+    }
+}
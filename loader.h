@@ -0,0 +1,74 @@
+#ifndef LOADER_H
+#define LOADER_H
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <sys/types.h>
+#include "buffer.h"
+#include "jobs.h"
+
+/**Fills a buffer from a file progressively: the first screenful of rows is
+   added right away, while Indexing jobs find the newlines in the rest of the
+   file, one chunk each. The indexed rows are then added to
+   the buffer in slices (or on demand) from the UI thread, which is the
+   only thread that touches the buffer*/
+class Loader {
+public:
+    /**Opens the file (creating it if needed) and adds at least its first
+       first_rows rows to the buffer*/
+    Loader(const char *filename, Buffer &buffer, std::size_t first_rows,
+           JobScheduler &jobs);
+    ~Loader();
+    Loader(const Loader&) = delete;
+    Loader& operator=(const Loader&) = delete;
+
+    /**True once every row of the file is in the buffer*/
+    bool done() const { return m_done; }
+    /**Percentage of the file whose newlines have been found*/
+    int indexed_percent() const;
+    /**Percentage of the file that has been added to the buffer*/
+    int loaded_percent() const;
+
+    /**Adds the next slice of indexed rows to the buffer, waiting briefly for
+       indexing to catch up if needed*/
+    void load_some();
+    /**Blocks until the buffer holds at least count rows (or the whole file)*/
+    void load_rows(std::size_t count);
+    void load_all();
+private:
+    struct Chunk {
+        // Offsets of each newline found within the chunk
+        std::vector<off_t> newlines;
+        std::atomic<bool> ready{false};
+    };
+
+    Buffer &m_buffer;
+    const char *m_data = nullptr;
+    off_t m_size = 0;
+    bool m_mapped = false;
+    // Used instead of a mapping when the file can't be mmap'd
+    std::vector<char> m_contents;
+
+    std::unique_ptr<Chunk[]> m_chunks;
+    std::size_t m_chunk_count = 0;
+    std::atomic<off_t> m_indexed_bytes{0};
+    // Calls off the indexing jobs
+    CancelToken m_indexing;
+    std::mutex m_mutex;
+    std::condition_variable m_chunk_ready;
+
+    // The chunk whose rows are being added to the buffer next
+    std::size_t m_curr_chunk = 0;
+    std::size_t m_curr_newline = 0;
+    // Offset in the file where the next row to be added starts
+    off_t m_row_start = 0;
+    bool m_done = false;
+
+    void index_chunk(std::size_t index);
+    bool wait_for_chunk(bool block);
+    void add_row(off_t end);
+    void finish();
+};
+#endif
@@ -4,118 +4,511 @@
 [X] Find more concise way to write highlighting code (maybe code gen?)
 [ ] Implement undo-redo functionality (maybe can do with macros??)
 [ ] Implement macro system that lets you record/play back keystrokes*/
-#include <fstream>
 #include <cstdio>
-#include <list>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
 #include <vector>
 #include <algorithm>
 #include <iterator>
 #include <string>
 #include <string_view>
+#include <functional>
+#include <chrono>
 #include "screen.h"
 #include "syntax-highlight.h"
+#include "buffer.h"
+#include "columns.h"
+#include "journal.h"
+#include "loader.h"
+#include "pager.h"
+#include "search.h"
+#include "replace.h"
+#include "kill-ring.h"
+#include "editing.h"
+#include "grep.h"
+#include "event-loop.h"
+#include "jobs.h"
+#include "file-watch.h"
+#include "brackets.h"
+#include "folds.h"
+#include "completion.h"
+#include "symbols.h"
+#include "diff-gutter.h"
+#include "batch.h"
+#include "work-pool.h"
+#include <sys/stat.h>
+#include <unistd.h>
 
-constexpr std::size_t TabSize = 4; // in spaces
+// The current syntax highlighting mode; set when loading a file
+const HighlightMode *highlight_mode = &text_mode;
+// Whether long rows are wrapped onto several screen rows (toggled by Ctrl-w)
+bool soft_wrap = false;
+// When wrapping, which of the top row's screen rows is at the top of the screen
+std::size_t top_segment = 0;
+// How long messages stay at the top of the screen without a keypress
+constexpr unsigned int MessageTimeout = 3000;
+// How often the list of matches in other files is updated while searching
+constexpr unsigned int GrepRefreshInterval = 100;
+// How often the pager shows how much of the file has been indexed
+constexpr unsigned int IndexRefreshInterval = 250;
+// How long to wait after the file changes on disk before reloading it, so
+// that a burst of writes is reloaded once
+constexpr unsigned int ReloadDelay = 100;
+// What is being searched for; its matches onscreen are shown in reverse video
+Query search_query;
+// What was last found with find(), which Enter on an empty query finds again
+Query last_query;
+/**A bracket shown in reverse video: the one under the cursor, or the one
+   matching it*/
+struct MarkedBracket {
+    static constexpr std::size_t NoRow = static_cast<std::size_t>(-1);
+    std::size_t row = NoRow;
+    std::size_t col = 0;
 
-using BufferRow = std::vector<char>;
-using Buffer = std::list<BufferRow>;
+    bool operator==(const MarkedBracket &other) const
+    {
+        return row == other.row && col == other.col;
+    }
+    bool operator!=(const MarkedBracket &other) const { return !(*this == other); }
+};
+MarkedBracket marked_brackets[2];
+// Where every cursor is while there are several (the main one included),
+// in order; edits are made at all of them at once
+MatchList cursors;
+// The text selected (between where selecting started and the cursor),
+// shown in reverse video
+Region selection;
+// Rows of the file being edited that are folded out of sight
+Folds folds;
+// Which rows of the file being edited differ from the file on disk
+DiffGutter diff_gutter;
+// Shown after the header of a fold
+constexpr char FoldMarker[] = " ...";
+// The most completions Ctrl-n cycles through
+constexpr std::size_t MaxCompletions = 50;
 
-// The current syntax highlighting mode; set when loading a file
-void(*highlight_mode)(Screen&,int,int);
+/**Draws bytes [first_byte, last_byte) of a row onto the given screen row,
+   where the left edge of the screen is at onscreen column left_col of the
+   row. Tabs are expanded and UTF-8 is decoded, with any invalid bytes
+   shown as '?'*/
+static void draw_text(Screen &window, const BufferRow &text, int row,
+                      std::size_t first_byte, std::size_t last_byte,
+                      std::size_t left_col)
+{
+    const std::size_t width = window.width();
+    std::size_t text_col = text.column_of(first_byte);
+    const char *letter = text.data() + first_byte;
+    const char *text_end = text.data() + last_byte;
+    while(text_col < left_col + width && letter != text_end) {
+        const auto glyph = glyph_at(letter, text_end - letter, text_col);
+        const bool fits = text_col >= left_col
+            && text_col + glyph.width <= left_col + width;
+        if(*letter == '\t' || !fits) {
+            // Fill in whatever part of it is onscreen with blanks
+            for(auto col = std::max(text_col, left_col);
+                col < std::min(text_col + glyph.width, left_col + width); ++col)
+                window.set(col - left_col, row, ' ');
+        } else if(std::isspace(static_cast<unsigned char>(*letter))) {
+            window.set(text_col - left_col, row, ' ');
+        } else if(!glyph.valid || std::iscntrl(static_cast<unsigned char>(*letter))) {
+            window.set(text_col - left_col, row, '?');
+        } else if(glyph.len > 1) {
+            window.set(text_col - left_col, row, letter, glyph.len);
+        } else {
+            window.set(text_col - left_col, row, *letter);
+        }
+        text_col += glyph.width;
+        letter += glyph.len;
+    }
+}
+
+/**Shows the matches of query among bytes [first_byte, last_byte) of a row,
+   drawn as in draw_text(), in reverse video*/
+static void mark_matches(Screen &window, Query &query, const BufferRow &text,
+                         int row, std::size_t first_byte, std::size_t last_byte,
+                         std::size_t left_col)
+{
+    const std::size_t width = window.width();
+    last_byte = std::min(last_byte, text.byte_at_column(left_col + width));
+    // Literal text may start just left of the screen and still show up
+    const std::size_t lookback = query.is_regex() ? 0 : query.text().size() - 1;
+    std::size_t start = first_byte - std::min(first_byte, lookback);
+    std::size_t match_start, match_end;
+    while(query.find(text.data(), text.size(), start, last_byte, match_start, match_end)) {
+        const auto first_col = text.column_of(std::max(match_start, first_byte));
+        const auto end_col = text.column_of(std::min(match_end, last_byte));
+        for(auto col = std::max(first_col, left_col);
+            col < std::min(end_col, left_col + width); ++col)
+            window.set_reverse(col - left_col, row);
+        start = match_start + 1;
+    }
+}
 
-/**Writes as much of the given char grid to the screen as will fit;
-   no line-wrapping (lines will be cut off when at edge)*/
-void draw(Screen &window, const Buffer &buffer, int start_row = 0)
+/**Marks a screen row in the gutter with how the row drawn there differs
+   from the file on disk*/
+static void draw_gutter(Screen &window, int row, DiffGutter::Mark mark)
+{
+    switch(mark) {
+    case DiffGutter::Mark::None:
+        window.set_gutter(row, " ", 1);
+        break;
+    case DiffGutter::Mark::Added:
+        window.set_gutter(row, "+", 1, Color::Green);
+        break;
+    case DiffGutter::Mark::Changed:
+        window.set_gutter(row, "~", 1, Color::Yellow);
+        break;
+    case DiffGutter::Mark::RemovedBelow:
+        window.set_gutter(row, "_", 1, Color::Red);
+        break;
+    case DiffGutter::Mark::RemovedAbove:
+        window.set_gutter(row, "\u203e", 3, Color::Red);
+        break;
+    }
+}
+
+/**Writes as much of the given char grid to the screen as will fit, starting
+   from onscreen column left_col of each row; no line-wrapping (lines will be
+   cut off when at edge) unless soft_wrap is on, in which case each row is
+   laid out over as many screen rows as it needs, starting from screen row
+   top_segment of the first row. Once the diff gutter is built, rows that
+   differ from the file on disk are marked in it (on their first screen row)*/
+void draw(Screen &window, const Buffer &buffer, int start_row = 0,
+          std::size_t left_col = 0)
 {
     const int width = window.width();
     const int height = window.height();
+    // Highlighting state at the left edge of each row onscreen
+    std::vector<LexState> row_states(height);
+    // The part of each screen row that search matches are looked for in
+    struct Shown {
+        const BufferRow *text;
+        std::size_t index;
+        std::size_t first_byte, last_byte, left_col;
+        // Whether the row is the header of a fold
+        bool folded;
+    };
+    std::vector<Shown> shown;
+    LexState state = 0;
     int row = 0;
+    std::size_t segment = soft_wrap ? top_segment : 0;
     /* Starting drawing using content starting at the row currently at
        The top of the screen */
     auto curr_row = std::next(buffer.begin(), start_row);
+    std::size_t index = start_row;
+    const bool gutter = diff_gutter.built();
     while(row < height && curr_row != buffer.end()) {
-	int col = 0;
-	auto letter = curr_row->begin();
-	while(col < width && letter != curr_row->end()) {
-	    if(std::isspace(*letter))
-		window.set(col++, row, ' ');
-	    else
-		window.set(col++, row, *letter);
-	    ++letter;
-	}
-	++row;
-	++curr_row;
+        const bool folded = folds.hidden_after(curr_row) > 0;
+        if(soft_wrap) {
+            const auto &points = curr_row->wrap_points(width);
+            for(; segment <= points.size() && row < height; ++segment, ++row) {
+                const std::size_t first = segment == 0 ? 0 : points[segment - 1];
+                const std::size_t last = segment < points.size() ? points[segment]
+                    : curr_row->size();
+                row_states[row] = lex_state_at(*highlight_mode, *curr_row, state, first);
+                draw_text(window, *curr_row, row, first, last, curr_row->column_of(first));
+                if(gutter)
+                    draw_gutter(window, row, segment == 0 ? diff_gutter.mark(index)
+                                : DiffGutter::Mark::None);
+                shown.push_back({&*curr_row, index, first, last,
+                                 curr_row->column_of(first), folded});
+            }
+            segment = 0;
+        } else {
+            // A tab/wide character may start just left of the screen's edge
+            const auto first_byte = curr_row->byte_at_column(left_col);
+            row_states[row] = lex_state_at(*highlight_mode, *curr_row, state, first_byte);
+            draw_text(window, *curr_row, row, first_byte, curr_row->size(), left_col);
+            if(gutter)
+                draw_gutter(window, row, diff_gutter.mark(index));
+            shown.push_back({&*curr_row, index, first_byte, curr_row->size(), left_col,
+                             folded});
+            ++row;
+        }
+        if(row < height && highlight_mode->carried != 0
+           && std::next(curr_row) != buffer.end())
+            // Carry the state at the end of this row over to the next one
+            state = lex_state_at(*highlight_mode, *curr_row, state, curr_row->size())
+                & highlight_mode->carried;
+	// Skip over the rows folded away after it
+	folds.step_down(curr_row, index);
     }
-    highlight_mode(window, start_row, height);
-}
-
-/**Creates a 2D grid of characters representing a given text file*/
-Buffer load(const char *filename)
-{
-    std::ifstream file(filename);
-    if(!file) {
-        // If file doesn't exist, create it
-        std::ofstream new_file(filename);
+    for(int below = row; gutter && below < height; ++below)
+        draw_gutter(window, below, DiffGutter::Mark::None);
+    highlight_mode->highlight(window, row_states.data(), height);
+    if(!search_query.empty()) {
+        for(std::size_t i = 0; i < shown.size(); ++i)
+            mark_matches(window, search_query, *shown[i].text, i, shown[i].first_byte,
+                         shown[i].last_byte, shown[i].left_col);
     }
-    Buffer buffer;
-    buffer.emplace_back();
-    auto curr_row = buffer.begin();
-    while(file) {
-	char curr = file.get();
-	if(curr == '\n') {
-	    buffer.emplace_back();
-	    curr_row = std::prev(buffer.end());
-	} else {
-	    curr_row->push_back(curr);
-	}
+    for(std::size_t i = 0; !selection.empty() && i < shown.size(); ++i) {
+        const auto row = shown[i].index;
+        if(row < selection.first_row || row > selection.last_row)
+            continue;
+        const auto &text = *shown[i].text;
+        const auto first = std::max(shown[i].first_byte,
+                                    row == selection.first_row ? selection.first_col : 0);
+        const auto last = std::min(shown[i].last_byte,
+                                   row == selection.last_row ? selection.last_col : text.size());
+        if(first > last)
+            continue;
+        // A selected newline shows as a column past the end of the row
+        const bool newline = row != selection.last_row && shown[i].last_byte == text.size();
+        const auto end_col = text.column_of(last) + (newline ? 1 : 0);
+        for(auto col = std::max(text.column_of(first), shown[i].left_col);
+            col < std::min(end_col, shown[i].left_col + width); ++col)
+            window.set_reverse(col - shown[i].left_col, i);
     }
-
-    if(buffer.size() >= 1 && curr_row->size() >= 1
-       && curr_row->back() == EOF)
-        curr_row->pop_back();
-    return buffer;
-}
-
-/**Write the buffer to disk as a text file*/
-void save(const Buffer &buffer, const char *filename)
-{
-    std::ofstream output_file(filename);
-    for(const auto &row_buf : buffer) {
-	for(char letter : row_buf) {
-	    output_file.put(letter);
-	}
-	if(row_buf != buffer.back())
-	    output_file.put('\n');
+    for(std::size_t i = 0; i < shown.size(); ++i) {
+        for(const auto &bracket : marked_brackets) {
+            if(bracket.row != shown[i].index || bracket.col < shown[i].first_byte
+               || bracket.col >= shown[i].last_byte)
+                continue;
+            const auto col = shown[i].text->column_of(bracket.col);
+            if(col >= shown[i].left_col && col < shown[i].left_col + std::size_t(width))
+                window.set_reverse(col - shown[i].left_col, i);
+        }
+    }
+    for(std::size_t i = 0; !cursors.empty() && i < shown.size(); ++i) {
+        // Each cursor is shown in reverse video
+        const auto row_cursors = std::lower_bound(
+            cursors.begin(), cursors.end(), shown[i].index,
+            [](const RowMatches &m, std::size_t row) { return m.row < row; });
+        if(row_cursors == cursors.end() || row_cursors->row != shown[i].index)
+            continue;
+        const auto last_byte = shown[i].last_byte;
+        for(const auto col : row_cursors->cols) {
+            // One at the end of the row is shown past its last screen row
+            if(col < shown[i].first_byte || col > last_byte
+               || (col == last_byte && last_byte != shown[i].text->size()))
+                continue;
+            const auto screen_col = shown[i].text->column_of(col);
+            if(screen_col >= shown[i].left_col
+               && screen_col < shown[i].left_col + std::size_t(width))
+                window.set_reverse(screen_col - shown[i].left_col, i);
+        }
+    }
+    for(std::size_t i = 0; i < shown.size(); ++i) {
+        // Marked at the end of the header's last screen row
+        if(!shown[i].folded || shown[i].last_byte != shown[i].text->size())
+            continue;
+        const auto end_col = shown[i].text->column_of(shown[i].last_byte);
+        for(std::size_t j = 0; FoldMarker[j] != '\0'; ++j) {
+            const auto col = end_col + j;
+            if(col >= shown[i].left_col && col < shown[i].left_col + std::size_t(width))
+                window.set(col - shown[i].left_col, i, FoldMarker[j], Color::Magenta);
+        }
     }
 }
 
-/**If necessary, move the visible text on screen up one line*/
+/**If necessary, move the visible text on screen up one line (when
+   soft-wrapping, scroll_sideways() takes care of this instead)*/
 static void scroll_up(Screen &window, int *cursor_y, int *top_visible_row,
-                      const Buffer &buffer)
+                      std::size_t left_col, const Buffer &buffer)
 {
-    if(*cursor_y == -1) {
+    if(!soft_wrap && *cursor_y == -1) {
         // If going offscreen, scroll upwards
-        --(*top_visible_row);
+        *top_visible_row = folds.shown_above(*top_visible_row);
         *cursor_y = 0;
         window.clear();
-        draw(window, buffer, *top_visible_row);
+        draw(window, buffer, *top_visible_row, left_col);
     }
 }
 
-/**If necessary, move the visible text on screen down one line*/
+/**If necessary, move the visible text on screen down one line (when
+   soft-wrapping, scroll_sideways() takes care of this instead)*/
 static void scroll_down(Screen &window, int *cursor_y, int *top_visible_row,
-                        Buffer::iterator curr_row,
+                        std::size_t left_col, Buffer::iterator curr_row,
                         const Buffer &buffer)
 {
-   if(*cursor_y == window.height() && curr_row != buffer.end()) {
+   if(!soft_wrap && *cursor_y == window.height() && curr_row != buffer.end()) {
        // If going offscreen, scroll downwards
-       ++(*top_visible_row);
+       *top_visible_row = folds.shown_below(*top_visible_row);
        *cursor_y = window.height() - 1;
        window.clear();
-       draw(window, buffer, *top_visible_row);
+       draw(window, buffer, *top_visible_row, left_col);
    }
 }
 
+/**Shows how much of a file being opened has been indexed/loaded so far*/
+static void draw_progress(Screen &window, const Loader &loader)
+{
+    const auto status = "Loading " + std::to_string(loader.loaded_percent())
+        + "% (indexed " + std::to_string(loader.indexed_percent()) + "%)";
+    const int x = std::max(0, window.width() - static_cast<int>(status.size()));
+    window.write(x, window.height() - 1, status.c_str(), Color::Yellow);
+}
+
+/**Asks the user to type a line of text on the bottom row of the screen;
+   returns false if they cancel with Ctrl-c. If given, on_update is called
+   whenever the answer changes (and every so often in between) and returns
+   a status message to show at the end of the row*/
+static bool prompt(Screen &window, const char *question, std::string &answer,
+                   const std::function<std::string(const std::string&)> &on_update = nullptr)
+{
+    const int row = window.height() - 1;
+    const int answer_x = std::strlen(question);
+    answer.clear();
+    window.set_input_timeout(on_update ? 100 : -1);
+    while(true) {
+        const auto status = on_update ? on_update(answer) : std::string();
+        for(int col = 0; col < window.width(); ++col)
+            window.set(col, row, ' ');
+        window.write(0, row, question, Color::Yellow);
+        const int status_x = window.width() - status.size();
+        if(status_x > answer_x + static_cast<int>(answer.size()))
+            window.write(status_x, row, status.c_str(), Color::Yellow);
+        window.write(answer_x, row, answer.c_str());
+        window.set_cursor(answer_x + answer.size(), row);
+        window.present();
+        const int input = window.get_input();
+        switch(input) {
+        case ctrl('c'):
+            window.set_input_timeout(-1);
+            return false;
+        case Key_Enter:
+        case Key_Enter2:
+            window.set_input_timeout(-1);
+            return true;
+        case Key_Backspace:
+        case Key_Backspace2:
+            if(!answer.empty())
+                answer.pop_back();
+            break;
+        default:
+            if(input >= ' ' && input < 127)
+                answer.push_back(input);
+        }
+    }
+}
+
+/**Fills the screen (minus the bottom row, used for status) with the lines
+   of a paged file starting at the given offset*/
+static void draw_page(Screen &window, PagedFile &file, off_t top)
+{
+    Buffer rows;
+    // Enough for a screen's width of multi-byte characters
+    std::vector<char> line(window.width() * 4);
+    for(int row = 0; row < window.height() - 1 && top != -1; ++row) {
+        const auto len = file.read_line(top, line.data(), line.size());
+        rows.append(line.data(), line.data() + len, top);
+        top = file.next_line(top);
+    }
+    draw(window, rows);
+}
+
+/**Read-only view of a file too large to load into memory; supports
+   scrolling, jumping to a line, and searching*/
+static void view(Screen &window, const char *filename)
+{
+    PagedFile file(filename);
+    if(!file.is_open())
+        return;
+    EventLoop events(window);
+    // Offset and number of the line at the top of the screen
+    off_t top = 0;
+    std::size_t top_line = 0;
+    std::string answer;
+    std::string query;
+    std::string message;
+    const auto redraw = [&] {
+        window.clear();
+        draw_page(window, file, top);
+        std::string status = std::string(filename) + " (read-only) line "
+            + std::to_string(top_line + 1);
+        if(!file.index_done())
+            status += ", indexed " + std::to_string(file.indexed_lines()) + " lines";
+        if(!message.empty())
+            status += " - " + message;
+        window.write(0, window.height() - 1, status.c_str(), Color::Yellow);
+        window.set_cursor(0, 0);
+        window.present();
+    };
+    // Show indexing progress every so often
+    std::function<void()> show_progress = [&] {
+        redraw();
+        if(!file.index_done())
+            events.add_timer(IndexRefreshInterval, show_progress);
+    };
+    show_progress();
+
+    events.on_resize(redraw);
+    events.on_key([&](int input) {
+        message.clear();
+        int lines_to_move = 0;
+        switch(input) {
+        case ctrl('c'):
+            events.stop();
+            return;
+        case Key_Down:
+            lines_to_move = 1;
+            break;
+        case Key_Up:
+            lines_to_move = -1;
+            break;
+        case Key_PageDown:
+            lines_to_move = window.height() - 1;
+            break;
+        case Key_PageUp:
+            lines_to_move = -(window.height() - 1);
+            break;
+        case ctrl('g'): {
+            // Go to line
+            if(!prompt(window, "Go to line: ", answer))
+                break;
+            const auto line = std::strtoul(answer.c_str(), nullptr, 10);
+            const auto offset = line > 0 ? file.line_offset(line - 1) : -1;
+            if(offset == -1) {
+                message = "No such line";
+            } else {
+                top = offset;
+                top_line = line - 1;
+            }
+            break;
+        }
+        case ctrl('f'): {
+            // Find the next occurrence after the top line (of the last query
+            // if nothing new was typed in)
+            if(!prompt(window, "Find: ", answer))
+                break;
+            if(!answer.empty())
+                query = answer;
+            const auto start = file.next_line(top);
+            const auto match = start == -1 ? -1 : file.find(start, query);
+            if(match == -1) {
+                message = "Not found";
+            } else {
+                top_line = file.line_at(match);
+                top = file.line_offset(top_line);
+            }
+            break;
+        }
+        }
+
+        for(; lines_to_move > 0; --lines_to_move) {
+            const auto next = file.next_line(top);
+            if(next == -1)
+                break;
+            top = next;
+            ++top_line;
+        }
+        for(; lines_to_move < 0 && top > 0; ++lines_to_move) {
+            top = file.prev_line(top);
+            --top_line;
+        }
+        redraw();
+    });
+    events.run();
+}
+
+/**Files bigger than this are opened in the read-only pager*/
+static off_t pager_threshold()
+{
+    // Half of physical memory
+    return static_cast<off_t>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE) / 2;
+}
+
 constexpr bool ends_with(std::string_view text, std::string_view match)
 {
     if(text.size() < match.size())
@@ -130,6 +523,10 @@ private:
 public:
     int x;
     int y;
+    // Index of the buffer row the cursor is on
+    std::size_t row = 0;
+    // Onscreen column that moving up/down tries to keep the cursor at
+    std::size_t goal_col = 0;
     Buffer::iterator row_it;
     BufferRow::iterator col_it;
 
@@ -153,6 +550,12 @@ public:
         window.set_cursor(x, y);
     }
 
+    /**Index of the character the cursor is on within its row*/
+    std::size_t col() const
+    {
+        return std::distance(row_it->begin(), col_it);
+    }
+
     void move_right(int amount = 1)
     {
         x += amount;
@@ -165,16 +568,93 @@ public:
         std::advance(col_it, -amount);
     }
 
+    /**Length in bytes of the character right of the cursor*/
+    std::size_t char_after() const
+    {
+        const auto offset = col();
+        return glyph_at(row_it->data() + offset, row_it->size() - offset, 0).len;
+    }
+
+    /**Length in bytes of the character left of the cursor*/
+    std::size_t char_before() const
+    {
+        const auto offset = col();
+        return offset - prev_char(row_it->data(), offset);
+    }
+
+    /**Move the cursor to a (possibly far away) place in the buffer*/
+    void jump(Buffer::iterator new_row_it, std::size_t new_row, std::size_t col)
+    {
+        row_it = new_row_it;
+        row = new_row;
+        col_it = std::next(row_it->begin(), col);
+    }
+
+    /**Which of its row's screen rows the cursor is on when wrapping to width*/
+    std::size_t segment(std::size_t width) const
+    {
+        const auto &points = row_it->wrap_points(width);
+        return std::upper_bound(points.begin(), points.end(), col()) - points.begin();
+    }
+
+    /**When wrapping to width, put the cursor goal_col columns into the given
+       screen row of its row*/
+    void move_to_segment(std::size_t segment, std::size_t width)
+    {
+        const auto &points = row_it->wrap_points(width);
+        const std::size_t start = segment == 0 ? 0 : points[segment - 1];
+        auto offset = row_it->byte_at_column(row_it->column_of(start) + goal_col);
+        if(segment < points.size() && offset >= points[segment])
+            // Stay on this screen row instead of going to the start of the next
+            offset = prev_char(row_it->data(), points[segment]);
+        col_it = std::next(row_it->begin(), offset);
+    }
+
+    /**When wrapping to width, go up one screen row; returns false if
+       already at the top of the buffer*/
+    bool move_up_wrapped(std::size_t width)
+    {
+        auto target = segment(width);
+        if(target == 0) {
+            if(row_it == buffer.begin())
+                return false;
+            move_up();
+            target = row_it->wrap_points(width).size();
+        } else {
+            --target;
+        }
+        move_to_segment(target, width);
+        return true;
+    }
+
+    /**When wrapping to width, go down one screen row; returns false if
+       already at the bottom of the buffer*/
+    bool move_down_wrapped(std::size_t width)
+    {
+        auto target = segment(width);
+        if(target == row_it->wrap_points(width).size()) {
+            if(std::next(folds.fold_end(row_it)) == buffer.end())
+                return false;
+            move_down();
+            target = 0;
+        } else {
+            ++target;
+        }
+        move_to_segment(target, width);
+        return true;
+    }
+
+    /**Go to the row shown above/below, skipping over folded rows*/
     void move_up()
     {
         --y;
-        --row_it;
+        folds.step_up(row_it, row);
     }
 
     void move_down()
     {
         ++y;
-        ++row_it;
+        folds.step_down(row_it, row);
     }
 
     void move_line_start()
@@ -182,19 +662,145 @@ public:
         col_it = row_it->begin();
         x = 0;
     }
+};
 
-    void move_line_end()
-    {
-        col_it = row_it->end();
-        x = row_it->size();
+
+/**When soft-wrapping, scroll up/down as needed so the cursor's screen row
+   is onscreen, and put the cursor there. Only the rows between the cursor and
+   the top of the screen are looked at, using their cached layouts*/
+static void scroll_wrapped(Screen &window, Cursor &cursor, int *top_visible_row,
+                           const Buffer &buffer)
+{
+    const std::size_t width = window.width();
+    const std::size_t height = window.height();
+    const auto segment = cursor.segment(width);
+    const auto &points = cursor.row_it->wrap_points(width);
+    const std::size_t start = segment == 0 ? 0 : points[segment - 1];
+    cursor.x = std::min(cursor.row_it->column_of(cursor.col())
+                        - cursor.row_it->column_of(start), width - 1);
+    cursor.goal_col = cursor.x;
+
+    const std::size_t top_row = *top_visible_row;
+    if(cursor.row < top_row || (cursor.row == top_row && segment < top_segment)) {
+        // Cursor went above the screen; put its screen row at the top
+        *top_visible_row = cursor.row;
+        top_segment = segment;
+        cursor.y = 0;
+        window.clear();
+        draw(window, buffer, *top_visible_row);
+        return;
     }
-};
+    // Count the screen rows above the cursor, giving up once there are
+    // more than fit onscreen
+    auto row_it = cursor.row_it;
+    std::size_t row = cursor.row;
+    std::size_t above = segment;
+    while(row > top_row && above < height + top_segment) {
+        folds.step_up(row_it, row);
+        above += row_it->wrap_points(width).size() + 1;
+    }
+    if(row == top_row && above - top_segment < height) {
+        cursor.y = above - top_segment;
+        return;
+    }
+    // Cursor went below the screen; put its screen row at the bottom
+    row_it = cursor.row_it;
+    row = cursor.row;
+    std::size_t back = height - 1;
+    if(back <= segment) {
+        top_segment = segment - back;
+    } else {
+        back -= segment;
+        top_segment = 0;
+        while(row > 0) {
+            folds.step_up(row_it, row);
+            const auto segments = row_it->wrap_points(width).size() + 1;
+            if(back <= segments) {
+                top_segment = segments - back;
+                break;
+            }
+            back -= segments;
+        }
+    }
+    *top_visible_row = row;
+    cursor.y = height - 1;
+    window.clear();
+    draw(window, buffer, *top_visible_row);
+}
 
+/**If necessary, move the visible text sideways so the cursor stays onscreen;
+   also keeps the cursor's x position (and its goal column) in sync with its
+   place in the row. When soft-wrapping, scrolls up/down instead*/
+static void scroll_sideways(Screen &window, Cursor &cursor, std::size_t *left_col,
+                            int *top_visible_row, const Buffer &buffer)
+{
+    if(soft_wrap) {
+        scroll_wrapped(window, cursor, top_visible_row, buffer);
+        return;
+    }
+    const std::size_t col = cursor.row_it->column_of(cursor.col());
+    const std::size_t width = window.width();
+    if(col < *left_col || col >= *left_col + width) {
+        // Jump by half a screen so typing along a long line doesn't
+        // scroll (and redraw) on every keystroke
+        *left_col = col > width / 2 ? col - width / 2 : 0;
+        window.clear();
+        draw(window, buffer, *top_visible_row, *left_col);
+    }
+    cursor.x = col - *left_col;
+    cursor.goal_col = col;
+}
 
 class Input {
 public:
     enum class Action : char {
-        Delete, Insert, Left, Right, Up, Down
+        Delete, Insert, Left, Right, Up, Down, Jump, Replace, Batch, Region
+    };
+    /**Queued when undoing a jump; undo_jump() says where to go back to*/
+    static constexpr int Key_UndoJump = 01000;
+    /**Queued when undoing a replace-all; undo_replace() says what to put back*/
+    static constexpr int Key_UndoReplace = 01001;
+    /**Queued when undoing a keypress done at every cursor; undo_batch()
+       says what to put back*/
+    static constexpr int Key_UndoBatch = 01002;
+    /**Queued when undoing a cut or paste; undo_region() says what to do*/
+    static constexpr int Key_UndoRegion = 01003;
+    struct Place {
+        std::size_t row;
+        std::size_t col;
+    };
+    /**Every occurrence of text that was replaced with replacement at once*/
+    struct Replacement {
+        // Where the cursor was beforehand
+        Place cursor;
+        MatchList matches;
+        std::string text;
+        std::string replacement;
+    };
+    /**A keypress done at every cursor at once*/
+    struct Batch {
+        // Where the main cursor was beforehand
+        Place cursor;
+        // Where every cursor was beforehand
+        MatchList cursors;
+        // What was typed at every cursor; if nothing, the character before
+        // each was erased instead
+        std::string typed;
+        // Where every cursor was afterwards (before any that ran into each
+        // other were merged), and the bytes erased before them (all of
+        // them, in order), to put back
+        MatchList moved;
+        std::string erased;
+    };
+    /**Text cut out or pasted in*/
+    struct RegionEdit {
+        // Where the cursor was beforehand
+        Place cursor;
+        // Where the text was cut from/pasted to
+        ::Region region;
+        // What was cut
+        Clip clip;
+        bool pasted;
     };
 private:
     struct Event {
@@ -202,15 +808,34 @@ private:
         char text;
     };
 
-    Screen &m_window;
     // All of the events that can be undone (most pressing is at end())
     std::vector<Event> m_history;
+    // Where the cursor was before each Jump event in m_history
+    std::vector<Place> m_jumps;
     // The keypresses that are to be done next (most pressing is at begin())
     std::vector<int> m_queue;
+    // Where each Key_UndoJump in m_queue goes (most pressing is at begin())
+    std::vector<Place> m_undo_jumps;
+    // The details of each Replace event in m_history
+    std::vector<Replacement> m_replacements;
+    // What each Key_UndoReplace in m_queue undoes (most pressing is at begin())
+    std::vector<Replacement> m_undo_replacements;
+    // The details of each Batch event in m_history
+    std::vector<Batch> m_batches;
+    // What each Key_UndoBatch in m_queue undoes (most pressing is at begin())
+    std::vector<Batch> m_undo_batches;
+    // The details of each Region event in m_history
+    std::vector<RegionEdit> m_regions;
+    // What each Key_UndoRegion in m_queue undoes (most pressing is at begin())
+    std::vector<RegionEdit> m_undo_regions;
     bool m_in_undo = false;
+
+    static bool is_continuation(char letter)
+    {
+        return (static_cast<unsigned char>(letter) & 0xc0) == 0x80;
+    }
 public:
-    explicit Input(Screen &window)
-        : m_window(window)
+    Input()
     {
         m_history.reserve(200);
     }
@@ -226,13 +851,28 @@ public:
             m_history.pop_back();
 
             switch(undo_event.type) {
-            case Action::Insert:
-                // Each insertion/deletion gets its own undo operation
+            case Action::Insert: {
+                // Each insertion/deletion gets its own undo operation; a
+                // multi-byte character is typed a byte at a time but is
+                // erased all at once
+                auto letter = undo_event.text;
+                while(is_continuation(letter) && !m_history.empty()
+                      && m_history.back().type == Action::Insert) {
+                    letter = m_history.back().text;
+                    m_history.pop_back();
+                }
                 m_queue.push_back(Key_Backspace);
                 return;
+            }
             case Action::Delete:
-                // Each insertion/deletion gets its own undo operation
-                m_queue.push_back(undo_event.text);
+                // Each insertion/deletion gets its own undo operation,
+                // putting back every byte of a multi-byte character
+                m_queue.push_back(static_cast<unsigned char>(undo_event.text));
+                while(!m_history.empty() && m_history.back().type == Action::Delete
+                      && is_continuation(m_history.back().text)) {
+                    m_queue.push_back(static_cast<unsigned char>(m_history.back().text));
+                    m_history.pop_back();
+                }
                 return;
             // Bundle all moving operations together
             // in a single undo move
@@ -248,6 +888,28 @@ public:
             case Action::Down:
                 m_queue.push_back(Key_Up);
                 break;
+            case Action::Jump:
+                m_queue.push_back(Key_UndoJump);
+                m_undo_jumps.push_back(m_jumps.back());
+                m_jumps.pop_back();
+                break;
+            case Action::Replace:
+                // A whole replace-all is undone in one go
+                m_queue.push_back(Key_UndoReplace);
+                m_undo_replacements.push_back(std::move(m_replacements.back()));
+                m_replacements.pop_back();
+                return;
+            case Action::Batch:
+                // Undone at every cursor at once
+                m_queue.push_back(Key_UndoBatch);
+                m_undo_batches.push_back(std::move(m_batches.back()));
+                m_batches.pop_back();
+                return;
+            case Action::Region:
+                m_queue.push_back(Key_UndoRegion);
+                m_undo_regions.push_back(std::move(m_regions.back()));
+                m_regions.pop_back();
+                return;
             }
         }
     }
@@ -258,200 +920,1683 @@ public:
             m_history.push_back({event, letter});
     }
 
-    int get()
+    /**Records that the cursor jumped away from the given place*/
+    void push_jump(std::size_t row, std::size_t col)
     {
-        if(m_queue.empty()) {
-            m_in_undo = false;
-            return m_window.get_input();
-        } else {
+        if(!m_in_undo) {
+            m_history.push_back({Action::Jump, 0});
+            m_jumps.push_back({row, col});
+        }
+    }
+
+    /**Records a replace-all*/
+    void push_replace(Replacement replacement)
+    {
+        if(!m_in_undo) {
+            m_history.push_back({Action::Replace, 0});
+            m_replacements.push_back(std::move(replacement));
+        }
+    }
+
+    /**Records a keypress done at every cursor. The bytes of a multi-byte
+       character are typed one at a time, but are undone as one*/
+    void push_batch(Batch batch)
+    {
+        if(m_in_undo)
+            return;
+        if(batch.typed.size() == 1 && is_continuation(batch.typed[0])
+           && !m_history.empty() && m_history.back().type == Action::Batch
+           && !m_batches.back().typed.empty()) {
+            m_batches.back().typed += batch.typed;
+            return;
+        }
+        m_history.push_back({Action::Batch, 0});
+        m_batches.push_back(std::move(batch));
+    }
+
+    /**Records a cut or paste*/
+    void push_region(RegionEdit edit)
+    {
+        if(!m_in_undo) {
+            m_history.push_back({Action::Region, 0});
+            m_regions.push_back(std::move(edit));
+        }
+    }
+
+    /**Changes where the text of the last event (a paste) went, once it has
+       been swapped for other text; does nothing if the last event isn't one
+       (e.g. it was forgotten by clear())*/
+    void amend_region(::Region region)
+    {
+        if(!m_history.empty() && m_history.back().type == Action::Region)
+            m_regions.back().region = region;
+    }
+
+    /**Forgets everything that could be undone, e.g. since the rows it
+       happened in were reloaded from disk*/
+    void clear()
+    {
+        m_history.clear();
+        m_jumps.clear();
+        m_replacements.clear();
+        m_batches.clear();
+        m_regions.clear();
+    }
+
+    /**What to undo for the Key_UndoReplace just returned by get()*/
+    Replacement undo_replace()
+    {
+        Replacement replacement{std::move(m_undo_replacements.front())};
+        m_undo_replacements.erase(m_undo_replacements.begin());
+        return replacement;
+    }
+
+    /**What to undo for the Key_UndoBatch just returned by get()*/
+    Batch undo_batch()
+    {
+        Batch batch{std::move(m_undo_batches.front())};
+        m_undo_batches.erase(m_undo_batches.begin());
+        return batch;
+    }
+
+    /**What to undo for the Key_UndoRegion just returned by get()*/
+    RegionEdit undo_region()
+    {
+        RegionEdit edit{std::move(m_undo_regions.front())};
+        m_undo_regions.erase(m_undo_regions.begin());
+        return edit;
+    }
+
+    /**Where to go for the Key_UndoJump just returned by get()*/
+    Place undo_jump()
+    {
+        const Place place{m_undo_jumps.front()};
+        m_undo_jumps.erase(m_undo_jumps.begin());
+        return place;
+    }
+
+    /**Calls handle(key) for a keypress, then for each keypress an undo
+       queued up in the meantime*/
+    template<typename Handler>
+    void dispatch(int key, Handler &handle)
+    {
+        m_in_undo = false;
+        handle(key);
+        while(!m_queue.empty()) {
             const int keypress{m_queue.front()};
             m_queue.erase(m_queue.begin());
-            return keypress;
+            handle(keypress);
         }
     }
 };
 
+/**Moves the cursor to the given place, scrolling it onscreen (near the
+   middle of the screen if it was far away) and redrawing. A fold hiding the
+   place is opened*/
+static void jump_to(Screen &window, Cursor &cursor, Buffer &buffer,
+                    int *top_visible_row, std::size_t *left_col, const Position &place)
+{
+    folds.reveal(place.row_it, place.row);
+    cursor.jump(place.row_it, place.row, place.col);
+    if(folds.hidden(*top_visible_row))
+        *top_visible_row = folds.shown_above(*top_visible_row);
+    // Rows are counted as they are shown, skipping folded ones
+    const std::size_t height = window.height();
+    const std::size_t top = folds.shown_before(*top_visible_row);
+    const std::size_t at = folds.shown_before(place.row);
+    // Keep clear of the bottom row, where prompts are shown
+    if(at < top || at + 1 >= top + height) {
+        *top_visible_row = folds.shown_row(at - std::min<std::size_t>(at, height / 2));
+        top_segment = 0;
+    }
+    cursor.y = at - folds.shown_before(*top_visible_row);
+    scroll_sideways(window, cursor, left_col, top_visible_row, buffer);
+    window.clear();
+    draw(window, buffer, *top_visible_row, *left_col);
+}
 
-int main(int argc, char **argv)
+/**Asks for some text (or, if is_regex is set, a regular expression) to
+   find, moving the cursor to its first match at or after the cursor as each
+   letter is typed in; pressing Enter on an empty query finds the next match
+   of the last query. Matches onscreen are shown and all of them are counted
+   in the background meanwhile. Returns true if the cursor ended up on a
+   match of last_query*/
+static bool find(Screen &window, Buffer &buffer, Cursor &cursor, Input &input_handler,
+                 JobScheduler &jobs, int *top_visible_row, std::size_t *left_col,
+                 bool is_regex)
 {
-    if(argc != 2) {
-	printf("Usage: ./editorial </path/to/file>\n");
-	return 1;
+    const Position origin{cursor.row_it, cursor.row, cursor.col()};
+    const int origin_top = *top_visible_row;
+    const auto origin_left = *left_col;
+    const auto origin_segment = top_segment;
+    MatchCounter counter(buffer, jobs);
+    Position match = origin;
+    bool found = false;
+    std::string prev_text;
+    const auto show_matches = [&](const std::string &text) {
+        if(text != prev_text) {
+            Query query(text, is_regex);
+            const bool extends = !is_regex && !prev_text.empty()
+                && text.size() > prev_text.size()
+                && text.compare(0, prev_text.size(), prev_text) == 0;
+            // Longer literal text has no matches between the origin and the
+            // last match (or anywhere, if the shorter text had none)
+            if(!extends)
+                found = find_next(buffer, origin, query, match);
+            else if(found)
+                found = find_next(buffer, match, query, match);
+            counter.start(query);
+            search_query = std::move(query);
+            prev_text = text;
+            *top_visible_row = origin_top;
+            *left_col = origin_left;
+            top_segment = origin_segment;
+            jump_to(window, cursor, buffer, top_visible_row, left_col,
+                    found ? match : origin);
+        }
+        if(text.empty())
+            return std::string();
+        if(!search_query.error().empty())
+            return search_query.error();
+        if(!found)
+            return std::string("Not found");
+        return std::to_string(counter.count()) + (counter.done() ? "" : "+")
+            + " matches";
+    };
+
+    std::string answer;
+    const bool accepted = prompt(window, is_regex ? "Regex: " : "Find: ", answer,
+                                 show_matches);
+    counter.stop();
+    search_query = Query();
+    if(accepted && answer.empty() && !last_query.empty()) {
+        // Find the next match after the cursor
+        found = find_next(buffer, {origin.row_it, origin.row, origin.col + 1},
+                          last_query, match);
+    } else if(accepted) {
+        last_query = Query(answer, is_regex);
+    } else {
+        found = false;
+    }
+    if(!found) {
+        // Put everything back the way it was
+        *top_visible_row = origin_top;
+        *left_col = origin_left;
+        top_segment = origin_segment;
+    }
+    const auto &place = found ? match : origin;
+    if(place.row_it != origin.row_it || place.col != origin.col)
+        input_handler.push_jump(origin.row, origin.col);
+    jump_to(window, cursor, buffer, top_visible_row, left_col, place);
+    return found;
+}
+
+/**Lists the symbols in the file, narrowed down to those fuzzily matching
+   the name typed in (best match first) as each letter is typed; Up/Down
+   choose one. Returns false if Ctrl-c was pressed (or nothing matched)*/
+static bool pick_symbol(Screen &window, const SymbolIndex &symbols, std::size_t &picked)
+{
+    constexpr char Question[] = "Symbol: ";
+    constexpr const char *KindNames[] = {"function", "class", "enum", "macro"};
+    std::string answer;
+    std::string prev_answer;
+    std::vector<std::size_t> matches = symbols.filter(answer);
+    // Which match is selected, and which one is at the top of the screen
+    std::size_t selected = 0;
+    std::size_t top = 0;
+    while(true) {
+        if(answer != prev_answer) {
+            // Longer names only match among the matches of shorter ones
+            const bool extends = answer.size() > prev_answer.size()
+                && answer.compare(0, prev_answer.size(), prev_answer) == 0;
+            matches = symbols.filter(answer, extends ? &matches : nullptr);
+            prev_answer = answer;
+            selected = top = 0;
+        }
+        const std::size_t width = window.width();
+        const std::size_t height = window.height() - 1;
+        if(selected < top)
+            top = selected;
+        else if(selected >= top + height)
+            top = selected - height + 1;
+
+        window.clear();
+        for(auto i = top; i < std::min(matches.size(), top + height); ++i) {
+            const auto &symbol = symbols.symbols()[matches[i]];
+            const int y = i - top;
+            const auto line = std::to_string(symbols.row_of(matches[i]) + 1);
+            const auto kind = KindNames[static_cast<int>(symbol.kind)];
+            window.write(0, y, symbol.name.substr(0, width).c_str());
+            if(symbol.name.size() + std::strlen(kind) + line.size() + 4 < width) {
+                window.write(symbol.name.size() + 2, y, kind, Color::Cyan);
+                window.write(width - line.size(), y, line.c_str(), Color::Yellow);
+            }
+            if(i == selected) {
+                for(std::size_t x = 0; x < width; ++x)
+                    window.set_reverse(x, y);
+            }
+        }
+        window.write(0, height, Question, Color::Yellow);
+        const auto status = std::to_string(matches.size()) + " of "
+            + std::to_string(symbols.symbols().size()) + " symbols";
+        const std::size_t answer_end = std::strlen(Question) + answer.size();
+        if(answer_end + status.size() < width)
+            window.write(width - status.size(), height, status.c_str(), Color::Yellow);
+        window.write(std::strlen(Question), height, answer.c_str());
+        window.set_cursor(answer_end, height);
+        window.present();
+
+        const int input = window.get_input();
+        switch(input) {
+        case ctrl('c'):
+            return false;
+        case Key_Enter:
+        case Key_Enter2:
+            if(matches.empty())
+                return false;
+            picked = matches[selected];
+            return true;
+        case Key_Down:
+            if(selected + 1 < matches.size())
+                ++selected;
+            break;
+        case Key_Up:
+            if(selected > 0)
+                --selected;
+            break;
+        case Key_PageDown:
+            if(!matches.empty())
+                selected = std::min(selected + height, matches.size() - 1);
+            break;
+        case Key_PageUp:
+            selected -= std::min(selected, height);
+            break;
+        case Key_Backspace:
+        case Key_Backspace2:
+            if(!answer.empty())
+                answer.pop_back();
+            break;
+        default:
+            if(input > ' ' && input < 127)
+                answer.push_back(input);
+        }
+    }
+}
+
+/**Where a place in a row ends up once the given occurrences (each len bytes
+   long) in that row are replaced with new_len bytes each; places inside an
+   occurrence move to its start*/
+static std::size_t col_after_replace(const std::vector<std::size_t> &cols, std::size_t len,
+                                     std::size_t new_len, std::size_t col)
+{
+    std::size_t new_col = col;
+    for(const auto match_col : cols) {
+        if(match_col + len <= col)
+            new_col = new_col - len + new_len;
+        else if(match_col < col)
+            return new_col - (col - match_col);
+        else
+            break;
+    }
+    return new_col;
+}
+
+/**Replaces the len bytes at each of matches with replacement (journaling
+   it); returns where the cursor's place in its row has moved to. The
+   cursor has to be moved there (e.g. with jump_to()) before it is used*/
+static std::size_t replace_matches(Buffer &buffer, const Cursor &cursor, Journal &journal,
+                                   const MatchList &matches, std::size_t len,
+                                   const std::string &replacement)
+{
+    auto col = cursor.col();
+    const auto row_matches = std::lower_bound(
+        matches.begin(), matches.end(), cursor.row,
+        [](const RowMatches &m, std::size_t row) { return m.row < row; });
+    if(row_matches != matches.end() && row_matches->row == cursor.row)
+        col = col_after_replace(row_matches->cols, len, replacement.size(), col);
+    replace_at(buffer, matches, len, replacement);
+    journal.replace(matches, len, replacement);
+    return col;
+}
+
+/**Asks for some text (showing how many times it occurs as it is typed) and
+   then what to replace it with, and replaces every occurrence in the buffer
+   as a single undoable edit; returns a message saying how it went (or
+   nothing, if cancelled)*/
+static std::string replace_all(Screen &window, Buffer &buffer, Cursor &cursor,
+                               Input &input_handler, Journal &journal, JobScheduler &jobs,
+                               int *top_visible_row, std::size_t *left_col)
+{
+    MatchCounter counter(buffer, jobs);
+    std::string prev_text;
+    const auto show_count = [&](const std::string &text) {
+        if(text != prev_text) {
+            counter.start(Query(text, false));
+            prev_text = text;
+        }
+        if(text.empty())
+            return std::string();
+        return std::to_string(counter.count()) + (counter.done() ? "" : "+")
+            + " matches";
+    };
+    std::string text, replacement;
+    const bool accepted = prompt(window, "Replace: ", text, show_count);
+    counter.stop();
+    const bool replacing = accepted && !text.empty()
+        && prompt(window, "With: ", replacement);
+    auto matches = replacing ? find_all(buffer, text) : MatchList();
+    const auto count = count_matches(matches);
+    if(count == 0) {
+        // Clear away the prompt
+        window.clear();
+        draw(window, buffer, *top_visible_row, *left_col);
+        return replacing ? "Not found" : "";
+    }
+    const Input::Place place{cursor.row, cursor.col()};
+    const auto col = replace_matches(buffer, cursor, journal, matches, text.size(),
+                                     replacement);
+    jump_to(window, cursor, buffer, top_visible_row, left_col,
+            {cursor.row_it, cursor.row, col});
+    input_handler.push_replace({place, std::move(matches), text, replacement});
+    return "Replaced " + std::to_string(count) + " occurrences";
+}
+
+/**Whether a keypress is done at every cursor when there are several: typing,
+   deleting and going left/right are, as is adding cursors; anything else
+   leaves just the main cursor*/
+static bool at_every_cursor(int input)
+{
+    switch(input) {
+    case ctrl('a'):
+    case ctrl('d'):
+    case Key_Tab:
+    case Key_Backspace:
+    case Key_Backspace2:
+    case Key_Left:
+    case Key_Right:
+    case Input::Key_UndoBatch:
+        return true;
+    default:
+        // Letters (including each byte of a multi-byte character)
+        return input >= ' ' && input < 0x100;
     }
-    const char *filename = argv[1];
-    Buffer buffer{load(filename)};
-    /* Open the syntax-highlighting mode appropriate for the
-       file extension of the opened file */
+}
+
+/**Whether a keypress leaves the selection going: moving the cursor does,
+   as do cutting and copying (which end it themselves); anything else
+   (e.g. typing) ends it first*/
+static bool keeps_selection(int input)
+{
+    switch(input) {
+    case ctrl('b'):
+    case ctrl('x'):
+    case ctrl('y'):
+    case ctrl('f'):
+    case ctrl('r'):
+    case ctrl(']'):
+    case ctrl('o'):
+    case ctrl('t'):
+    case ctrl('u'):
+    case ctrl('w'):
+    case Key_Left:
+    case Key_Right:
+    case Key_Up:
+    case Key_Down:
+    case Input::Key_UndoJump:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**Picks the syntax highlighting mode for a file from its extension*/
+static void set_highlight_mode(std::string_view filename)
+{
     if(ends_with(filename, ".md"))
-        highlight_mode = markdown_mode;
+        highlight_mode = &markdown_mode;
     else if(ends_with(filename, ".cpp") || ends_with(filename, ".h"))
-        highlight_mode = cpp_mode;
+        highlight_mode = &cpp_mode;
     else if(ends_with(filename, ".s"))
-        highlight_mode = mips_mode;
+        highlight_mode = &mips_mode;
     else
-        highlight_mode = text_mode;
+        highlight_mode = &text_mode;
+}
 
-    Screen window;
+/**Edits a file, starting with the cursor at the start of the given row,
+   until the user quits*/
+static void edit(Screen &window, const char *filename, std::size_t start_row = 0)
+{
+    struct stat file_info;
+    if(stat(filename, &file_info) == 0 && file_info.st_size > pager_threshold()) {
+        view(window, filename);
+        return;
+    }
+    set_highlight_mode(filename);
+    // A column on the left for marking rows that differ from the file
+    window.set_gutter_width(1);
+    Buffer buffer;
+    EventLoop events(window);
+    JobScheduler jobs(events);
+    // The version of the file that the buffer's unedited rows were read from
+    auto on_disk = FileVersion::of(filename);
+    // Only wait for the first screenful of the file; the rest loads in the
+    // background (and on demand when scrolling)
+    Loader loader(filename, buffer, window.height(), jobs);
+    if(on_disk.size == -1) {
+        // The loader has just made it
+        on_disk = FileVersion::of(filename);
+    }
+    FileWatch file_watch(filename);
+    // Recover any edits from a session that ended without saving
+    Journal journal(filename);
+    if(journal.recoverable())
+        loader.load_all();
+    const auto recovered = journal.replay(buffer);
     Cursor cursor(window, buffer);
-    Input input_handler(window);
+    Input input_handler;
+    // Where the brackets are, for matching them; only built once needed
+    BracketIndex brackets(*highlight_mode);
+    buffer.on_change([&brackets](auto change, auto row, auto row_it) {
+        brackets.update(change, row, *row_it);
+    });
+    buffer.on_change([](auto change, auto row, auto row_it) {
+        folds.update(change, row, row_it);
+    });
+    // The words in the file, for completing them; only built once needed
+    WordIndex words(*highlight_mode);
+    buffer.on_change([&words, &buffer](auto change, auto, auto row_it) {
+        words.update(change, *row_it, buffer.last_edit());
+    });
+    // The symbols declared in the file, for Ctrl-o; found in the background
+    // once the file is loaded, then kept up to date row by row
+    SymbolIndex symbols(*highlight_mode);
+    buffer.on_change([&symbols](auto change, auto row, auto row_it) {
+        symbols.update(change, row, *row_it);
+    });
+    buffer.on_change([](auto change, auto row, auto) {
+        diff_gutter.update(change, row);
+    });
+    // The completions Ctrl-n is cycling through, while it is pressed again
+    // and again: which one is in the buffer, and how many of its bytes
+    // (after the part typed) were put in
+    struct {
+        std::vector<std::string> words;
+        std::size_t index = 0;
+        std::size_t typed = 0;
+        std::size_t inserted = 0;
+    } completion;
+    // Text cut or copied, to be pasted back in
+    KillRing kill_ring;
+    // Where selecting started, while the cursor is being moved to select
+    // text; the selection is everything between there and the cursor
+    bool selecting = false;
+    std::size_t mark_row = 0, mark_col = 0;
+    // What was pasted last, while Ctrl-p may still swap it for an older clip
+    struct {
+        bool active = false;
+        std::size_t index = 0;
+        Region region;
+    } last_paste;
     // The index of the row in the buffer at the top of the screen
     int top_visible_row = 0;
+    // The index of the column in each row at the left edge of the screen
+    std::size_t left_col = 0;
+    top_segment = 0;
+    marked_brackets[0] = marked_brackets[1] = MarkedBracket();
     draw(window, buffer);
-    cursor.refresh();
-    window.present();
+    if(start_row > 0) {
+        loader.load_rows(start_row + 1);
+        start_row = std::min(start_row, buffer.size() - 1);
+        jump_to(window, cursor, buffer, &top_visible_row, &left_col,
+                {std::next(buffer.begin(), start_row), start_row, 0});
+    }
     // Flag to redraw screen on next tick
     bool needs_redraw = false;
-    bool done = false;
-    int input;
-    while(!done && (input = input_handler.get())) {
-	if(input == Key_Resize) {
-	    window.clear();
-	    draw(window, buffer, top_visible_row);
-	    cursor.refresh();
-	    window.present_resize();
-	    continue;
-	} else if(needs_redraw) {
-	    window.clear();
-	    draw(window, buffer, top_visible_row);
-	    cursor.refresh();
-	    window.present();
+    // Jobs about the buffer as it is, which are called off before each
+    // keypress is handled since it may make their results stale. Jobs that
+    // read the buffer itself (rather than a snapshot) must be done before
+    // it is changed, which this also sees to
+    CancelToken buffer_jobs;
+    // Starts finding the file's symbols in the background, if they aren't
+    // known yet; a keypress calls it off, so it is started again after each
+    const auto index_symbols = [&] {
+        if(!symbols.enabled() || symbols.built() || !loader.done())
+            return;
+        jobs.submit(Priority::WholeFile, buffer_jobs,
+                    [&symbols, token = buffer_jobs, rows = buffer.snapshot()]
+                    () -> JobScheduler::Callback {
+            auto found = std::make_shared<SymbolIndex::Contents>();
+            if(!symbols.scan(rows, token, *found))
+                return nullptr;
+            return [&symbols, found] { symbols.assign(std::move(*found)); };
+        });
+    };
+    const auto redraw = [&] {
+        window.clear();
+        draw(window, buffer, top_visible_row, left_col);
+        cursor.refresh();
+        window.present();
+    };
+    // The diff job last started, which works from a snapshot so is left
+    // running through keypresses; it is called off when another is started
+    // (or the diff is cleared) instead, so they never pile up
+    CancelToken diff_job;
+    bool diff_job_running = false;
+    std::uint64_t diff_job_generation = 0;
+    const auto stop_diffing = [&] {
+        diff_job.cancel();
+        diff_job = CancelToken();
+        diff_job_running = false;
+    };
+    // Starts diffing the buffer against the file on disk in the background:
+    // all of it until that has been done once, then just the hunks edited
+    // since. Like index_symbols(), it is started again after each keypress,
+    // unless the one running was started since the last edit
+    const auto diff_with_disk = [&] {
+        if(!loader.done() || (diff_gutter.built() && !diff_gutter.dirty()))
+            return;
+        if(diff_job_running && diff_job_generation == diff_gutter.generation())
+            return;
+        stop_diffing();
+        diff_job_running = true;
+        diff_job_generation = diff_gutter.generation();
+        const auto show = [&] {
+            diff_job_running = false;
+            // With a message up, the gutter is redrawn along with the rest
+            // once it goes
+            if(!needs_redraw)
+                redraw();
+        };
+        if(!diff_gutter.built()) {
+            jobs.submit(Priority::WholeFile, diff_job,
+                        [&, show, token = diff_job, rows = buffer.snapshot(),
+                         generation = diff_gutter.generation()]()
+                        -> JobScheduler::Callback {
+                auto contents = std::make_shared<DiffGutter::Contents>();
+                contents->generation = generation;
+                if(!DiffGutter::scan(filename, rows, token, *contents))
+                    return nullptr;
+                return [show, contents] {
+                    diff_gutter.build(std::move(*contents));
+                    show();
+                };
+            });
+            return;
+        }
+        // Only a few rows around each edit, so quick enough to be ready
+        // by the time they are looked at
+        jobs.submit(Priority::Visible, diff_job,
+                    [show, token = diff_job, rows = buffer.snapshot(),
+                     work = std::make_shared<DiffGutter::Refinement>(
+                         diff_gutter.dirty_hunks())]() -> JobScheduler::Callback {
+            if(!DiffGutter::refine(rows, token, *work))
+                return nullptr;
+            return [show, work] {
+                diff_gutter.apply(std::move(*work));
+                show();
+            };
+        });
+    };
+    // Types text at every cursor at once (or, if it is empty, deletes the
+    // character before each one), as a single undoable edit that changes
+    // each row once, then redraws
+    const auto edit_at_cursors = [&](std::string_view text) {
+        Input::Batch batch{{cursor.row, cursor.col()}, cursors, std::string(text), {}, {}};
+        // Which of the cursors the main one is, to find it again afterwards
+        const std::size_t main_row = std::lower_bound(
+            cursors.begin(), cursors.end(), cursor.row,
+            [](const RowMatches &m, std::size_t row) { return m.row < row; })
+            - cursors.begin();
+        const auto &main_cols = cursors[main_row].cols;
+        const std::size_t main_index = std::lower_bound(
+            main_cols.begin(), main_cols.end(), cursor.col()) - main_cols.begin();
+        MatchList moved;
+        if(text.empty()) {
+            moved = erase_before(buffer, cursors, batch.erased);
+            batch.moved = moved;
+            for(std::size_t i = 0; i < cursors.size(); ++i) {
+                // Right to left, so each erase is where the row has it
+                const auto &cols = cursors[i].cols;
+                const auto &new_cols = moved[i].cols;
+                for(auto j = cols.size(); j-- > 0;) {
+                    const auto erased = cols[j] - new_cols[j];
+                    const auto len = j == 0 ? erased : erased - (cols[j - 1] - new_cols[j - 1]);
+                    if(len > 0)
+                        journal.erase(cursors[i].row, cols[j] - len, len);
+                }
+            }
+        } else {
+            replace_at(buffer, cursors, 0, text);
+            journal.replace(cursors, 0, text);
+            // Each cursor ends up after the text put in there
+            moved = shift_matches(cursors, 0, text.size());
+            for(auto &row_cursors : moved) {
+                for(auto &col : row_cursors.cols)
+                    col += text.size();
+            }
+        }
+        const auto col = moved[main_row].cols[main_index];
+        unique_places(moved);
+        cursors = std::move(moved);
+        input_handler.push_batch(std::move(batch));
+        cursor.jump(cursor.row_it, cursor.row, col);
+        scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
+        redraw();
+    };
+    // Moves every cursor a character left/right, staying within its row
+    const auto move_cursors = [&](bool right) {
+        auto row_it = buffer.begin();
+        std::size_t row = 0;
+        for(auto &row_cursors : cursors) {
+            std::advance(row_it, row_cursors.row - row);
+            row = row_cursors.row;
+            for(auto &col : row_cursors.cols) {
+                if(right && col < row_it->size())
+                    col += glyph_at(row_it->data() + col, row_it->size() - col, 0).len;
+                else if(!right && col > 0)
+                    col = prev_char(row_it->data(), col);
+            }
+        }
+        unique_places(cursors);
+        input_handler.push(right ? Input::Action::Right : Input::Action::Left);
+        if(right && cursor.col_it != cursor.row_it->end())
+            cursor.move_right(cursor.char_after());
+        else if(!right && cursor.col_it != cursor.row_it->begin())
+            cursor.move_left(cursor.char_before());
+        scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
+        redraw();
+    };
+    // The iterator to a row, stepping from the cursor's row rather than from
+    // the top of the buffer, since it is most likely nearby
+    const auto row_near_cursor = [&](std::size_t row) {
+        return row >= cursor.row ? std::next(cursor.row_it, row - cursor.row)
+            : std::prev(cursor.row_it, cursor.row - row);
+    };
+    // Marks the bracket under the cursor and the one matching it (once the
+    // whole file is there to look through); returns whether that changed
+    // which brackets are marked, so the screen needs redrawing
+    const auto mark_brackets = [&] {
+        MarkedBracket marks[2];
+        if(brackets.enabled() && loader.done() && cursor.col_it != cursor.row_it->end()
+           && std::string_view("()[]{}").find(*cursor.col_it) != std::string_view::npos) {
+            brackets.build(buffer);
+            BracketIndex::Place match;
+            bool mismatched;
+            if(brackets.find_match(buffer.snapshot(), cursor.row, cursor.col(), match,
+                                   mismatched)) {
+                marks[0] = {cursor.row, cursor.col()};
+                marks[1] = {match.row, match.col};
+            }
+        }
+        const bool changed = marks[0] != marked_brackets[0] || marks[1] != marked_brackets[1];
+        marked_brackets[0] = marks[0];
+        marked_brackets[1] = marks[1];
+        return changed;
+    };
+    // Selects the text between where selecting started and the cursor;
+    // returns whether that changed, so the screen needs redrawing
+    const auto mark_selection = [&] {
+        const auto selected = selecting
+            ? region_between(mark_row, mark_col, cursor.row, cursor.col()) : Region();
+        const bool changed = selected != selection;
+        selection = selected;
+        return changed;
+    };
+    // Puts the clip kill_ring.at(index) in at the cursor, with the cursor
+    // left after it
+    const auto paste_clip = [&](std::size_t index) {
+        const auto end = insert_clip(buffer, &journal,
+                                     {cursor.row_it, cursor.row, cursor.col()},
+                                     kill_ring.at(index));
+        last_paste = {true, index, {cursor.row, cursor.col(), end.row, end.col}};
+        jump_to(window, cursor, buffer, &top_visible_row, &left_col, end);
+    };
+    // Shows a message at the top of the screen until the next keypress (or
+    // until it has been up for a while)
+    auto message_timer = EventLoop::NoTimer;
+    const auto show_message = [&](const std::string &message, Color color) {
+        window.write(0, 0, message.c_str(), color);
+        needs_redraw = true;
+        events.cancel_timer(message_timer);
+        message_timer = events.add_timer(MessageTimeout, [&] {
+            if(needs_redraw) {
+                redraw();
+                needs_redraw = false;
+            }
+        });
+    };
+    if(recovered > 0)
+        show_message("Recovered " + std::to_string(recovered) + " unsaved edits",
+                     Color::Yellow);
+
+    // Set once the file has changed on disk in a way the buffer couldn't
+    // follow (e.g. there were unsaved edits), so saving would overwrite
+    // someone else's changes
+    bool disk_changed = false;
+    auto reload_timer = EventLoop::NoTimer;
+    // Brings the buffer up to date with the file after another process
+    // changed it, as long as that doesn't throw away any unsaved edits
+    std::function<void()> check_disk = [&] {
+        reload_timer = EventLoop::NoTimer;
+        const auto current = FileVersion::of(filename);
+        if(disk_changed || current == on_disk)
+            return;
+        if(!loader.done()) {
+            // The rows still to be loaded come from the old version
+            reload_timer = events.add_timer(ReloadDelay, check_disk);
+            return;
+        }
+        if(current.size == -1 || journal.has_edits()) {
+            disk_changed = true;
+            show_message(current.size == -1 ? "File was removed from disk"
+                         : "File changed on disk; unsaved edits kept", Color::Red);
+            cursor.refresh();
+            window.present();
+            return;
+        }
+        buffer_jobs.cancel();
+        buffer_jobs = CancelToken();
+        const bool at_end = std::next(folds.fold_end(cursor.row_it)) == buffer.end();
+        const std::size_t old_row = cursor.row;
+        const std::size_t old_col = cursor.col();
+        const auto result = reload(buffer, filename, on_disk, current);
+        if(!result.ok) {
+            if(FileVersion::of(filename) != current) {
+                // Still being written; try again once it settles
+                reload_timer = events.add_timer(ReloadDelay, check_disk);
+            } else {
+                disk_changed = true;
+                show_message("File changed on disk but couldn't be read", Color::Red);
+                cursor.refresh();
+                window.present();
+            }
+            return;
+        }
+        on_disk = current;
+        // Edits are journaled against the version on disk
+        journal.reset();
+        diff_gutter.clear();
+        stop_diffing();
+        // Rows only added after the end (or none changed at all) leave what
+        // can be undone where it was
+        if(!result.appended && result.rows_changed > 0)
+            input_handler.clear();
+        // The text pasted may have changed, and can't be undone anyway
+        last_paste.active = false;
+        // The rows selected may have changed
+        selecting = false;
+        mark_selection();
+        // Folds with rows that changed were opened, moving the rows below
+        const bool unfolded = folds.take_changed();
+        if(result.appended && !at_end && !unfolded) {
+            // The rows the cursor is on weren't touched
+            redraw();
+        } else {
+            // Follow the end of a growing file (like tail -f), or stay on
+            // the same text as far as it is still there
+            const std::size_t row = !result.appended
+                ? std::min(row_after(result.hunks, old_row), buffer.size() - 1)
+                : at_end ? buffer.size() - 1 : old_row;
+            const auto row_it = std::next(buffer.begin(), row);
+            const auto col = row_it->byte_at_column(
+                row_it->column_of(std::min(old_col, row_it->size())));
+            jump_to(window, cursor, buffer, &top_visible_row, &left_col, {row_it, row, col});
+        }
+        if(mark_brackets())
+            redraw();
+        show_message(std::to_string(result.rows_changed)
+                     + (result.appended ? " rows added to the end of the file"
+                        : " rows changed on disk were reloaded"), Color::Yellow);
+        cursor.refresh();
+        window.present();
+        diff_with_disk();
+    };
+    events.watch(file_watch.fd(), [&] {
+        if(file_watch.changed() && reload_timer == EventLoop::NoTimer)
+            reload_timer = events.add_timer(ReloadDelay, check_disk);
+    });
+    if(!loader.done()) {
+        draw_progress(window, loader);
+        // Keep loading the file in between keypresses
+        events.on_idle([&] {
+            loader.load_some();
+            if(loader.done()) {
+                // Clear the progress message
+                events.on_idle(nullptr);
+                mark_brackets();
+                index_symbols();
+                diff_with_disk();
+                redraw();
+            } else {
+                draw_progress(window, loader);
+                cursor.refresh();
+                window.present();
+            }
+        });
+    }
+    cursor.refresh();
+    window.present();
+    events.on_resize([&] {
+        loader.load_rows(top_visible_row + window.height() + 1);
+        // Rows are re-wrapped to the new width as they are drawn
+        scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
+        redraw();
+    });
+    const auto handle_key = [&](int input) {
+	buffer_jobs.cancel();
+	buffer_jobs = CancelToken();
+	// Make sure the rows needed onscreen (plus one to scroll to) are loaded
+	loader.load_rows(top_visible_row + window.height() + 1);
+	if(needs_redraw) {
+	    redraw();
 	    needs_redraw = false;
 	}
+	if(!cursors.empty() && !at_every_cursor(input)) {
+	    // Back to just the main cursor
+	    cursors.clear();
+	    redraw();
+	}
+	if(selecting && !keeps_selection(input)) {
+	    selecting = false;
+	    if(mark_selection())
+	        redraw();
+	}
 
 	switch(input) {
 	case ctrl('c'):
-	    // Exit program
-	    done = true;
+	    // Exit program, throwing away unsaved edits
+	    journal.reset();
+	    events.stop();
             break;
-	case ctrl('s'):
-	    // Save to disk
-	    save(buffer, filename);
-	    window.write(0, 0, "Saved", Color::Yellow);
+	case ctrl('s'): {
+	    // Save to disk, unless that would silently overwrite changes made
+	    // there by something else
+	    loader.load_all();
+	    if(disk_changed || FileVersion::of(filename) != on_disk) {
+	        std::string answer;
+	        const bool overwrite = prompt(window, "File changed on disk; overwrite it? (y/n) ",
+	                                      answer) && answer == "y";
+	        redraw();
+	        if(!overwrite)
+	            break;
+	        // Rows can no longer be copied from where they were in the file
+	        for(auto row = buffer.begin(); row != buffer.end(); ++row)
+	            buffer.set_origin(row, BufferRow::NoOrigin);
+	    }
+	    if(save(buffer, filename)) {
+	        journal.reset();
+	        // Nothing differs from what was just saved
+	        stop_diffing();
+	        diff_gutter.saved(buffer);
+	        redraw();
+	        on_disk = FileVersion::of(filename);
+	        disk_changed = false;
+	        show_message("Saved", Color::Yellow);
+	    } else
+	        show_message("Save failed", Color::Red);
 	    cursor.refresh();
 	    window.present();
-	    needs_redraw = true;
 	    break;
+	}
         case ctrl('z'):
             // Undo
             input_handler.set_undo();
             break;
+	case ctrl('f'):
+	case ctrl('r'):
+	    // Find text/a regular expression, which requires the whole file
+	    loader.load_all();
+	    if(find(window, buffer, cursor, input_handler, jobs, &top_visible_row,
+	            &left_col, input == ctrl('r'))) {
+	        // Say which match the cursor is on, once they have all been counted
+	        jobs.submit(Priority::WholeFile, buffer_jobs,
+	                    [&, token = buffer_jobs, query = last_query, rows = buffer.snapshot(),
+	                     row = cursor.row, col = cursor.col()]() mutable
+	                    -> JobScheduler::Callback {
+	            std::size_t before, total;
+	            if(!locate_match(rows, query, row, col, token, before, total))
+	                return nullptr;
+	            return [&show_message, &cursor, &window, before, total] {
+	                show_message("Match " + std::to_string(before + 1) + " of "
+	                             + std::to_string(total), Color::Yellow);
+	                cursor.refresh();
+	                window.present();
+	            };
+	        });
+	    }
+	    cursor.refresh();
+	    window.present();
+	    break;
+	case ctrl('e'): {
+	    // Replace all, which requires the whole file
+	    loader.load_all();
+	    const auto message = replace_all(window, buffer, cursor, input_handler, journal,
+	                                     jobs, &top_visible_row, &left_col);
+	    if(!message.empty())
+	        show_message(message, Color::Yellow);
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case Input::Key_UndoReplace: {
+	    const auto undone = input_handler.undo_replace();
+	    const auto &text = undone.text;
+	    const auto &replacement = undone.replacement;
+	    replace_matches(buffer, cursor, journal,
+	                    shift_matches(undone.matches, text.size(), replacement.size()),
+	                    replacement.size(), text);
+	    // Go back to where the cursor was before the replace
+	    const auto place = undone.cursor;
+	    jump_to(window, cursor, buffer, &top_visible_row, &left_col,
+	            {std::next(buffer.begin(), place.row), place.row, place.col});
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case Input::Key_UndoBatch: {
+	    const auto undone = input_handler.undo_batch();
+	    if(!undone.typed.empty()) {
+	        // Erase what was typed, from where it ended up
+	        const auto typed_at = shift_matches(undone.cursors, 0, undone.typed.size());
+	        replace_at(buffer, typed_at, undone.typed.size(), "");
+	        journal.replace(typed_at, undone.typed.size(), "");
+	    } else {
+	        // Put back what was erased before each cursor, left to right
+	        std::size_t at = 0;
+	        for(std::size_t i = 0; i < undone.cursors.size(); ++i) {
+	            const auto &cols = undone.cursors[i].cols;
+	            const auto &new_cols = undone.moved[i].cols;
+	            std::size_t put_back = 0;
+	            for(std::size_t j = 0; j < cols.size(); ++j) {
+	                const auto len = cols[j] - new_cols[j] - put_back;
+	                if(len > 0)
+	                    journal.insert(undone.cursors[i].row, new_cols[j] + put_back,
+	                                   undone.erased.data() + at, len);
+	                at += len;
+	                put_back += len;
+	            }
+	        }
+	        unerase_before(buffer, undone.cursors, undone.moved, undone.erased);
+	    }
+	    cursors = undone.cursors;
+	    const auto place = undone.cursor;
+	    jump_to(window, cursor, buffer, &top_visible_row, &left_col,
+	            {std::next(buffer.begin(), place.row), place.row, place.col});
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case Input::Key_UndoRegion: {
+	    const auto undone = input_handler.undo_region();
+	    const auto &region = undone.region;
+	    const auto row_it = std::next(buffer.begin(), region.first_row);
+	    if(undone.pasted)
+	        cut_region(buffer, &journal, row_it, region);
+	    else
+	        insert_clip(buffer, &journal, {row_it, region.first_row, region.first_col},
+	                    undone.clip);
+	    const auto place = undone.cursor;
+	    jump_to(window, cursor, buffer, &top_visible_row, &left_col,
+	            {std::next(buffer.begin(), place.row), place.row, place.col});
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case Input::Key_UndoJump: {
+	    const auto place = input_handler.undo_jump();
+	    jump_to(window, cursor, buffer, &top_visible_row, &left_col,
+	            {std::next(buffer.begin(), place.row), place.row, place.col});
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case ctrl(']'): {
+	    // Jump to the bracket matching the one at the cursor, or else to
+	    // the one opening the block the cursor is in
+	    if(!brackets.enabled())
+	        break;
+	    loader.load_all();
+	    brackets.build(buffer);
+	    const auto rows = buffer.snapshot();
+	    BracketIndex::Place place;
+	    bool mismatched = false;
+	    if(brackets.find_match(rows, cursor.row, cursor.col(), place, mismatched)) {
+	        if(place.row == cursor.row && place.col == cursor.col()) {
+	            show_message("No matching bracket", Color::Red);
+	            cursor.refresh();
+	            window.present();
+	            break;
+	        }
+	    } else if(!brackets.find_enclosing(rows, cursor.row, cursor.col(), place)) {
+	        show_message("Not inside any brackets", Color::Red);
+	        cursor.refresh();
+	        window.present();
+	        break;
+	    }
+	    input_handler.push_jump(cursor.row, cursor.col());
+	    jump_to(window, cursor, buffer, &top_visible_row, &left_col,
+	            {row_near_cursor(place.row), place.row, place.col});
+	    if(mark_brackets())
+	        redraw();
+	    if(mismatched)
+	        show_message("Mismatched bracket", Color::Red);
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case ctrl('t'): {
+	    // Fold away the block/section at the cursor, or unfold it
+	    if(folds.unfold(cursor.row_it, cursor.row)) {
+	        folds.take_changed();
+	        redraw();
+	        break;
+	    }
+	    loader.load_all();
+	    if(brackets.enabled())
+	        brackets.build(buffer);
+	    std::size_t header, count;
+	    if(!find_fold(*highlight_mode, brackets, buffer.snapshot(), cursor.row,
+	                  header, count)) {
+	        show_message("Nothing to fold here", Color::Red);
+	        cursor.refresh();
+	        window.present();
+	        break;
+	    }
+	    const auto header_it = row_near_cursor(header);
+	    folds.fold(buffer, header_it, header, count);
+	    // Stay put unless folded away, then go to the fold's header
+	    if(folds.hidden(cursor.row))
+	        jump_to(window, cursor, buffer, &top_visible_row, &left_col, {header_it, header, 0});
+	    else
+	        jump_to(window, cursor, buffer, &top_visible_row, &left_col,
+	                {cursor.row_it, cursor.row, cursor.col()});
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case ctrl('u'):
+	    // Unfold everything
+	    folds.unfold_all();
+	    folds.take_changed();
+	    jump_to(window, cursor, buffer, &top_visible_row, &left_col,
+	            {cursor.row_it, cursor.row, cursor.col()});
+	    cursor.refresh();
+	    window.present();
+	    break;
+	case ctrl('n'): {
+	    // Complete the word before the cursor, or swap in the next completion
+	    if(completion.words.empty()) {
+	        loader.load_all();
+	        words.build(buffer);
+	        const auto start = word_start(*cursor.row_it, cursor.col());
+	        completion.typed = cursor.col() - start;
+	        if(completion.typed > 0) {
+	            const std::string_view prefix(cursor.row_it->data() + start, completion.typed);
+	            completion.words = words.complete(prefix, MaxCompletions);
+	        }
+	        if(completion.words.empty()) {
+	            show_message("No completions", Color::Red);
+	            cursor.refresh();
+	            window.present();
+	            break;
+	        }
+	        completion.index = 0;
+	    } else {
+	        // Take out the last completion (last byte first, as Backspace does)
+	        const auto len = completion.inserted;
+	        cursor.move_left(len);
+	        for(auto i = len; i-- > 0;)
+	            input_handler.push(Input::Action::Delete, cursor.col_it[i]);
+	        journal.erase(cursor.row, cursor.col(), len);
+	        cursor.col_it = buffer.erase(cursor.row_it, cursor.row, cursor.col_it,
+	                                     cursor.col_it + len);
+	        completion.index = (completion.index + 1) % completion.words.size();
+	    }
+	    const auto &word = completion.words[completion.index];
+	    const auto rest = std::string_view(word).substr(completion.typed);
+	    for(const char letter : rest)
+	        input_handler.push(Input::Action::Insert, letter);
+	    journal.insert(cursor.row, cursor.col(), rest.data(), rest.size());
+	    cursor.col_it = buffer.insert(cursor.row_it, cursor.row, cursor.col_it, rest.begin(),
+	                                  rest.end());
+	    cursor.move_right(rest.size());
+	    completion.inserted = rest.size();
+	    scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
+	    draw(window, buffer, top_visible_row, left_col);
+	    show_message("Completion " + std::to_string(completion.index + 1) + " of "
+	                 + std::to_string(completion.words.size()), Color::Yellow);
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case ctrl('o'): {
+	    // Jump to a symbol (function, class, etc.) picked by name
+	    if(!symbols.enabled()) {
+	        show_message("No symbols in this kind of file", Color::Red);
+	        cursor.refresh();
+	        window.present();
+	        break;
+	    }
+	    loader.load_all();
+	    if(!symbols.built()) {
+	        // The background scan hasn't finished; no use waiting for it
+	        SymbolIndex::Contents found;
+	        symbols.scan(buffer.snapshot(), CancelToken(), found);
+	        symbols.assign(std::move(found));
+	    }
+	    std::size_t picked;
+	    if(pick_symbol(window, symbols, picked)) {
+	        const auto row = symbols.row_of(picked);
+	        input_handler.push_jump(cursor.row, cursor.col());
+	        jump_to(window, cursor, buffer, &top_visible_row, &left_col,
+	                {row_near_cursor(row), row, symbols.symbols()[picked].col});
+	    } else {
+	        redraw();
+	    }
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case ctrl('d'): {
+	    // Add a cursor on the row below, in the same column, and make it
+	    // the main one
+	    loader.load_rows(cursor.row + 2);
+	    if(std::next(folds.fold_end(cursor.row_it)) == buffer.end())
+	        break;
+	    if(cursors.empty())
+	        cursors.push_back({cursor.row, {cursor.col()}});
+	    const auto column = cursor.row_it->column_of(cursor.col());
+	    auto row_it = cursor.row_it;
+	    auto row = cursor.row;
+	    folds.step_down(row_it, row);
+	    const auto col = row_it->byte_at_column(column);
+	    add_place(cursors, row, col);
+	    jump_to(window, cursor, buffer, &top_visible_row, &left_col, {row_it, row, col});
+	    show_message(std::to_string(count_matches(cursors)) + " cursors", Color::Yellow);
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case ctrl('a'): {
+	    // Put a cursor at every match of what was last found
+	    if(last_query.empty()) {
+	        show_message("Nothing has been found yet", Color::Red);
+	        cursor.refresh();
+	        window.present();
+	        break;
+	    }
+	    loader.load_all();
+	    MatchList found;
+	    if(!last_query.is_regex()) {
+	        found = find_all(buffer, last_query.text());
+	    } else {
+	        std::size_t row = 0;
+	        for(const auto &text : buffer) {
+	            last_query.for_each_match(text.data(), text.size(),
+	                                      [&](std::size_t start, std::size_t) {
+	                if(found.empty() || found.back().row != row)
+	                    found.push_back({row, {}});
+	                found.back().cols.push_back(start);
+	            });
+	            ++row;
+	        }
+	    }
+	    add_place(found, cursor.row, cursor.col());
+	    const auto count = count_matches(found);
+	    if(count == 1) {
+	        show_message("No other matches", Color::Red);
+	        cursor.refresh();
+	        window.present();
+	        break;
+	    }
+	    cursors = std::move(found);
+	    redraw();
+	    show_message(std::to_string(count) + " cursors", Color::Yellow);
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case ctrl('b'):
+	    // Start selecting text at the cursor, or stop
+	    selecting = !selecting;
+	    mark_row = cursor.row;
+	    mark_col = cursor.col();
+	    if(selecting) {
+	        show_message("Selecting (Ctrl-x cuts, Ctrl-y copies)", Color::Yellow);
+	        cursor.refresh();
+	        window.present();
+	    }
+	    break;
+	case ctrl('x'):
+	case ctrl('y'): {
+	    // Cut/copy the selection, keeping it in the kill ring to paste
+	    if(selection.empty()) {
+	        show_message("Nothing selected (Ctrl-b starts selecting)", Color::Red);
+	        cursor.refresh();
+	        window.present();
+	        break;
+	    }
+	    const auto region = selection;
+	    Clip clip{buffer.snapshot(), region};
+	    journal.copy(clip);
+	    kill_ring.push(clip);
+	    selecting = false;
+	    mark_selection();
+	    const auto rows = std::to_string(region.last_row - region.first_row + 1);
+	    if(input == ctrl('x')) {
+	        input_handler.push_region({{cursor.row, cursor.col()}, region, std::move(clip),
+	                                   false});
+	        jump_to(window, cursor, buffer, &top_visible_row, &left_col,
+	                cut_region(buffer, &journal, row_near_cursor(region.first_row), region));
+	        show_message("Cut " + rows + " lines", Color::Yellow);
+	    } else {
+	        redraw();
+	        show_message("Copied " + rows + " lines", Color::Yellow);
+	    }
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case ctrl('v'): {
+	    // Paste the last text cut or copied
+	    if(kill_ring.empty()) {
+	        show_message("Nothing to paste", Color::Red);
+	        cursor.refresh();
+	        window.present();
+	        break;
+	    }
+	    const Input::Place place{cursor.row, cursor.col()};
+	    paste_clip(0);
+	    input_handler.push_region({place, last_paste.region, {}, true});
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case ctrl('p'): {
+	    // Swap the text just pasted for the clip cut/copied before it
+	    if(!last_paste.active) {
+	        show_message("Ctrl-p swaps in older text right after pasting", Color::Red);
+	        cursor.refresh();
+	        window.present();
+	        break;
+	    }
+	    const auto region = last_paste.region;
+	    const auto start = cut_region(
+	        buffer, &journal, std::prev(cursor.row_it, region.last_row - region.first_row),
+	        region);
+	    cursor.jump(start.row_it, start.row, start.col);
+	    paste_clip((last_paste.index + 1) % kill_ring.size());
+	    input_handler.amend_region(last_paste.region);
+	    show_message("Clip " + std::to_string(last_paste.index + 1) + " of "
+	                 + std::to_string(kill_ring.size()), Color::Yellow);
+	    cursor.refresh();
+	    window.present();
+	    break;
+	}
+	case ctrl('w'):
+	    // Toggle wrapping long rows onto several screen rows
+	    soft_wrap = !soft_wrap;
+	    left_col = 0;
+	    top_segment = 0;
+	    cursor.y = folds.shown_before(cursor.row) - folds.shown_before(top_visible_row);
+	    scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
+	    window.clear();
+	    draw(window, buffer, top_visible_row, left_col);
+	    cursor.refresh();
+	    window.present();
+	    break;
 	case Key_Enter:
 	case Key_Enter2: {
-            auto next_row = buffer.emplace(std::next(cursor.row_it));
-            std::copy(cursor.col_it, cursor.row_it->end(),
-                      std::back_inserter(*next_row));
-            cursor.col_it = cursor.row_it->erase(cursor.col_it, cursor.row_it->end());
+            split_row(buffer, &journal, {cursor.row_it, cursor.row, cursor.col()});
             cursor.move_down();
             cursor.move_line_start();
             input_handler.push(Input::Action::Insert, '\n');
-            scroll_down(window, &cursor.y, &top_visible_row, cursor.row_it, buffer);
+            scroll_down(window, &cursor.y, &top_visible_row, left_col, cursor.row_it,
+                        buffer);
+            scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
 	    window.clear();
-	    draw(window, buffer, top_visible_row);
+	    draw(window, buffer, top_visible_row, left_col);
             cursor.refresh();
 	    window.present();
 	    break;
         }
 	case Key_Backspace:
 	case Key_Backspace2:
-	    if(cursor.col_it != cursor.row_it->begin()) {
-		// If line isn't empty, just remove the character
-                cursor.move_left();
-                input_handler.push(Input::Action::Delete, *cursor.col_it);
-		cursor.col_it = cursor.row_it->erase(cursor.col_it);
-	    } else if(cursor.row_it != buffer.begin()) {
-		// If deleting a newline, move text of
-		// that line to the end of the prior line
-                input_handler.push(Input::Action::Delete, '\n');
-		auto prior_row = std::prev(cursor.row_it);
-                const auto old_len = cursor.row_it->size();
-		std::move(cursor.row_it->begin(), cursor.row_it->end(),
-			  std::back_inserter(*prior_row));
-                cursor.row_it = buffer.erase(cursor.row_it);
-                cursor.move_up();
-                // Move cursor to the front of the newly appended text
-                cursor.move_line_end();
-                cursor.move_left(old_len);
+	    if(!cursors.empty()) {
+	        edit_at_cursors("");
+	        break;
 	    }
-            scroll_up(window, &cursor.y, &top_visible_row, buffer);
+	    {
+                std::string erased;
+                const auto place = erase_char_before(
+                    buffer, &journal, {cursor.row_it, cursor.row, cursor.col()}, erased);
+                // Last byte first, so undoing re-inserts them in order
+                for(auto i = erased.size(); i-- > 0;)
+                    input_handler.push(Input::Action::Delete, erased[i]);
+                cursor.jump(place.row_it, place.row, place.col);
+                if(erased == "\n")
+                    --cursor.y;
+	    }
+            scroll_up(window, &cursor.y, &top_visible_row, left_col, buffer);
+            scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
 	    window.clear();
-	    draw(window, buffer, top_visible_row);
+	    draw(window, buffer, top_visible_row, left_col);
 	    cursor.refresh();
 	    window.present();
 	    break;
 	case Key_Right:
-	    if(cursor.col_it != cursor.row_it->end()) {
-		// Go right as long as there is text left to go over
-                input_handler.push(Input::Action::Right);
-		cursor.move_right();
-	    } else if(std::next(cursor.row_it) != buffer.end()) {
-		// Can't go right anymore at buffer end
+	    if(!cursors.empty()) {
+	        move_cursors(true);
+	        break;
+	    }
+	    {
+		// Over the next character, or onto the next row at the end of
+		// one (but not past the end of the buffer)
+		Position place{cursor.row_it, cursor.row, cursor.col()};
+		if(!move_right(buffer, &folds, place))
+		    break;
                 input_handler.push(Input::Action::Right);
-                cursor.move_down();
-                cursor.move_line_start();
-                scroll_down(window, &cursor.y, &top_visible_row, cursor.row_it, buffer);
+                const bool next_row = place.row != cursor.row;
+                cursor.jump(place.row_it, place.row, place.col);
+                if(next_row) {
+                    ++cursor.y;
+                    scroll_down(window, &cursor.y, &top_visible_row, left_col,
+                                cursor.row_it, buffer);
+                }
 	    }
+            scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
 	    cursor.refresh();
 	    window.present();
 	    break;
 	case Key_Left:
-	    if(cursor.col_it != cursor.row_it->begin()) {
-		// Go left as long as there is text left to go over
-                input_handler.push(Input::Action::Left);
-		cursor.move_left();
-	    } else if(cursor.row_it != buffer.begin()) {
-		// Can't go left anymore at buffer start
+	    if(!cursors.empty()) {
+	        move_cursors(false);
+	        break;
+	    }
+	    {
+		// Back over the character before, or onto the end of the row
+		// before at the start of one (but not past the buffer's start)
+		Position place{cursor.row_it, cursor.row, cursor.col()};
+		if(!move_left(buffer, &folds, place))
+		    break;
                 input_handler.push(Input::Action::Left);
-		cursor.move_up();
-		cursor.move_line_end();
-                scroll_up(window, &cursor.y, &top_visible_row, buffer);
+                const bool prior_row = place.row != cursor.row;
+                cursor.jump(place.row_it, place.row, place.col);
+                if(prior_row) {
+                    --cursor.y;
+                    scroll_up(window, &cursor.y, &top_visible_row, left_col, buffer);
+                }
 	    }
+            scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
 	    cursor.refresh();
 	    window.present();
 	    break;
 	case Key_Up: {
-	    if(cursor.row_it == buffer.begin())
-                break;
+            const auto goal_col = cursor.goal_col;
+            if(soft_wrap) {
+                // Go up a screen row, which may be within the same row
+                if(!cursor.move_up_wrapped(window.width()))
+                    break;
+            } else {
+                Position place{cursor.row_it, cursor.row, cursor.col()};
+                if(!move_vertically(buffer, &folds, place, false, goal_col))
+                    break;
+                --cursor.y;
+                cursor.jump(place.row_it, place.row, place.col);
+            }
             input_handler.push(Input::Action::Up);
-            cursor.move_up();
-	    const auto offset = std::min<unsigned long>(cursor.x, cursor.row_it->size());
-            cursor.move_line_start();
-            cursor.move_right(offset);
-            scroll_up(window, &cursor.y, &top_visible_row, buffer);
+            scroll_up(window, &cursor.y, &top_visible_row, left_col, buffer);
+            scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
+            // Keep aiming for the same column past shorter rows
+            cursor.goal_col = goal_col;
 	    cursor.refresh();
 	    window.present();
 	    break;
 	}
 	case Key_Down: {
-	    if(std::next(cursor.row_it) == buffer.end())
-		break;
+            const auto goal_col = cursor.goal_col;
+            if(soft_wrap) {
+                if(!cursor.move_down_wrapped(window.width()))
+                    break;
+            } else {
+                Position place{cursor.row_it, cursor.row, cursor.col()};
+                if(!move_vertically(buffer, &folds, place, true, goal_col))
+                    break;
+                ++cursor.y;
+                cursor.jump(place.row_it, place.row, place.col);
+            }
             input_handler.push(Input::Action::Down);
-            cursor.move_down();
-            const auto offset = std::min<unsigned long>(cursor.x, cursor.row_it->size());
-            cursor.move_line_start();
-            cursor.move_right(offset);
-            scroll_down(window, &cursor.y, &top_visible_row, cursor.row_it, buffer);
+            scroll_down(window, &cursor.y, &top_visible_row, left_col, cursor.row_it,
+                        buffer);
+            scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
+            cursor.goal_col = goal_col;
 	    cursor.refresh();
 	    window.present();
 	    break;
 	}
-	case Key_Tab:
+	case Key_Tab: {
+            if(!cursors.empty()) {
+                edit_at_cursors(std::string(TabSize, ' '));
+                break;
+            }
             for(std::size_t i = 0; i < TabSize; ++i)
                 input_handler.push(Input::Action::Insert, ' ');
-	    cursor.col_it = cursor.row_it->insert(cursor.col_it, TabSize, ' ');
-            cursor.move_right(TabSize);
-	    draw(window, buffer, top_visible_row);
+            const auto place = insert_text(buffer, &journal,
+                                           {cursor.row_it, cursor.row, cursor.col()},
+                                           std::string(TabSize, ' '));
+            cursor.jump(place.row_it, place.row, place.col);
+            scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
+	    draw(window, buffer, top_visible_row, left_col);
 	    cursor.refresh();
 	    window.present();
 	    break;
-	default:
+        }
+	default: {
+            if(!cursors.empty()) {
+                const char letter = input;
+                edit_at_cursors({&letter, 1});
+                break;
+            }
             input_handler.push(Input::Action::Insert, input);
-            cursor.col_it = cursor.row_it->insert(cursor.col_it, input);
-            cursor.move_right();
-	    draw(window, buffer, top_visible_row);
+            const char letter = input;
+            const auto place = insert_text(buffer, &journal,
+                                           {cursor.row_it, cursor.row, cursor.col()},
+                                           {&letter, 1});
+            cursor.jump(place.row_it, place.row, place.col);
+            scroll_sideways(window, cursor, &left_col, &top_visible_row, buffer);
+	    draw(window, buffer, top_visible_row, left_col);
 	    cursor.refresh();
 	    window.present();
         }
+        }
+    };
+    events.on_key([&](int key) {
+        // Any other key keeps the completion put in last
+        if(key != ctrl('n'))
+            completion.words.clear();
+        // ...or the text pasted last
+        if(key != ctrl('v') && key != ctrl('p'))
+            last_paste.active = false;
+        input_handler.dispatch(key, handle_key);
+        if(folds.take_changed()) {
+            // Edits opened folds, so the rows below them moved down
+            jump_to(window, cursor, buffer, &top_visible_row, &left_col,
+                    {cursor.row_it, cursor.row, cursor.col()});
+            cursor.refresh();
+            window.present();
+        }
+        const bool brackets_changed = mark_brackets();
+        if(mark_selection() || brackets_changed)
+            redraw();
+        index_symbols();
+        diff_with_disk();
+    });
+    index_symbols();
+    diff_with_disk();
+    events.run();
+    stop_diffing();
+    // Other screens don't mark brackets, fold rows, have several cursors or
+    // select text
+    marked_brackets[0] = marked_brackets[1] = MarkedBracket();
+    folds = Folds();
+    diff_gutter = DiffGutter();
+    window.set_gutter_width(0);
+    cursors.clear();
+    selection = Region();
+}
+
+/**Lists the lines containing text in every file under directory, adding
+   them as they are found; Enter opens the selected one's file at that line
+   (quitting it comes back to the list)*/
+static void grep_files(Screen &window, const char *text, const char *directory)
+{
+    EventLoop events(window);
+    ProjectSearch search(directory, text);
+    std::vector<GrepMatch> matches;
+    // Which match is selected, and which one is at the top of the screen
+    std::size_t selected = 0;
+    std::size_t top = 0;
+    bool searching = true;
+    Query query(text, false);
+    const auto redraw = [&] {
+        const std::size_t height = window.height() - 1;
+        if(selected < top)
+            top = selected;
+        else if(selected >= top + height)
+            top = selected - height + 1;
+
+        // One screen row per match, with the text searched for marked
+        window.clear();
+        for(auto i = top; i < std::min(matches.size(), top + height); ++i) {
+            const auto &match = matches[i];
+            const auto line = match.path + ':' + std::to_string(match.line + 1) + ": "
+                + match.text;
+            const BufferRow row(line.data(), line.data() + line.size(),
+                                BufferRow::NoOrigin);
+            draw_text(window, row, i - top, 0, row.size(), 0);
+            mark_matches(window, query, row, i - top, 0, row.size(), 0);
+        }
+        if(!matches.empty()) {
+            for(int x = 0; x < window.width(); ++x)
+                window.set_reverse(x, selected - top);
+        }
+        const auto status = std::to_string(matches.size()) + " matches in "
+            + std::to_string(search.files_searched()) + " files"
+            + (searching ? " (searching)" : "");
+        window.write(0, height, status.c_str(), Color::Yellow);
+        window.set_cursor(0, selected - top);
+        window.present();
+    };
+    // Show the matches found so far every so often, until all are in
+    std::function<void()> show_progress = [&] {
+        // Checked first, so no matches can come in after the last look
+        searching = !search.done();
+        search.take_matches(matches);
+        redraw();
+        if(searching)
+            events.add_timer(GrepRefreshInterval, show_progress);
+    };
+    show_progress();
+
+    events.on_resize(redraw);
+    events.on_key([&](int key) {
+        const std::size_t height = window.height() - 1;
+        switch(key) {
+        case ctrl('c'):
+            events.stop();
+            return;
+        case Key_Down:
+            if(selected + 1 < matches.size())
+                ++selected;
+            break;
+        case Key_Up:
+            if(selected > 0)
+                --selected;
+            break;
+        case Key_PageDown:
+            if(!matches.empty())
+                selected = std::min(selected + height, matches.size() - 1);
+            break;
+        case Key_PageUp:
+            selected -= std::min(selected, height);
+            break;
+        case Key_Enter:
+        case Key_Enter2:
+            if(!matches.empty()) {
+                window.clear();
+                edit(window, matches[selected].path.c_str(), matches[selected].line);
+            }
+            break;
+        }
+        redraw();
+    });
+    events.run();
+}
+
+/**Runs an editing script on each of the files, with every core taking a
+   file at a time, and prints how it went for each; returns the exit status*/
+static int batch_edit(const char *script_file, char **files, int file_count)
+{
+    Script script;
+    std::string error;
+    if(!script.load(script_file, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
     }
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    std::vector<BatchResult> results(file_count);
+    {
+        WorkPool pool;
+        for(int i = 0; i < file_count; ++i)
+            pool.push([&script, &results, files, i] { results[i] = script.run(files[i]); });
+        pool.wait();
+    }
+    const double total = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
 
+    int changed = 0;
+    int failed = 0;
+    for(int i = 0; i < file_count; ++i) {
+        const auto &result = results[i];
+        if(!result.ok) {
+            ++failed;
+            printf("%s: failed, %s (%.1f ms)\n", files[i], result.error.c_str(),
+                   result.milliseconds);
+            continue;
+        }
+        if(result.edits > 0)
+            ++changed;
+        printf("%s: %zu edit%s (%.1f ms)\n", files[i], result.edits,
+               result.edits == 1 ? "" : "s", result.milliseconds);
+    }
+    printf("%d file%s, %d changed, %d failed in %.1f ms\n", file_count,
+           file_count == 1 ? "" : "s", changed, failed, total);
+    return failed > 0 ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc >= 4 && std::strcmp(argv[1], "--batch") == 0)
+        // No terminal needed
+        return batch_edit(argv[2], argv + 3, argc - 3);
+    // Whether to open the file in the read-only pager
+    const bool view_only = argc == 3 && std::strcmp(argv[1], "--view") == 0;
+    const bool grep = (argc == 3 || argc == 4) && std::strcmp(argv[1], "--grep") == 0;
+    if(argc != 2 && !view_only && !grep) {
+	printf("Usage: ./editorial [--view] </path/to/file>\n"
+	       "       ./editorial --grep <text> [/path/to/directory]\n"
+	       "       ./editorial --batch <script> <file>...\n");
+	return 1;
+    }
+
+    Screen window;
+    if(grep) {
+        grep_files(window, argv[2], argc == 4 ? argv[3] : ".");
+    } else if(view_only) {
+        set_highlight_mode(argv[2]);
+        view(window, argv[2]);
+    } else {
+        edit(window, argv[1]);
+    }
     return 0;
 }
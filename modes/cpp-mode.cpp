@@ -48,6 +48,7 @@ int main()
     t.add_match("public:", "KeywordColor");
     t.add_match("private:", "KeywordColor");
     t.add_match("return ", "KeywordColor");
+    t.add_match("struct ", "KeywordColor");
     t.add_match("switch", "KeywordColor");
     t.add_match("true", "KeywordColor");
     t.add_match("try", "KeywordColor");
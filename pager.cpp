@@ -0,0 +1,250 @@
+#include "pager.h"
+#include "search.h"
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Size of each mapped region of the file; a multiple of the page size
+constexpr off_t WindowSize = 1 << 24;
+// Most windows mapped at once, bounding how much of the file is resident
+constexpr std::size_t MaxWindows = 4;
+// How many lines apart the entries in the line index are
+constexpr std::size_t CheckpointInterval = 1024;
+
+PagedFile::PagedFile(const char *filename)
+{
+    m_fd = open(filename, O_RDONLY);
+    struct stat info;
+    if(m_fd == -1 || fstat(m_fd, &info) != 0) {
+        if(m_fd != -1)
+            close(m_fd);
+        m_fd = -1;
+        return;
+    }
+    m_size = info.st_size;
+    m_checkpoints.push_back(0);
+    m_indexer = std::thread(&PagedFile::build_index, this);
+}
+
+PagedFile::~PagedFile()
+{
+    m_stopping = true;
+    if(m_indexer.joinable())
+        m_indexer.join();
+    for(const auto &window : m_windows)
+        munmap(const_cast<char*>(window.data), window.len);
+    if(m_fd != -1)
+        close(m_fd);
+}
+
+const char* PagedFile::map(off_t offset, off_t &avail)
+{
+    auto window = std::find_if(m_windows.begin(), m_windows.end(),
+                               [offset](const Window &w) {
+                                   return offset >= w.start
+                                       && offset < w.start + w.len;
+                               });
+    if(window == m_windows.end()) {
+        if(m_windows.size() == MaxWindows) {
+            // Evict the least recently used window
+            window = std::min_element(m_windows.begin(), m_windows.end(),
+                                      [](const Window &a, const Window &b) {
+                                          return a.last_used < b.last_used;
+                                      });
+            munmap(const_cast<char*>(window->data), window->len);
+            m_windows.erase(window);
+        }
+        const off_t start = offset - offset % WindowSize;
+        const off_t len = std::min(WindowSize, m_size - start);
+        void *data = mmap(nullptr, len, PROT_READ, MAP_SHARED, m_fd, start);
+        if(data == MAP_FAILED) {
+            avail = 0;
+            return nullptr;
+        }
+        m_windows.push_back({start, len, static_cast<const char*>(data), 0});
+        window = std::prev(m_windows.end());
+    }
+    window->last_used = ++m_use_count;
+    avail = window->start + window->len - offset;
+    return window->data + (offset - window->start);
+}
+
+std::size_t PagedFile::read(off_t offset, char *out, std::size_t len)
+{
+    std::size_t copied = 0;
+    while(copied < len && offset < m_size) {
+        off_t avail;
+        const char *data = map(offset, avail);
+        if(data == nullptr)
+            break;
+        const auto amount = std::min<off_t>(avail, len - copied);
+        std::memcpy(out + copied, data, amount);
+        copied += amount;
+        offset += amount;
+    }
+    return copied;
+}
+
+std::size_t PagedFile::read_line(off_t offset, char *out, std::size_t len)
+{
+    std::size_t copied = 0;
+    while(copied < len && offset < m_size) {
+        off_t avail;
+        const char *data = map(offset, avail);
+        if(data == nullptr)
+            break;
+        const auto amount = std::min<off_t>(avail, len - copied);
+        auto *newline = static_cast<const char*>(std::memchr(data, '\n', amount));
+        const auto line_part = newline ? newline - data : amount;
+        std::memcpy(out + copied, data, line_part);
+        copied += line_part;
+        if(newline != nullptr)
+            break;
+        offset += amount;
+    }
+    return copied;
+}
+
+off_t PagedFile::next_line(off_t offset)
+{
+    while(offset < m_size) {
+        off_t avail;
+        const char *data = map(offset, avail);
+        if(data == nullptr)
+            break;
+        auto *newline = static_cast<const char*>(std::memchr(data, '\n', avail));
+        if(newline != nullptr)
+            return offset + (newline - data) + 1;
+        offset += avail;
+    }
+    return -1;
+}
+
+off_t PagedFile::prev_line(off_t offset)
+{
+    // Skip the newline that ends the prior line
+    offset -= 2;
+    while(offset >= 0) {
+        off_t avail;
+        const char *data = map(offset, avail);
+        if(data == nullptr)
+            break;
+        // Scan backwards to the start of this window
+        for(off_t i = 0; i <= offset % WindowSize; ++i) {
+            if(*(data - i) == '\n')
+                return offset - i + 1;
+        }
+        offset -= offset % WindowSize + 1;
+    }
+    return 0;
+}
+
+off_t PagedFile::line_offset(std::size_t line)
+{
+    off_t offset;
+    {
+        std::unique_lock<std::mutex> lock(m_index_mutex);
+        m_index_grew.wait(lock, [&]{ return m_index_done || m_indexed_lines > line; });
+        if(line >= m_indexed_lines)
+            return -1;
+        offset = m_checkpoints[line / CheckpointInterval];
+    }
+    for(std::size_t i = 0; i < line % CheckpointInterval; ++i)
+        offset = next_line(offset);
+    return offset;
+}
+
+std::size_t PagedFile::line_at(off_t offset)
+{
+    std::size_t checkpoint;
+    off_t line_start;
+    {
+        std::unique_lock<std::mutex> lock(m_index_mutex);
+        m_index_grew.wait(lock, [&]{
+            return m_index_done || m_checkpoints.back() > offset;
+        });
+        // Last checkpoint at or before offset
+        checkpoint = std::upper_bound(m_checkpoints.begin(), m_checkpoints.end(),
+                                      offset) - m_checkpoints.begin() - 1;
+        line_start = m_checkpoints[checkpoint];
+    }
+    std::size_t line = checkpoint * CheckpointInterval;
+    off_t next;
+    while((next = next_line(line_start)) != -1 && next <= offset) {
+        line_start = next;
+        ++line;
+    }
+    return line;
+}
+
+off_t PagedFile::find(off_t offset, std::string_view text)
+{
+    if(text.empty())
+        return offset;
+    const off_t len = text.size();
+    std::vector<char> straddle;
+    while(offset + len <= m_size) {
+        off_t avail;
+        const char *data = map(offset, avail);
+        if(data == nullptr)
+            break;
+        const auto *match = find_literal(data, avail, text);
+        if(match != nullptr)
+            return offset + (match - data);
+        const off_t boundary = offset + avail;
+        if(boundary >= m_size)
+            break;
+        // Check for a match that starts in this window and ends in the next
+        const off_t straddle_start = std::max(offset, boundary - len + 1);
+        straddle.resize(std::min(boundary + len - 1, m_size) - straddle_start);
+        if(read(straddle_start, straddle.data(), straddle.size()) != straddle.size())
+            break;
+        match = find_literal(straddle.data(), straddle.size(), text);
+        if(match != nullptr)
+            return straddle_start + (match - straddle.data());
+        offset = boundary;
+    }
+    return -1;
+}
+
+/**Runs on its own thread, mapping one window at a time (separately from the
+   windows used for display) and recording every CheckpointInterval-th line*/
+void PagedFile::build_index()
+{
+    std::size_t lines = 1;
+    for(off_t start = 0; start < m_size && !m_stopping; start += WindowSize) {
+        const off_t len = std::min(WindowSize, m_size - start);
+        void *mapping = mmap(nullptr, len, PROT_READ, MAP_SHARED, m_fd, start);
+        if(mapping == MAP_FAILED)
+            break;
+        madvise(mapping, len, MADV_SEQUENTIAL);
+        const char *data = static_cast<const char*>(mapping);
+        const char *pos = data;
+        const char *end = data + len;
+        std::vector<off_t> new_checkpoints;
+        while(pos < end) {
+            auto *newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+            if(newline == nullptr)
+                break;
+            pos = newline + 1;
+            if(lines++ % CheckpointInterval == 0)
+                new_checkpoints.push_back(start + (pos - data));
+        }
+        munmap(mapping, len);
+        {
+            std::lock_guard<std::mutex> lock(m_index_mutex);
+            m_checkpoints.insert(m_checkpoints.end(), new_checkpoints.begin(),
+                                 new_checkpoints.end());
+            m_indexed_lines = lines;
+        }
+        m_index_grew.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_index_mutex);
+        m_index_done = true;
+    }
+    m_index_grew.notify_all();
+}
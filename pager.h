@@ -0,0 +1,72 @@
+#ifndef PAGER_H
+#define PAGER_H
+#include <vector>
+#include <string_view>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <sys/types.h>
+
+/**Read-only access to a file that may be larger than memory. The file is
+   only ever mapped a few windows at a time (least recently used windows are
+   unmapped first), and lines are located through a sparse index holding the
+   offset of every CheckpointInterval-th line, built by a background thread*/
+class PagedFile {
+public:
+    explicit PagedFile(const char *filename);
+    ~PagedFile();
+    PagedFile(const PagedFile&) = delete;
+    PagedFile& operator=(const PagedFile&) = delete;
+
+    bool is_open() const { return m_fd != -1; }
+    off_t size() const { return m_size; }
+    /**Copies up to len bytes starting at offset into out, stopping early
+       at the end of the line; returns the number of bytes copied*/
+    std::size_t read_line(off_t offset, char *out, std::size_t len);
+    /**Offset where the line after the one containing offset starts,
+       or -1 if offset is on the last line*/
+    off_t next_line(off_t offset);
+    /**Offset where the line before the one starting at offset starts*/
+    off_t prev_line(off_t offset);
+    /**Offset where the given line (counting from 0) starts, or -1 if the
+       file has fewer lines; waits for the index to reach the line*/
+    off_t line_offset(std::size_t line);
+    /**The line (counting from 0) containing offset; waits for the index*/
+    std::size_t line_at(off_t offset);
+    /**Offset of the first occurrence of text at or after offset, or -1*/
+    off_t find(off_t offset, std::string_view text);
+
+    /**Number of lines known so far, and whether that is all of them*/
+    std::size_t indexed_lines() const { return m_indexed_lines; }
+    bool index_done() const { return m_index_done; }
+private:
+    struct Window {
+        off_t start;
+        off_t len;
+        const char *data;
+        unsigned long last_used;
+    };
+
+    int m_fd = -1;
+    off_t m_size = 0;
+    std::vector<Window> m_windows;
+    unsigned long m_use_count = 0;
+
+    // Offset of line i * CheckpointInterval at index i
+    std::vector<off_t> m_checkpoints;
+    std::atomic<std::size_t> m_indexed_lines{1};
+    std::atomic<bool> m_index_done{false};
+    std::atomic<bool> m_stopping{false};
+    std::mutex m_index_mutex;
+    std::condition_variable m_index_grew;
+    std::thread m_indexer;
+
+    /**Points to the byte at offset; avail is set to how many bytes can be
+       read from there before the end of its window*/
+    const char* map(off_t offset, off_t &avail);
+    /**Copies up to len bytes starting at offset into out*/
+    std::size_t read(off_t offset, char *out, std::size_t len);
+    void build_index();
+};
+#endif
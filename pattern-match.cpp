@@ -2,6 +2,7 @@
 #include "syntax-highlight.h"
 #include "pattern-match.h"
 #include <algorithm>
+#include <cctype>
 
 void Tree::add_child(char letter, std::string_view color)
 {
@@ -30,6 +31,7 @@ void Tree::add_match(std::string_view match, std::string_view color)
 {
     if(match.empty()) {
         // At end of match being added
+        ends_match = true;
         return;
     }
 
@@ -41,20 +43,34 @@ void Tree::add_match(std::string_view match, std::string_view color)
 }
 
 
-static void print_tree(const Tree &tree, std::ofstream &file)
+/**How generated code reads the letters to match: checking that there is
+   another one, reading it (and moving past it), and the length matched*/
+struct Reader {
+    const char *at_end;
+    const char *next;
+    const char *length;
+};
+
+// Reads from the screen, starting at (col, row)
+constexpr Reader ScreenReader{"col >= window_width", "window.get(curr_col++, row)",
+                              "curr_col - col"};
+// Reads from [first, last)
+constexpr Reader TextReader{"curr == last", "*curr++", "curr - first"};
+
+static void print_tree(const Tree &tree, std::ofstream &file, const Reader &reader)
 {
     if(tree.empty()) {
         // If user's string ends at this node, they have a match
-        file << "return {true, curr_color, curr_col - col};\n";
+        file << "return {true, curr_color, " << reader.length << "};\n";
         return;
     }
 
-    file << "if(col >= window_width) return {false, Color::Default, 0};\n"
-         << "switch(window.get(curr_col++, row)) {\n";
+    file << "if(" << reader.at_end << ") return {false, Color::Default, 0};\n"
+         << "switch(" << reader.next << ") {\n";
     for(const auto &child : tree.children) {
         file << "case '" << child->letter << "':\n"
              << "curr_color = " << child->color << ";\n";
-        print_tree(*child, file);
+        print_tree(*child, file, reader);
         file << "break;\n";
     }
     file << "default:\n"
@@ -63,9 +79,33 @@ static void print_tree(const Tree &tree, std::ofstream &file)
 }
 
 
+/**Collects the matches in the tree that are words to complete: letters,
+   digits, '_' and '$' not starting with a digit, once any trailing
+   space/colon (e.g. in "int " or "public:") is dropped*/
+static void collect_words(const Tree &tree, std::string &match, std::set<std::string> &words)
+{
+    if(tree.ends_match) {
+        auto word = match.substr(0, match.find_last_not_of(" :") + 1);
+        const bool is_word = !word.empty() && !std::isdigit(static_cast<unsigned char>(word[0]))
+            && std::all_of(word.begin(), word.end(), [](char letter) {
+                   return std::isalnum(static_cast<unsigned char>(letter))
+                       || letter == '_' || letter == '$';
+               });
+        if(is_word)
+            words.insert(word);
+    }
+    for(const auto &child : tree.children) {
+        match.push_back(child->letter);
+        collect_words(*child, match, words);
+        match.pop_back();
+    }
+}
+
 // Used to construct the declaration of matching functions (e.g. match_cpp())
 constexpr const char *ReturnType = "std::tuple<bool,Color,std::size_t> ";
 constexpr const char *Args = "(Screen &window, int col, int row)";
+// The same, for the version matching text in memory (e.g. match_cpp_text())
+constexpr const char *TextArgs = "(const char *first, const char *last)";
 
 void write_header(const std::string &path, const char *func_name)
 {
@@ -78,6 +118,10 @@ void write_header(const std::string &path, const char *func_name)
                 << "#include <tuple>\n"
                 << "#include \"screen.h\"\n\n"
                 << ReturnType << func_name << Args << ";\n"
+                << "// The same matches, at the start of [first, last)\n"
+                << ReturnType << func_name << "_text" << TextArgs << ";\n"
+                << "// The words it matches, for completion; ends with nullptr\n"
+                << "extern const char *const " << func_name << "_words[];\n"
                 << "#endif" << std::endl;
 }
 
@@ -92,6 +136,21 @@ void write_source(const std::string &path, const char *func_name,
              << "int curr_col = col;\n"
              << "Color curr_color;\n"
              << "const int window_width = window.width();\n";
-    print_tree(tree, src_file);
-    src_file << "}" << std::endl;
+    print_tree(tree, src_file, ScreenReader);
+    src_file << "}\n\n"
+             << ReturnType << func_name << "_text" << TextArgs << '\n'
+             << "{\n"
+             << "const char *curr = first;\n"
+             << "Color curr_color;\n";
+    print_tree(tree, src_file, TextReader);
+    src_file << "}\n\n";
+
+    std::string match;
+    std::set<std::string> words;
+    collect_words(tree, match, words);
+    src_file << "const char *const " << func_name << "_words[] = {\n";
+    for(const auto &word : words)
+        src_file << '"' << word << "\",\n";
+    src_file << "nullptr\n"
+             << "};" << std::endl;
 }
@@ -13,6 +13,8 @@ public:
     const char letter;
     const std::string color;
     std::set<std::unique_ptr<Tree>> children;
+    // Whether a match ends here (longer ones may go on past it)
+    bool ends_match = false;
 
     Tree() : letter{} {}
     explicit Tree(char l, std::string_view c) : letter(l), color(c) {}
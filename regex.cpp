@@ -0,0 +1,559 @@
+#include "regex.h"
+#include "search.h"
+#include <cctype>
+
+// Deepest nesting of groups allowed, so parsing can't overflow the stack
+constexpr int MaxDepth = 100;
+// Largest count allowed in {m,n}
+constexpr int MaxRepeat = 1000;
+// Most NFA states a pattern may compile to
+constexpr std::size_t MaxNfaStates = 100000;
+// Most DFA states cached at once; the cache starts over when it fills up
+constexpr std::size_t MaxDfaStates = 2000;
+
+Regex::Regex(std::string_view pattern)
+{
+    auto rest = pattern;
+    m_root = parse_alternation(rest, 0);
+    if(m_root != -1 && !rest.empty())
+        fail("Unmatched )");
+    if(!valid())
+        return;
+    m_required = required_literal(m_root);
+
+    // Both NFAs end in a Match state at index 0
+    m_forward_nfa.push_back({NfaState::Kind::Match, {}, {}});
+    const int forward_start = compile(m_root, 0, false, m_forward_nfa);
+    m_reverse_nfa.push_back({NfaState::Kind::Match, {}, {}});
+    const int reverse_start = compile(m_root, 0, true, m_reverse_nfa);
+    if(m_forward_nfa.size() + m_reverse_nfa.size() > MaxNfaStates) {
+        fail("Pattern is too large");
+        return;
+    }
+    m_anchored.init(&m_forward_nfa, forward_start, false);
+    m_starts_finder.init(&m_reverse_nfa, reverse_start, true);
+}
+
+int Regex::fail(const char *message)
+{
+    if(m_error.empty())
+        m_error = message;
+    return -1;
+}
+
+int Regex::add_node(Node node)
+{
+    m_nodes.push_back(std::move(node));
+    return m_nodes.size() - 1;
+}
+
+int Regex::parse_alternation(std::string_view &pattern, int depth)
+{
+    if(depth > MaxDepth)
+        return fail("Too many nested groups");
+    Node node{Node::Kind::Alternate, {}, {}};
+    while(true) {
+        const int branch = parse_concatenation(pattern, depth);
+        if(branch == -1)
+            return -1;
+        node.children.push_back(branch);
+        if(pattern.empty() || pattern[0] != '|')
+            break;
+        pattern.remove_prefix(1);
+    }
+    if(node.children.size() == 1)
+        return node.children[0];
+    return add_node(std::move(node));
+}
+
+int Regex::parse_concatenation(std::string_view &pattern, int depth)
+{
+    Node node{Node::Kind::Concat, {}, {}};
+    while(!pattern.empty() && pattern[0] != '|' && pattern[0] != ')') {
+        const int part = parse_repetition(pattern, depth);
+        if(part == -1)
+            return -1;
+        node.children.push_back(part);
+    }
+    if(node.children.empty())
+        return add_node({Node::Kind::Empty, {}, {}});
+    if(node.children.size() == 1)
+        return node.children[0];
+    return add_node(std::move(node));
+}
+
+/**Reads a decimal number of at most MaxRepeat; returns -1 if there isn't one*/
+static int parse_count(std::string_view &pattern)
+{
+    if(pattern.empty() || !std::isdigit(static_cast<unsigned char>(pattern[0])))
+        return -1;
+    int count = 0;
+    while(!pattern.empty() && std::isdigit(static_cast<unsigned char>(pattern[0]))) {
+        count = std::min(count * 10 + (pattern[0] - '0'), MaxRepeat + 1);
+        pattern.remove_prefix(1);
+    }
+    return count;
+}
+
+int Regex::parse_repetition(std::string_view &pattern, int depth)
+{
+    int atom = parse_atom(pattern, depth);
+    while(atom != -1 && !pattern.empty()) {
+        int min, max;
+        if(pattern[0] == '*') {
+            min = 0, max = -1;
+            pattern.remove_prefix(1);
+        } else if(pattern[0] == '+') {
+            min = 1, max = -1;
+            pattern.remove_prefix(1);
+        } else if(pattern[0] == '?') {
+            min = 0, max = 1;
+            pattern.remove_prefix(1);
+        } else if(pattern[0] == '{') {
+            // {m}, {m,}, or {m,n}; anything else is a literal '{'
+            auto rest = pattern.substr(1);
+            min = max = parse_count(rest);
+            if(min == -1)
+                break;
+            if(!rest.empty() && rest[0] == ',') {
+                rest.remove_prefix(1);
+                max = parse_count(rest);
+            }
+            if(rest.empty() || rest[0] != '}')
+                break;
+            if(min > MaxRepeat || max > MaxRepeat)
+                return fail("Repeat count is too large");
+            if(max != -1 && max < min)
+                return fail("Bad repeat range");
+            pattern = rest.substr(1);
+        } else {
+            break;
+        }
+        const auto kind = m_nodes[atom].kind;
+        if(kind == Node::Kind::LineStart || kind == Node::Kind::LineEnd)
+            return fail("Nothing to repeat");
+        Node node{Node::Kind::Repeat, {}, {atom}};
+        node.min = min;
+        node.max = max;
+        atom = add_node(std::move(node));
+    }
+    return atom;
+}
+
+int Regex::parse_atom(std::string_view &pattern, int depth)
+{
+    const char letter = pattern[0];
+    pattern.remove_prefix(1);
+    Node node{Node::Kind::Bytes, {}, {}};
+    switch(letter) {
+    case '(': {
+        const int group = parse_alternation(pattern, depth + 1);
+        if(group == -1)
+            return -1;
+        if(pattern.empty() || pattern[0] != ')')
+            return fail("Unmatched (");
+        pattern.remove_prefix(1);
+        return group;
+    }
+    case '[':
+        return parse_class(pattern);
+    case '.':
+        node.bytes.set();
+        break;
+    case '^':
+        node.kind = Node::Kind::LineStart;
+        break;
+    case '$':
+        node.kind = Node::Kind::LineEnd;
+        break;
+    case '\\':
+        if(!parse_escape(pattern, node.bytes))
+            return -1;
+        break;
+    case '*':
+    case '+':
+    case '?':
+        return fail("Nothing to repeat");
+    default:
+        node.bytes.set(static_cast<unsigned char>(letter));
+    }
+    return add_node(std::move(node));
+}
+
+/**Reads what follows a backslash, adding the bytes it stands for to bytes*/
+bool Regex::parse_escape(std::string_view &pattern, std::bitset<256> &bytes)
+{
+    if(pattern.empty())
+        return fail("Pattern ends with \\") != -1;
+    const char letter = pattern[0];
+    pattern.remove_prefix(1);
+    std::bitset<256> escaped;
+    switch(letter) {
+    case 'd':
+    case 'D':
+        for(int c = '0'; c <= '9'; ++c)
+            escaped.set(c);
+        break;
+    case 'w':
+    case 'W':
+        for(int c = 0; c < 128; ++c) {
+            if(std::isalnum(c) || c == '_')
+                escaped.set(c);
+        }
+        break;
+    case 's':
+    case 'S':
+        for(const char c : {' ', '\t', '\r', '\v', '\f', '\n'})
+            escaped.set(c);
+        break;
+    case 'n':
+        escaped.set('\n');
+        break;
+    case 't':
+        escaped.set('\t');
+        break;
+    default:
+        escaped.set(static_cast<unsigned char>(letter));
+    }
+    // \D, \W, and \S are the opposites of \d, \w, and \s
+    if(letter == 'D' || letter == 'W' || letter == 'S')
+        escaped.flip();
+    bytes |= escaped;
+    return true;
+}
+
+int Regex::parse_class(std::string_view &pattern)
+{
+    Node node{Node::Kind::Bytes, {}, {}};
+    const bool negated = !pattern.empty() && pattern[0] == '^';
+    if(negated)
+        pattern.remove_prefix(1);
+    // A ']' right at the start is part of the class
+    bool first = true;
+    while(!pattern.empty() && (pattern[0] != ']' || first)) {
+        first = false;
+        if(pattern[0] == '\\') {
+            pattern.remove_prefix(1);
+            if(!parse_escape(pattern, node.bytes))
+                return -1;
+            continue;
+        }
+        const auto low = static_cast<unsigned char>(pattern[0]);
+        pattern.remove_prefix(1);
+        if(pattern.size() >= 2 && pattern[0] == '-' && pattern[1] != ']') {
+            const auto high = static_cast<unsigned char>(pattern[1]);
+            pattern.remove_prefix(2);
+            if(high < low)
+                return fail("Bad character range");
+            for(int c = low; c <= high; ++c)
+                node.bytes.set(c);
+        } else {
+            node.bytes.set(low);
+        }
+    }
+    if(pattern.empty())
+        return fail("Unmatched [");
+    pattern.remove_prefix(1);
+    if(negated)
+        node.bytes.flip();
+    return add_node(std::move(node));
+}
+
+/**If node only ever matches one string, puts it in text and returns true*/
+bool Regex::exact_literal(int node, std::string &text) const
+{
+    const auto &curr = m_nodes[node];
+    switch(curr.kind) {
+    case Node::Kind::Empty:
+        return true;
+    case Node::Kind::Bytes:
+        if(curr.bytes.count() != 1)
+            return false;
+        for(int c = 0; c < 256; ++c) {
+            if(curr.bytes.test(c))
+                text.push_back(c);
+        }
+        return true;
+    case Node::Kind::Concat:
+        for(const auto child : curr.children) {
+            if(!exact_literal(child, text))
+                return false;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::string Regex::required_literal(int node) const
+{
+    const auto &curr = m_nodes[node];
+    std::string best;
+    if(exact_literal(node, best))
+        return best;
+    best.clear();
+    switch(curr.kind) {
+    case Node::Kind::Concat: {
+        // Runs of exact children must appear together; otherwise go with
+        // whatever the children each require
+        std::string run;
+        for(const auto child : curr.children) {
+            std::string text;
+            if(exact_literal(child, text)) {
+                run += text;
+            } else {
+                run.clear();
+                text = required_literal(child);
+            }
+            if(run.size() > best.size())
+                best = run;
+            if(text.size() > best.size())
+                best = text;
+        }
+        return best;
+    }
+    case Node::Kind::Repeat:
+        if(curr.min > 0)
+            return required_literal(curr.children[0]);
+        return best;
+    default:
+        return best;
+    }
+}
+
+/**Adds NFA states matching node then continuing to state next (with the
+   node's text reversed if reversed is set); returns the first of them*/
+int Regex::compile(int node, int next, bool reversed, std::vector<NfaState> &nfa)
+{
+    if(nfa.size() > MaxNfaStates)
+        return next;
+    const auto &curr = m_nodes[node];
+    const auto add = [&nfa](NfaState state) {
+        nfa.push_back(std::move(state));
+        return static_cast<int>(nfa.size() - 1);
+    };
+    switch(curr.kind) {
+    case Node::Kind::Empty:
+        return next;
+    case Node::Kind::Bytes:
+        return add({NfaState::Kind::Bytes, curr.bytes, {next}});
+    case Node::Kind::LineStart:
+        return add({reversed ? NfaState::Kind::LineEnd : NfaState::Kind::LineStart,
+                    {}, {next}});
+    case Node::Kind::LineEnd:
+        return add({reversed ? NfaState::Kind::LineStart : NfaState::Kind::LineEnd,
+                    {}, {next}});
+    case Node::Kind::Concat:
+        // Built back to front, since each part needs to know what follows it
+        if(reversed) {
+            for(const auto child : curr.children)
+                next = compile(child, next, reversed, nfa);
+        } else {
+            for(auto child = curr.children.rbegin(); child != curr.children.rend(); ++child)
+                next = compile(*child, next, reversed, nfa);
+        }
+        return next;
+    case Node::Kind::Alternate: {
+        NfaState split{NfaState::Kind::Split, {}, {}};
+        for(const auto child : curr.children)
+            split.out.push_back(compile(child, next, reversed, nfa));
+        return add(std::move(split));
+    }
+    case Node::Kind::Repeat: {
+        const int child = curr.children[0];
+        int tail = next;
+        if(curr.max == -1) {
+            // Loop back to a split that either goes around again or leaves
+            const int loop = add({NfaState::Kind::Split, {}, {}});
+            const int body = compile(child, loop, reversed, nfa);
+            nfa[loop].out = {body, next};
+            tail = loop;
+        } else {
+            // Each optional copy can skip straight to the end
+            for(int i = curr.min; i < curr.max; ++i) {
+                const int body = compile(child, tail, reversed, nfa);
+                tail = add({NfaState::Kind::Split, {}, {body, next}});
+            }
+        }
+        for(int i = 0; i < curr.min; ++i)
+            tail = compile(child, tail, reversed, nfa);
+        return tail;
+    }
+    }
+    return next;
+}
+
+void Regex::LazyDfa::init(const std::vector<NfaState> *nfa, int start, bool unanchored)
+{
+    m_nfa = nfa;
+    m_nfa_start = start;
+    m_unanchored = unanchored;
+    m_visited.assign(nfa->size(), 0);
+    m_mid_line_start = {start};
+    closure(m_mid_line_start, false, false);
+    reset();
+}
+
+void Regex::LazyDfa::reset()
+{
+    m_nfa_states.clear();
+    m_accepts.clear();
+    m_next.clear();
+    m_ids.clear();
+    std::vector<int> dead;
+    intern(dead);
+    m_start_ids[0] = m_start_ids[1] = -1;
+}
+
+/**Adds every state reachable from the given ones without reading a byte,
+   keeping only those that read a byte, match, or wait on $ (unless
+   at_line_end, when $ is followed). The result is sorted*/
+void Regex::LazyDfa::closure(std::vector<int> &states, bool at_line_start,
+                             bool at_line_end)
+{
+    if(++m_visit_mark == 0) {
+        std::fill(m_visited.begin(), m_visited.end(), 0);
+        m_visit_mark = 1;
+    }
+    std::vector<int> to_visit;
+    to_visit.swap(states);
+    while(!to_visit.empty()) {
+        const int id = to_visit.back();
+        to_visit.pop_back();
+        if(m_visited[id] == m_visit_mark)
+            continue;
+        m_visited[id] = m_visit_mark;
+        const auto &state = (*m_nfa)[id];
+        switch(state.kind) {
+        case NfaState::Kind::Split:
+            to_visit.insert(to_visit.end(), state.out.begin(), state.out.end());
+            break;
+        case NfaState::Kind::LineStart:
+            if(at_line_start)
+                to_visit.push_back(state.out[0]);
+            break;
+        case NfaState::Kind::LineEnd:
+            if(at_line_end)
+                to_visit.push_back(state.out[0]);
+            else
+                states.push_back(id);
+            break;
+        default:
+            states.push_back(id);
+        }
+    }
+    std::sort(states.begin(), states.end());
+}
+
+/**Id of the DFA state for a set of NFA states, adding it if it's new*/
+int Regex::LazyDfa::intern(std::vector<int> &nfa_states)
+{
+    const auto found = m_ids.find(nfa_states);
+    if(found != m_ids.end())
+        return found->second;
+    unsigned char accepts = 0;
+    if(std::binary_search(nfa_states.begin(), nfa_states.end(), 0))
+        accepts |= Accepts;
+    // Would following any $ lead to a match?
+    std::vector<int> at_end(nfa_states);
+    closure(at_end, false, true);
+    if(std::binary_search(at_end.begin(), at_end.end(), 0))
+        accepts |= AcceptsAtEnd;
+    m_accepts.push_back(accepts);
+    m_next.resize(m_next.size() + 256, -1);
+    m_nfa_states.push_back(nfa_states);
+    const int id = m_nfa_states.size() - 1;
+    m_ids.emplace(std::move(nfa_states), id);
+    return id;
+}
+
+int Regex::LazyDfa::start(bool at_line_start)
+{
+    int &id = m_start_ids[at_line_start];
+    if(id == -1) {
+        std::vector<int> states{m_nfa_start};
+        closure(states, at_line_start, false);
+        id = intern(states);
+    }
+    return id;
+}
+
+/**Works out (and caches) the state after a byte not read in this state before*/
+int Regex::LazyDfa::add_step(int state, unsigned char byte)
+{
+    std::vector<int> next_states;
+    for(const auto id : m_nfa_states[state]) {
+        const auto &nfa_state = (*m_nfa)[id];
+        if(nfa_state.kind == NfaState::Kind::Bytes && nfa_state.bytes.test(byte))
+            next_states.push_back(nfa_state.out[0]);
+    }
+    if(m_unanchored)
+        next_states.insert(next_states.end(), m_mid_line_start.begin(),
+                           m_mid_line_start.end());
+    closure(next_states, false, false);
+    if(m_nfa_states.size() >= MaxDfaStates) {
+        // Start the cache over; the caller only holds on to the new state
+        reset();
+        return intern(next_states);
+    }
+    const int next = intern(next_states);
+    m_next[state * 256 + byte] = next;
+    return next;
+}
+
+void Regex::find_starts(const char *text, std::size_t len, std::size_t from,
+                        std::size_t limit)
+{
+    m_starts.clear();
+    if(!m_required.empty()
+       && find_literal(text + from, limit - from, m_required) == nullptr)
+        return;
+    // A match can end at any position, and $ only where the line does
+    int state = m_starts_finder.start(limit == len);
+    std::size_t pos = limit;
+    while(true) {
+        // Has some match been read (backwards) from here?
+        if(pos == 0 ? m_starts_finder.accepts_at_end(state)
+                    : m_starts_finder.accepts(state))
+            m_starts.push_back(pos);
+        if(pos == from)
+            break;
+        --pos;
+        state = m_starts_finder.step(state, text[pos]);
+    }
+    std::reverse(m_starts.begin(), m_starts.end());
+}
+
+long Regex::longest_match(const char *text, std::size_t len, std::size_t start,
+                          std::size_t limit)
+{
+    int state = m_anchored.start(start == 0);
+    long end = -1;
+    for(std::size_t pos = start; ; ++pos) {
+        if(pos == len ? m_anchored.accepts_at_end(state) : m_anchored.accepts(state))
+            end = pos;
+        if(pos == limit)
+            break;
+        state = m_anchored.step(state, text[pos]);
+        if(state == LazyDfa::Dead)
+            break;
+    }
+    return end;
+}
+
+bool Regex::search(const char *text, std::size_t len, std::size_t from, std::size_t limit,
+                   std::size_t &start, std::size_t &end)
+{
+    if(!valid() || from > limit)
+        return false;
+    find_starts(text, len, from, limit);
+    for(const auto match_start : m_starts) {
+        const long match_end = longest_match(text, len, match_start, limit);
+        if(match_end >= 0) {
+            start = match_start;
+            end = match_end;
+            return true;
+        }
+    }
+    return false;
+}
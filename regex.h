@@ -0,0 +1,157 @@
+#ifndef REGEX_H
+#define REGEX_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <bitset>
+#include <map>
+#include <algorithm>
+
+/**A regular expression, matched one line at a time without backtracking.
+   Supports literals, '.', [classes] (including ranges and negation), the
+   escapes \d \w \s (and their negations \D \W \S), groups, '|', the
+   repetitions * + ? {m} {m,} {m,n}, and the anchors ^ and $. Matching is
+   byte-based and leftmost-longest.
+
+   The pattern is parsed into a tree, which is compiled into two NFAs (one
+   for the pattern, one for the pattern reversed). These are run as DFAs
+   whose states are built lazily as the text calls for them and cached, so
+   matching costs one table lookup per byte. A literal that every match must
+   contain is pulled out of the tree and searched for first, so lines that
+   can't match are skipped at the speed of a plain substring search*/
+class Regex {
+public:
+    explicit Regex(std::string_view pattern);
+    // The DFAs point into the NFAs
+    Regex(const Regex&) = delete;
+    Regex& operator=(const Regex&) = delete;
+
+    /**False if the pattern couldn't be parsed; error() says why*/
+    bool valid() const { return m_error.empty(); }
+    const std::string& error() const { return m_error; }
+
+    /**Finds the leftmost match starting in [from, limit] of a line of text
+       that is len bytes long; returns false if there is none. Matches are
+       cut off at limit, so only an empty one can start there, and $ only
+       matches at limit if it is the end of the line*/
+    bool search(const char *text, std::size_t len, std::size_t from, std::size_t limit,
+                std::size_t &start, std::size_t &end);
+    /**Calls on_match(start, end) for each non-overlapping match in a line*/
+    template<typename Callback>
+    void for_each_match(const char *text, std::size_t len, Callback on_match);
+private:
+    struct Node {
+        enum class Kind : char {
+            Empty, Bytes, Concat, Alternate, Repeat, LineStart, LineEnd
+        } kind;
+        std::bitset<256> bytes;
+        std::vector<int> children;
+        // For Repeat; max is -1 if unbounded
+        int min = 0, max = 0;
+    };
+
+    struct NfaState {
+        enum class Kind : char {
+            Match, Bytes, Split, LineStart, LineEnd
+        } kind;
+        std::bitset<256> bytes;
+        std::vector<int> out;
+    };
+
+    /**A set of NFA states run as a DFA, with states added as needed*/
+    class LazyDfa {
+    public:
+        // Id of the state with no NFA states left in it (no match possible)
+        static constexpr int Dead = 0;
+
+        void init(const std::vector<NfaState> *nfa, int start, bool unanchored);
+        /**The state to begin matching in*/
+        int start(bool at_line_start);
+        int step(int state, unsigned char byte)
+        {
+            const int next = m_next[state * 256 + byte];
+            return next != -1 ? next : add_step(state, byte);
+        }
+        bool accepts(int state) const { return m_accepts[state] & Accepts; }
+        bool accepts_at_end(int state) const { return m_accepts[state] & AcceptsAtEnd; }
+    private:
+        // Flags in m_accepts
+        static constexpr unsigned char Accepts = 1, AcceptsAtEnd = 2;
+        const std::vector<NfaState> *m_nfa = nullptr;
+        int m_nfa_start = 0;
+        // Whether a new match can begin at any position
+        bool m_unanchored = false;
+        // The NFA states making up each DFA state
+        std::vector<std::vector<int>> m_nfa_states;
+        std::vector<unsigned char> m_accepts;
+        // Next state for each state and byte (at state * 256 + byte), or -1
+        // if not worked out yet
+        std::vector<int> m_next;
+        std::map<std::vector<int>, int> m_ids;
+        int m_start_ids[2];
+        std::vector<int> m_mid_line_start;
+        std::vector<unsigned int> m_visited;
+        unsigned int m_visit_mark = 0;
+
+        int add_step(int state, unsigned char byte);
+        void reset();
+        void closure(std::vector<int> &states, bool at_line_start, bool at_line_end);
+        int intern(std::vector<int> &nfa_states);
+    };
+
+    std::string m_error;
+    std::vector<Node> m_nodes;
+    int m_root = -1;
+    // Substring that every match contains
+    std::string m_required;
+    std::vector<NfaState> m_forward_nfa;
+    std::vector<NfaState> m_reverse_nfa;
+    // Tries a match from one start position; runs the pattern forwards
+    LazyDfa m_anchored;
+    // Finds every position a match starts at; runs the reversed pattern
+    // backwards, starting a new match at each position
+    LazyDfa m_starts_finder;
+    std::vector<std::size_t> m_starts;
+
+    // Parsing; each returns the index of the new node, or -1 on error
+    int parse_alternation(std::string_view &pattern, int depth);
+    int parse_concatenation(std::string_view &pattern, int depth);
+    int parse_repetition(std::string_view &pattern, int depth);
+    int parse_atom(std::string_view &pattern, int depth);
+    int parse_class(std::string_view &pattern);
+    bool parse_escape(std::string_view &pattern, std::bitset<256> &bytes);
+    int add_node(Node node);
+    int fail(const char *message);
+
+    bool exact_literal(int node, std::string &text) const;
+    std::string required_literal(int node) const;
+    int compile(int node, int next, bool reversed, std::vector<NfaState> &nfa);
+
+    /**Positions in [from, limit] where a match starts, into m_starts; one
+       at limit can only be empty*/
+    void find_starts(const char *text, std::size_t len, std::size_t from,
+                     std::size_t limit);
+    /**End of the longest match beginning at start, or -1 if none*/
+    long longest_match(const char *text, std::size_t len, std::size_t start,
+                       std::size_t limit);
+};
+
+template<typename Callback>
+void Regex::for_each_match(const char *text, std::size_t len, Callback on_match)
+{
+    if(!valid())
+        return;
+    find_starts(text, len, 0, len);
+    // Matches ending past a start can't begin there (no overlaps)
+    std::size_t next_free = 0;
+    for(const auto start : m_starts) {
+        if(start < next_free)
+            continue;
+        const auto end = longest_match(text, len, start, len);
+        if(end < 0)
+            continue;
+        on_match(start, static_cast<std::size_t>(end));
+        next_free = std::max<std::size_t>(end, start + 1);
+    }
+}
+#endif
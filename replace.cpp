@@ -0,0 +1,237 @@
+#include "replace.h"
+#include "search.h"
+#include "columns.h"
+#include <thread>
+#include <algorithm>
+#include <iterator>
+
+// Fewest rows worth handing to a thread of their own
+constexpr std::size_t MinRowsPerThread = 4096;
+
+/**How many threads to share out count rows among: one per core, or fewer
+   if there aren't many rows*/
+static std::size_t chunk_count(std::size_t count)
+{
+    const std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    return std::max<std::size_t>(1, std::min(cores, count / MinRowsPerThread));
+}
+
+/**Splits [0, count) into the given number of about equal ranges and calls
+   work(chunk, first, last) for each range on a thread of its own*/
+template<typename Work>
+static void in_parallel(std::size_t count, std::size_t chunks, Work work)
+{
+    std::vector<std::thread> workers;
+    for(std::size_t i = 1; i < chunks; ++i)
+        workers.emplace_back(work, i, count * i / chunks, count * (i + 1) / chunks);
+    // The calling thread takes the first chunk itself
+    work(0, 0, count / chunks);
+    for(auto &worker : workers)
+        worker.join();
+}
+
+MatchList find_all(const Buffer &buffer, std::string_view text)
+{
+    if(text.empty())
+        return {};
+    // Where each chunk of rows starts, so the chunks can be searched at once
+    const std::size_t row_count = buffer.size();
+    const auto chunks = chunk_count(row_count);
+    std::vector<Buffer::const_iterator> chunk_starts;
+    auto row_it = buffer.begin();
+    for(std::size_t i = 0, row = 0; i < chunks; ++i) {
+        const std::size_t first = row_count * i / chunks;
+        std::advance(row_it, first - row);
+        row = first;
+        chunk_starts.push_back(row_it);
+    }
+
+    std::vector<MatchList> chunk_matches(chunks);
+    in_parallel(row_count, chunks, [&](std::size_t chunk, std::size_t first,
+                                       std::size_t last) {
+        auto &matches = chunk_matches[chunk];
+        auto row_it = chunk_starts[chunk];
+        for(auto row = first; row < last; ++row, ++row_it) {
+            const char *begin = row_it->data();
+            const char *end = begin + row_it->size();
+            const char *found = begin;
+            while((found = find_literal(found, end - found, text)) != nullptr) {
+                if(matches.empty() || matches.back().row != row)
+                    matches.push_back({row, {}});
+                matches.back().cols.push_back(found - begin);
+                found += text.size();
+            }
+        }
+    });
+
+    MatchList all = std::move(chunk_matches[0]);
+    for(std::size_t i = 1; i < chunks; ++i)
+        std::move(chunk_matches[i].begin(), chunk_matches[i].end(), std::back_inserter(all));
+    return all;
+}
+
+/**Rebuilds each row with places in it once, with build(i, old_row, text)
+   making the new text of the row for places[i]; the rows are shared out
+   among all cores, then handed to the buffer in order*/
+template<typename Build>
+static void rebuild_rows(Buffer &buffer, const MatchList &places, Build build)
+{
+    // Find the rows to change in a single walk down the list
+    std::vector<Buffer::iterator> rows;
+    rows.reserve(places.size());
+    auto row_it = buffer.begin();
+    std::size_t row = 0;
+    for(const auto &row_places : places) {
+        std::advance(row_it, row_places.row - row);
+        row = row_places.row;
+        rows.push_back(row_it);
+    }
+
+    // The new rows are built in parallel, then handed to the buffer in order
+    std::vector<RowText> texts(places.size());
+    const auto chunks = chunk_count(places.size());
+    in_parallel(places.size(), chunks, [&](std::size_t, std::size_t first,
+                                           std::size_t last) {
+        for(auto i = first; i < last; ++i)
+            build(i, *rows[i], texts[i]);
+    });
+    for(std::size_t i = 0; i < places.size(); ++i)
+        buffer.assign(rows[i], places[i].row, std::move(texts[i]));
+}
+
+void replace_at(Buffer &buffer, const MatchList &matches, std::size_t len,
+                std::string_view replacement)
+{
+    rebuild_rows(buffer, matches, [&](std::size_t i, const BufferRow &old_row,
+                                      RowText &text) {
+        const auto &cols = matches[i].cols;
+        char *out = text.open(0, old_row.size() - cols.size() * len
+                                 + cols.size() * replacement.size());
+        std::size_t copied = 0;
+        for(const auto col : cols) {
+            out = std::copy(old_row.data() + copied, old_row.data() + col, out);
+            out = std::copy(replacement.begin(), replacement.end(), out);
+            copied = col + len;
+        }
+        std::copy(old_row.data() + copied, old_row.data() + old_row.size(), out);
+    });
+}
+
+MatchList erase_before(Buffer &buffer, const MatchList &places, std::string &erased_text)
+{
+    MatchList moved = places;
+    // Rows where the only place is at the start are left alone
+    MatchList changing;
+    std::vector<std::size_t> changing_index;
+    for(std::size_t i = 0; i < places.size(); ++i) {
+        if(places[i].cols.back() > 0) {
+            changing.push_back(places[i]);
+            changing_index.push_back(i);
+        }
+    }
+    // What is erased from each row, gathered up once they are all done
+    std::vector<std::string> row_erased(changing.size());
+    rebuild_rows(buffer, changing, [&](std::size_t i, const BufferRow &old_row,
+                                       RowText &text) {
+        const auto &cols = changing[i].cols;
+        auto &new_cols = moved[changing_index[i]].cols;
+        const char *old_text = old_row.data();
+        // Where the character before each place starts
+        std::vector<std::size_t> starts(cols.size());
+        std::size_t erased = 0, copied = 0;
+        for(std::size_t j = 0; j < cols.size(); ++j) {
+            starts[j] = cols[j] == 0 ? 0
+                : std::max(copied, prev_char(old_text, cols[j]));
+            erased += cols[j] - starts[j];
+            copied = cols[j];
+        }
+        char *out = text.open(0, old_row.size() - erased);
+        erased = copied = 0;
+        for(std::size_t j = 0; j < cols.size(); ++j) {
+            out = std::copy(old_text + copied, old_text + starts[j], out);
+            row_erased[i].append(old_text + starts[j], old_text + cols[j]);
+            copied = cols[j];
+            erased += cols[j] - starts[j];
+            new_cols[j] = cols[j] - erased;
+        }
+        std::copy(old_text + copied, old_text + old_row.size(), out);
+    });
+    for(const auto &text : row_erased)
+        erased_text += text;
+    return moved;
+}
+
+void unerase_before(Buffer &buffer, const MatchList &places, const MatchList &moved,
+                    std::string_view erased)
+{
+    // The rows erase_before() changed, with where their bytes start in erased
+    MatchList changing;
+    std::vector<std::size_t> changing_index;
+    std::vector<std::size_t> starts;
+    std::size_t start = 0;
+    for(std::size_t i = 0; i < places.size(); ++i) {
+        if(places[i].cols.back() > 0) {
+            changing.push_back(moved[i]);
+            changing_index.push_back(i);
+            starts.push_back(start);
+            start += places[i].cols.back() - moved[i].cols.back();
+        }
+    }
+    rebuild_rows(buffer, changing, [&](std::size_t i, const BufferRow &old_row,
+                                       RowText &text) {
+        const auto &cols = places[changing_index[i]].cols;
+        const auto &new_cols = changing[i].cols;
+        const char *row_erased = erased.data() + starts[i];
+        const std::size_t len = cols.back() - new_cols.back();
+        char *out = text.open(0, old_row.size() + len);
+        // Each place erased the bytes between it and the one before
+        std::size_t copied = 0, put_back = 0;
+        for(std::size_t j = 0; j < cols.size(); ++j) {
+            out = std::copy(old_row.data() + copied, old_row.data() + new_cols[j], out);
+            copied = new_cols[j];
+            const std::size_t upto = cols[j] - new_cols[j];
+            out = std::copy(row_erased + put_back, row_erased + upto, out);
+            put_back = upto;
+        }
+        std::copy(old_row.data() + copied, old_row.data() + old_row.size(), out);
+    });
+}
+
+MatchList shift_matches(MatchList matches, std::size_t len, std::size_t new_len)
+{
+    for(auto &row_matches : matches) {
+        // Each earlier replacement in the row moves the rest along
+        for(std::size_t i = 0; i < row_matches.cols.size(); ++i)
+            row_matches.cols[i] = row_matches.cols[i] - i * len + i * new_len;
+    }
+    return matches;
+}
+
+void add_place(MatchList &places, std::size_t row, std::size_t col)
+{
+    auto row_places = std::lower_bound(
+        places.begin(), places.end(), row,
+        [](const RowMatches &m, std::size_t row) { return m.row < row; });
+    if(row_places == places.end() || row_places->row != row)
+        row_places = places.insert(row_places, {row, {}});
+    auto &cols = row_places->cols;
+    const auto at = std::lower_bound(cols.begin(), cols.end(), col);
+    if(at == cols.end() || *at != col)
+        cols.insert(at, col);
+}
+
+void unique_places(MatchList &places)
+{
+    for(auto &row_places : places) {
+        auto &cols = row_places.cols;
+        cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+    }
+}
+
+std::size_t count_matches(const MatchList &matches)
+{
+    std::size_t count = 0;
+    for(const auto &row_matches : matches)
+        count += row_matches.cols.size();
+    return count;
+}
@@ -0,0 +1,50 @@
+#ifndef REPLACE_H
+#define REPLACE_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include "buffer.h"
+
+/**Where some text occurs within one row of the buffer*/
+struct RowMatches {
+    std::size_t row;
+    // Byte offsets of each occurrence, in order and not overlapping
+    std::vector<std::size_t> cols;
+};
+// Sorted by row; rows without any occurrences are left out
+using MatchList = std::vector<RowMatches>;
+
+/**Every (non-overlapping) occurrence of text in the buffer. Rows are split
+   into one chunk per core, which are searched in parallel*/
+MatchList find_all(const Buffer &buffer, std::string_view text);
+
+/**Replaces the len bytes at each of matches with replacement. Each row that
+   changes is rebuilt once, with the rows shared out among all cores*/
+void replace_at(Buffer &buffer, const MatchList &matches, std::size_t len,
+                std::string_view replacement);
+
+/**Erases the character (all of its bytes) before each of places that isn't
+   at the start of its row, rebuilding each row once as replace_at() does;
+   the bytes erased are added to erased, in order. Returns where each place
+   ends up, in the same order (places that run into each other end up in
+   the same place)*/
+MatchList erase_before(Buffer &buffer, const MatchList &places, std::string &erased);
+
+/**Undoes erase_before(places), which returned moved, by putting back the
+   bytes it erased before each of moved*/
+void unerase_before(Buffer &buffer, const MatchList &places, const MatchList &moved,
+                    std::string_view erased);
+
+/**Where the replacements are once replace_at(matches, len, replacement) is
+   done, i.e. what to replace to undo it*/
+MatchList shift_matches(MatchList matches, std::size_t len, std::size_t new_len);
+
+/**Adds a place to a list of them, unless it is already there*/
+void add_place(MatchList &places, std::size_t row, std::size_t col);
+
+/**Drops any place in a list of them that is the same as the one before*/
+void unique_places(MatchList &places);
+
+/**Total number of occurrences in matches*/
+std::size_t count_matches(const MatchList &matches);
+#endif
@@ -0,0 +1,77 @@
+#include "row-text.h"
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+RowText::RowText(const char *first, const char *last)
+{
+    const std::size_t len = last - first;
+    if(len == 0)
+        return;
+    m_block = allocate(len);
+    m_block->size = len;
+    std::memcpy(m_block->bytes(), first, len);
+}
+
+RowText::~RowText()
+{
+    if(m_block != nullptr && m_block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_block->~Block();
+        ::operator delete(m_block);
+    }
+}
+
+RowText::Block* RowText::allocate(std::size_t capacity)
+{
+    if(capacity > std::numeric_limits<std::size_t>::max() - sizeof(Block))
+        throw std::bad_alloc();
+    void *memory = ::operator new(sizeof(Block) + capacity);
+    return new(memory) Block{{1}, 0, capacity};
+}
+
+void RowText::reserve(std::size_t capacity)
+{
+    if(m_block != nullptr && m_block->capacity >= capacity
+       // Acquire, so the last reader of a shared block is done with it
+       && m_block->refs.load(std::memory_order_acquire) == 1)
+        return;
+    const std::size_t old_size = size();
+    // Rows that are being typed into grow a little at a time
+    const std::size_t most = std::numeric_limits<std::size_t>::max() - sizeof(Block);
+    const std::size_t grown = old_size <= most - old_size / 2 ? old_size + old_size / 2 : most;
+    Block *block = allocate(std::max(capacity, grown));
+    block->size = old_size;
+    if(old_size > 0)
+        std::memcpy(block->bytes(), m_block->bytes(), old_size);
+    // Lets go of the old block, which is freed unless a snapshot has it
+    RowText old;
+    old.m_block = m_block;
+    m_block = block;
+}
+
+char* RowText::open(std::size_t pos, std::size_t len)
+{
+    if(len == 0)
+        return const_cast<char*>(data()) + pos;
+    const std::size_t old_size = size();
+    if(len > std::numeric_limits<std::size_t>::max() - old_size)
+        throw std::length_error("row too long");
+    reserve(old_size + len);
+    char *at = m_block->bytes() + pos;
+    std::memmove(at + len, at, old_size - pos);
+    m_block->size = old_size + len;
+    return at;
+}
+
+void RowText::close(std::size_t pos, std::size_t len)
+{
+    if(len == 0)
+        return;
+    const std::size_t old_size = size();
+    reserve(old_size);
+    char *at = m_block->bytes() + pos;
+    std::memmove(at, at + len, old_size - pos - len);
+    m_block->size = old_size - len;
+}
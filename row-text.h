@@ -0,0 +1,61 @@
+#ifndef ROW_TEXT_H
+#define ROW_TEXT_H
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <utility>
+
+/**The bytes of one row, kept in a single reference-counted block so that
+   buffer snapshots can share them instead of copying. Copying a RowText
+   only bumps the count; changing text that is shared gives this RowText
+   its own copy first, so everyone else keeps seeing the old bytes*/
+class RowText {
+public:
+    RowText() = default;
+    RowText(const char *first, const char *last);
+    RowText(const RowText &other) : m_block(other.m_block)
+    {
+        if(m_block != nullptr)
+            m_block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    RowText(RowText &&other) noexcept : m_block(std::exchange(other.m_block, nullptr)) {}
+    RowText& operator=(RowText other) noexcept
+    {
+        std::swap(m_block, other.m_block);
+        return *this;
+    }
+    ~RowText();
+
+    const char* data() const { return m_block != nullptr ? m_block->bytes() : Empty; }
+    std::size_t size() const { return m_block != nullptr ? m_block->size : 0; }
+
+    /**Makes room for len bytes at pos (moving the rest along), returning
+       where to write them*/
+    char* open(std::size_t pos, std::size_t len);
+    /**Removes the len bytes at pos*/
+    void close(std::size_t pos, std::size_t len);
+private:
+    // What data() points to for every empty row; one object (not a literal
+    // per use), so iterators into empty rows taken anywhere compare equal
+    static constexpr char Empty[1] = {};
+
+    // Sizes are full width, since nothing else stops a row being longer
+    // than 4 GiB
+    struct Block {
+        std::atomic<std::uint32_t> refs;
+        std::size_t size;
+        std::size_t capacity;
+
+        // The text follows the header in the same allocation
+        char* bytes() { return reinterpret_cast<char*>(this + 1); }
+        const char* bytes() const { return reinterpret_cast<const char*>(this + 1); }
+    };
+
+    Block *m_block = nullptr;
+
+    static Block* allocate(std::size_t capacity);
+    /**Makes sure the block belongs to this RowText alone and can hold at
+       least capacity bytes*/
+    void reserve(std::size_t capacity);
+};
+#endif
@@ -0,0 +1,309 @@
+#ifndef ROW_TREE_H
+#define ROW_TREE_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+/**A sequence of per-row summaries that also knows what any run of rows
+   sums up to, kept in an implicit treap: a binary tree in row order whose
+   shape is decided by random priorities, so that adding, removing,
+   changing or looking up a row are all O(log n) (expected). Summary must
+   form a monoid: Summary() sums up no rows, and a + b sums up a's rows
+   followed by b's (it needn't commute)*/
+template<typename Summary>
+class RowTree {
+public:
+    // Returned by find_next()/find_prev() when no row is found
+    static constexpr std::size_t NoRow = static_cast<std::size_t>(-1);
+
+    std::size_t size() const { return count(m_root); }
+    const Summary& row(std::size_t index) const;
+    /**Rows [0, index) summed up*/
+    Summary prefix(std::size_t index) const;
+
+    void insert(std::size_t index, const Summary &row);
+    void erase(std::size_t index);
+    void set(std::size_t index, const Summary &row);
+    /**Replaces every row, in O(n)*/
+    void assign(const std::vector<Summary> &rows);
+
+    /**The first row at or after from that could_hold(before, row) is true
+       of, where before sums up every row before it. Runs of rows are passed
+       to could_hold too (summed up) and skipped if it is false of them, so
+       it must be true of a run whenever it is true of a row in the run*/
+    template<typename CouldHold>
+    std::size_t find_next(std::size_t from, CouldHold could_hold) const
+    {
+        return find_next(m_root, 0, Summary(), from, could_hold);
+    }
+    /**The last row before until that could_hold() (as in find_next()) is
+       true of*/
+    template<typename CouldHold>
+    std::size_t find_prev(std::size_t until, CouldHold could_hold) const
+    {
+        return find_prev(m_root, 0, Summary(), until, could_hold);
+    }
+private:
+    static constexpr std::uint32_t None = static_cast<std::uint32_t>(-1);
+
+    struct Node {
+        std::uint32_t left;
+        std::uint32_t right;
+        std::uint32_t priority;
+        // Rows in the subtree
+        std::uint32_t count;
+        Summary own;
+        // The subtree's rows summed up
+        Summary all;
+    };
+
+    // Freed nodes are kept on a list for reuse, so nodes never move
+    std::vector<Node> m_nodes;
+    std::vector<std::uint32_t> m_free;
+    std::uint32_t m_root = None;
+    std::uint32_t m_random = 2463534242u;
+
+    std::size_t count(std::uint32_t node) const { return node == None ? 0 : m_nodes[node].count; }
+    std::uint32_t next_priority()
+    {
+        // xorshift32
+        m_random ^= m_random << 13;
+        m_random ^= m_random >> 17;
+        m_random ^= m_random << 5;
+        return m_random;
+    }
+    std::uint32_t make_node(const Summary &row);
+    /**Recomputes a node's count and sum from its children's*/
+    void update(std::uint32_t node);
+    /**Splits the subtree at node into its first index rows and the rest*/
+    void split(std::uint32_t node, std::size_t index, std::uint32_t &left, std::uint32_t &right);
+    std::uint32_t merge(std::uint32_t left, std::uint32_t right);
+
+    template<typename CouldHold>
+    std::size_t find_next(std::uint32_t node, std::size_t first, const Summary &before,
+                          std::size_t from, CouldHold &could_hold) const
+    {
+        if(node == None || first + m_nodes[node].count <= from
+           || !could_hold(before, m_nodes[node].all))
+            return NoRow;
+        const auto &n = m_nodes[node];
+        const auto found = find_next(n.left, first, before, from, could_hold);
+        if(found != NoRow)
+            return found;
+        const std::size_t index = first + count(n.left);
+        const Summary at = n.left == None ? before : before + m_nodes[n.left].all;
+        if(index >= from && could_hold(at, n.own))
+            return index;
+        return find_next(n.right, index + 1, at + n.own, from, could_hold);
+    }
+    template<typename CouldHold>
+    std::size_t find_prev(std::uint32_t node, std::size_t first, const Summary &before,
+                          std::size_t until, CouldHold &could_hold) const
+    {
+        if(node == None || first >= until || !could_hold(before, m_nodes[node].all))
+            return NoRow;
+        const auto &n = m_nodes[node];
+        const std::size_t index = first + count(n.left);
+        const Summary at = n.left == None ? before : before + m_nodes[n.left].all;
+        const auto found = find_prev(n.right, index + 1, at + n.own, until, could_hold);
+        if(found != NoRow)
+            return found;
+        if(index < until && could_hold(at, n.own))
+            return index;
+        return find_prev(n.left, first, before, until, could_hold);
+    }
+};
+
+template<typename Summary>
+const Summary& RowTree<Summary>::row(std::size_t index) const
+{
+    auto node = m_root;
+    while(true) {
+        const auto &n = m_nodes[node];
+        const auto left_count = count(n.left);
+        if(index == left_count)
+            return n.own;
+        if(index < left_count) {
+            node = n.left;
+        } else {
+            index -= left_count + 1;
+            node = n.right;
+        }
+    }
+}
+
+template<typename Summary>
+Summary RowTree<Summary>::prefix(std::size_t index) const
+{
+    Summary sum;
+    auto node = m_root;
+    while(node != None && index > 0) {
+        const auto &n = m_nodes[node];
+        const auto left_count = count(n.left);
+        if(index <= left_count) {
+            node = n.left;
+        } else {
+            if(n.left != None)
+                sum = sum + m_nodes[n.left].all;
+            sum = sum + n.own;
+            index -= left_count + 1;
+            node = n.right;
+        }
+    }
+    return sum;
+}
+
+template<typename Summary>
+std::uint32_t RowTree<Summary>::make_node(const Summary &row)
+{
+    const Node node{None, None, next_priority(), 1, row, row};
+    if(m_free.empty()) {
+        m_nodes.push_back(node);
+        return m_nodes.size() - 1;
+    }
+    const auto index = m_free.back();
+    m_free.pop_back();
+    m_nodes[index] = node;
+    return index;
+}
+
+template<typename Summary>
+void RowTree<Summary>::update(std::uint32_t node)
+{
+    auto &n = m_nodes[node];
+    n.count = 1 + count(n.left) + count(n.right);
+    n.all = n.own;
+    if(n.left != None)
+        n.all = m_nodes[n.left].all + n.all;
+    if(n.right != None)
+        n.all = n.all + m_nodes[n.right].all;
+}
+
+template<typename Summary>
+void RowTree<Summary>::split(std::uint32_t node, std::size_t index,
+                             std::uint32_t &left, std::uint32_t &right)
+{
+    if(node == None) {
+        left = right = None;
+        return;
+    }
+    auto &n = m_nodes[node];
+    const auto left_count = count(n.left);
+    if(index <= left_count) {
+        split(n.left, index, left, n.left);
+        right = node;
+    } else {
+        split(n.right, index - left_count - 1, n.right, right);
+        left = node;
+    }
+    update(node);
+}
+
+template<typename Summary>
+std::uint32_t RowTree<Summary>::merge(std::uint32_t left, std::uint32_t right)
+{
+    if(left == None)
+        return right;
+    if(right == None)
+        return left;
+    if(m_nodes[left].priority > m_nodes[right].priority) {
+        const auto merged = merge(m_nodes[left].right, right);
+        m_nodes[left].right = merged;
+        update(left);
+        return left;
+    }
+    const auto merged = merge(left, m_nodes[right].left);
+    m_nodes[right].left = merged;
+    update(right);
+    return right;
+}
+
+template<typename Summary>
+void RowTree<Summary>::insert(std::size_t index, const Summary &row)
+{
+    const auto node = make_node(row);
+    std::uint32_t left, right;
+    split(m_root, index, left, right);
+    m_root = merge(merge(left, node), right);
+}
+
+template<typename Summary>
+void RowTree<Summary>::erase(std::size_t index)
+{
+    std::uint32_t left, rest, node, right;
+    split(m_root, index, left, rest);
+    split(rest, 1, node, right);
+    m_free.push_back(node);
+    m_root = merge(left, right);
+}
+
+template<typename Summary>
+void RowTree<Summary>::set(std::size_t index, const Summary &row)
+{
+    // The nodes on the way down all need their sums redone afterwards
+    std::vector<std::uint32_t> path;
+    auto node = m_root;
+    while(true) {
+        path.push_back(node);
+        auto &n = m_nodes[node];
+        const auto left_count = count(n.left);
+        if(index == left_count) {
+            n.own = row;
+            break;
+        }
+        if(index < left_count) {
+            node = n.left;
+        } else {
+            index -= left_count + 1;
+            node = n.right;
+        }
+    }
+    for(auto step = path.rbegin(); step != path.rend(); ++step)
+        update(*step);
+}
+
+template<typename Summary>
+void RowTree<Summary>::assign(const std::vector<Summary> &rows)
+{
+    m_nodes.clear();
+    m_free.clear();
+    m_nodes.reserve(rows.size());
+    // Builds the treap left to right, keeping the path down its right edge:
+    // each new node takes the place of the lower-priority nodes at the end
+    // of the path, which become its left subtree
+    std::vector<std::uint32_t> right_edge;
+    for(const auto &row : rows) {
+        const auto node = make_node(row);
+        auto below = None;
+        while(!right_edge.empty()
+              && m_nodes[right_edge.back()].priority < m_nodes[node].priority) {
+            below = right_edge.back();
+            right_edge.pop_back();
+        }
+        m_nodes[node].left = below;
+        if(!right_edge.empty())
+            m_nodes[right_edge.back()].right = node;
+        right_edge.push_back(node);
+    }
+    m_root = right_edge.empty() ? None : right_edge.front();
+    // Work out the counts and sums from the bottom up (children always
+    // come before their parents in post-order)
+    std::vector<std::pair<std::uint32_t, bool>> pending;
+    if(m_root != None)
+        pending.push_back({m_root, false});
+    while(!pending.empty()) {
+        auto [node, children_done] = pending.back();
+        pending.pop_back();
+        if(children_done) {
+            update(node);
+            continue;
+        }
+        pending.push_back({node, true});
+        for(const auto child : {m_nodes[node].left, m_nodes[node].right}) {
+            if(child != None)
+                pending.push_back({child, false});
+        }
+    }
+}
+#endif
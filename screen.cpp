@@ -1,6 +1,12 @@
+// Use the wide-character (UTF-8 aware) parts of ncurses
+#define NCURSES_WIDECHAR 1
 #include <ncurses.h>
 #include "screen.h"
 #include <stdexcept>
+#include <algorithm>
+#include <clocale>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
 #if (NCURSES_VERSION_MAJOR >= 4 && NCURSES_VERSION_MINOR >= 1)
   //Should be virtually all NCurses versions
@@ -15,6 +21,8 @@
 
 Screen::Screen()
 {
+    // Take the character encoding (e.g. UTF-8) from the environment
+    setlocale(LC_ALL, "");
     // Character-at-a-time input, no echoing
     initscr();
     raw();
@@ -38,7 +46,7 @@ Screen::Screen()
 
 Screen::~Screen() { endwin(); }
 
-int Screen::width() const { return COLS; }
+int Screen::width() const { return std::max(0, COLS - m_gutter_width); }
 
 int Screen::height() const { return LINES; }
 
@@ -46,20 +54,31 @@ void Screen::clear() { ::erase(); }
 
 void Screen::present() { refresh(); }
 
-void Screen::present_resize()
+void Screen::resize()
 {
-    present();
-    // Ignore next event, which will be an ERR
-    get_input();
+    struct winsize size;
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0)
+        resizeterm(size.ws_row, size.ws_col);
 }
 
 int Screen::get(int x, int y) const
 {
-    return mvinch(y, x) & A_CHARTEXT;
+    // Read back the whole code point, so that the low byte of a non-ASCII
+    // character isn't mistaken for some ASCII character
+    cchar_t cell;
+    wchar_t text[CCHARW_MAX + 1];
+    attr_t attrs;
+    short pair;
+    if(mvin_wch(y, x + m_gutter_width, &cell) == ERR
+       || getcchar(&cell, text, &attrs, &pair, nullptr) == ERR)
+        return ' ';
+    return text[0];
 }
 
 int Screen::get_input() { return getch(); }
 
+void Screen::set_input_timeout(int ms) { timeout(ms); }
+
 /**Used to tell ncurses to select a color for all
    characters printed to screen for duration of scope*/
 class UsingColorPair {
@@ -78,19 +97,28 @@ public:
 void Screen::set(int x, int y, unsigned int ch, Color fg)
 {
     UsingColorPair curr_color(fg);
-    mvaddch(y, x, ch);
+    mvaddch(y, x + m_gutter_width, ch);
 }
 
-void Screen::set_color(int x, int y, Color fg)
+void Screen::set(int x, int y, const char *glyph, std::size_t len, Color fg)
 {
-    auto character = mvinch(y, x);
     UsingColorPair curr_color(fg);
-    if((character & A_COLOR) != curr_color.get()) {
-        mvaddch(y, x, character & A_CHARTEXT);
-    }
+    mvaddnstr(y, x + m_gutter_width, glyph, len);
+}
+
+void Screen::set_color(int x, int y, Color fg)
+{
+    // Recolor in place, leaving the (possibly multi-byte) character alone
+    mvchgat(y, x + m_gutter_width, 1, A_NORMAL, static_cast<short>(fg), nullptr);
 }
 
-void Screen::set_cursor(int x, int y) { move(y, x); }
+void Screen::set_reverse(int x, int y)
+{
+    const short pair = PAIR_NUMBER(mvinch(y, x + m_gutter_width) & A_COLOR);
+    mvchgat(y, x + m_gutter_width, 1, A_REVERSE, pair, nullptr);
+}
+
+void Screen::set_cursor(int x, int y) { move(y, x + m_gutter_width); }
 
 /**Writes the given text to the screen with optional coloring; text starts
    at the given coordinates, continuing from left to right; text wraps when
@@ -98,5 +126,11 @@ void Screen::set_cursor(int x, int y) { move(y, x); }
 void Screen::write(int x, int y, const char *text, Color fg)
 {
     UsingColorPair curr_color(fg);
-    mvaddstr(y, x, text);
+    mvaddstr(y, x + m_gutter_width, text);
+}
+
+void Screen::set_gutter(int y, const char *glyph, std::size_t len, Color fg)
+{
+    UsingColorPair curr_color(fg);
+    mvaddnstr(y, 0, glyph, len);
 }
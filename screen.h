@@ -1,5 +1,6 @@
 #ifndef SCREEN_CURSES_H
 #define SCREEN_CURSES_H
+#include <cstddef>
 enum class Color : char {
     Red = 1, Green = 2, Yellow = 3, Blue = 4,
     Magenta = 5, Cyan = 6, White = 7, Default = 8
@@ -14,6 +15,8 @@ constexpr int Key_Up = 0403;
 constexpr int Key_Down = 0402;
 constexpr int Key_Left = 0404;
 constexpr int Key_Right = 0405;
+constexpr int Key_PageDown = 0522;
+constexpr int Key_PageUp = 0523;
 constexpr int Key_Resize = 0632;
 constexpr int ErrCode = -1;
 /**Ex: ctrl('c') -> 'Ctrl-c'; works in switch statements*/
@@ -29,18 +32,34 @@ public:
     void clear();
     /**Sync the screen buffer with the terminal display*/
     void present();
-    /**Present after a resize (needed to catch error code after resize)*/
-    void present_resize();
+    /**Match the size of the terminal, after it has changed (this is done
+       automatically by get_input() unless an EventLoop is running)*/
+    void resize();
     /**Get a character from the current screen buffer*/
     int get(int x, int y) const;
     /**Get one character of user input (includes events like scrolling/ctrl keys)*/
     int get_input();
+    /**Make get_input() give up and return ErrCode after waiting ms
+       milliseconds for input (or never give up if ms is negative)*/
+    void set_input_timeout(int ms);
     void set(int x, int y, unsigned int ch, Color fg = Color::Default);
+    /**Put one character given as len bytes of UTF-8 at (x, y)*/
+    void set(int x, int y, const char *glyph, std::size_t len,
+             Color fg = Color::Default);
     void set_color(int x, int y, Color fg);
+    /**Show the character at (x, y) in reverse video, keeping its color*/
+    void set_reverse(int x, int y);
     /**Move the cursor to a position onscreen. Doesn't require a subsequent
        screen_present() call to show up onscreen.*/
     void set_cursor(int x, int y);
     /**Print text to screen starting from (x, y), left-to-right*/
     void write(int x, int y, const char *text, Color fg = Color::Default);
+    /**Keep the leftmost columns of the screen for set_gutter(); everything
+       else (width() included) is shifted right past them*/
+    void set_gutter_width(int width) { m_gutter_width = width; }
+    /**Put one character given as len bytes of UTF-8 in the gutter at row y*/
+    void set_gutter(int y, const char *glyph, std::size_t len, Color fg = Color::Default);
+private:
+    int m_gutter_width = 0;
 };
 #endif
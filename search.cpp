@@ -0,0 +1,217 @@
+#include "search.h"
+#include <cstring>
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+// Most match locations kept around for narrowing down a longer query
+constexpr std::size_t MaxKeptMatches = 1 << 20;
+
+const char* find_literal(const char *text, std::size_t len, std::string_view needle)
+{
+    const std::size_t needle_len = needle.size();
+    if(needle_len == 0)
+        return text;
+    if(needle_len > len)
+        return nullptr;
+    if(needle_len == 1)
+        return static_cast<const char*>(std::memchr(text, needle[0], len));
+
+    std::size_t i = 0;
+#ifdef __SSE2__
+    // Each bit of mask marks a spot where both the first and last bytes of
+    // the needle line up with the text
+    const __m128i first = _mm_set1_epi8(needle.front());
+    const __m128i last = _mm_set1_epi8(needle.back());
+    for(; i + needle_len - 1 + 16 <= len; i += 16) {
+        const __m128i block_first = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(text + i));
+        const __m128i block_last = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(text + i + needle_len - 1));
+        unsigned int mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                          _mm_cmpeq_epi8(last, block_last)));
+        while(mask != 0) {
+            const auto offset = i + __builtin_ctz(mask);
+            if(std::memcmp(text + offset + 1, needle.data() + 1, needle_len - 2) == 0)
+                return text + offset;
+            // Clear the lowest bit
+            mask &= mask - 1;
+        }
+    }
+#endif
+    // Whatever is left (or everything, without SSE2): find each occurrence
+    // of the first byte and check the rest
+    const std::size_t last_start = len - needle_len;
+    while(i <= last_start) {
+        auto *candidate = static_cast<const char*>(
+            std::memchr(text + i, needle[0], last_start - i + 1));
+        if(candidate == nullptr)
+            return nullptr;
+        if(std::memcmp(candidate + 1, needle.data() + 1, needle_len - 1) == 0)
+            return candidate;
+        i = candidate - text + 1;
+    }
+    return nullptr;
+}
+
+Query::Query(std::string text, bool is_regex)
+    : m_text(std::move(text))
+{
+    if(is_regex)
+        m_regex = std::make_unique<Regex>(m_text);
+}
+
+Query& Query::operator=(Query other)
+{
+    m_text = std::move(other.m_text);
+    m_regex = std::move(other.m_regex);
+    return *this;
+}
+
+bool Query::find(const char *text, std::size_t len, std::size_t from, std::size_t limit,
+                 std::size_t &start, std::size_t &end)
+{
+    if(from > limit || m_text.empty())
+        return false;
+    if(is_regex())
+        return m_regex->search(text, len, from, limit, start, end);
+    // Let matches that start before limit run past it
+    const auto search_end = std::min(len, limit + m_text.size() - 1);
+    const char *found = find_literal(text + from, search_end - from, m_text);
+    if(found == nullptr)
+        return false;
+    start = found - text;
+    end = start + m_text.size();
+    return true;
+}
+
+bool find_next(const Buffer &buffer, const Position &start, Query &query,
+               Position &match)
+{
+    if(query.empty() || !query.error().empty())
+        return false;
+    auto row_it = start.row_it;
+    auto row = start.row;
+    auto col = start.col;
+    bool wrapped = false;
+    while(true) {
+        std::size_t match_start, match_end;
+        if(query.find(row_it->data(), row_it->size(), col, row_it->size(),
+                      match_start, match_end)) {
+            match = {row_it, row, match_start};
+            return true;
+        }
+        // Stop after taking a second look at the start of the first row
+        if(wrapped && row_it == start.row_it)
+            return false;
+        col = 0;
+        if(++row_it == buffer.end()) {
+            row_it = buffer.begin();
+            row = 0;
+        } else {
+            ++row;
+        }
+        wrapped = wrapped || row_it == start.row_it;
+    }
+}
+
+bool locate_match(const Snapshot &rows, Query &query, std::size_t row, std::size_t col,
+                  const CancelToken &token, std::size_t &before, std::size_t &total)
+{
+    before = total = 0;
+    std::size_t current_row = 0;
+    return rows.for_each_row([&](const RowText &text) {
+        if(token.cancelled())
+            return false;
+        query.for_each_match(text.data(), text.size(), [&](std::size_t start, std::size_t) {
+            ++total;
+            if(current_row < row || (current_row == row && start < col))
+                ++before;
+        });
+        ++current_row;
+        return true;
+    });
+}
+
+void MatchCounter::start(const Query &query)
+{
+    stop();
+    std::vector<Match> candidates;
+    const auto &text = query.text();
+    const auto &old_text = m_query.text();
+    if(!m_query.empty() && m_matches_kept && !query.is_regex() && !m_query.is_regex()
+       && text.size() >= old_text.size() && text.compare(0, old_text.size(), old_text) == 0) {
+        // Every match of the new query is a match of the old one, so only
+        // those need checking in the rows already searched
+        candidates.swap(m_matches);
+    } else {
+        m_next_row = m_buffer.begin();
+    }
+    m_matches.clear();
+    m_matches_kept = true;
+    m_query = query;
+    m_count = 0;
+    if(m_query.empty() || !m_query.error().empty()) {
+        m_done = true;
+        return;
+    }
+    m_done = false;
+    m_candidates_checked = false;
+    m_jobs.submit(Priority::Search, m_counting,
+                  [this, candidates = std::move(candidates)]() mutable {
+                      count_matches(std::move(candidates));
+                      return nullptr;
+                  });
+}
+
+void MatchCounter::stop()
+{
+    m_counting.cancel();
+    m_counting = CancelToken();
+    if(!m_candidates_checked) {
+        // The job was stopped (or never started) before it got through them
+        m_matches_kept = false;
+        m_candidates_checked = true;
+    }
+}
+
+void MatchCounter::add_match(Buffer::const_iterator row_it, std::size_t col)
+{
+    ++m_count;
+    if(!m_matches_kept)
+        return;
+    if(m_matches.size() == MaxKeptMatches) {
+        // Too many to be worth keeping; a longer query will search again
+        m_matches_kept = false;
+        std::vector<Match>().swap(m_matches);
+    } else {
+        m_matches.push_back({row_it, col});
+    }
+}
+
+/**Runs as a job; checks the old query's matches, then searches the rest of
+   the buffer*/
+void MatchCounter::count_matches(std::vector<Match> candidates)
+{
+    for(std::size_t i = 0; i < candidates.size(); ++i) {
+        if(m_counting.cancelled())
+            return;
+        const auto &candidate = candidates[i];
+        const auto &text = m_query.text();
+        if(candidate.row_it->size() - candidate.col >= text.size()
+           && std::memcmp(candidate.row_it->data() + candidate.col, text.data(),
+                          text.size()) == 0)
+            add_match(candidate.row_it, candidate.col);
+    }
+    m_candidates_checked = true;
+    for(; m_next_row != m_buffer.end(); ++m_next_row) {
+        if(m_counting.cancelled())
+            return;
+        m_query.for_each_match(m_next_row->data(), m_next_row->size(),
+                               [this](std::size_t start, std::size_t) {
+                                   add_match(m_next_row, start);
+                               });
+    }
+    m_done = true;
+}
@@ -0,0 +1,122 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include "buffer.h"
+#include "regex.h"
+#include "jobs.h"
+
+/**Pointer to the first occurrence of needle within [text, text + len), or
+   nullptr if there is none. Candidates are found 16 bytes at a time by
+   comparing the needle's first and last bytes (using SSE2 where available)
+   and only then checked in full*/
+const char* find_literal(const char *text, std::size_t len, std::string_view needle);
+
+/**Text to search for, either as is or as a regular expression*/
+class Query {
+public:
+    Query() = default;
+    Query(std::string text, bool is_regex);
+    Query(const Query &other) : Query(other.m_text, other.is_regex()) {}
+    Query(Query&&) = default;
+    Query& operator=(Query other);
+
+    const std::string& text() const { return m_text; }
+    bool is_regex() const { return m_regex != nullptr; }
+    bool empty() const { return m_text.empty(); }
+    /**What is wrong with the regular expression, if anything*/
+    std::string error() const { return is_regex() ? m_regex->error() : std::string(); }
+    /**Finds the first match starting in [from, limit) of a row's text, which
+       is len bytes long, or an empty regular expression match at limit;
+       matches running past limit may be missed*/
+    bool find(const char *text, std::size_t len, std::size_t from, std::size_t limit,
+              std::size_t &start, std::size_t &end);
+    /**Calls on_match(start, end) for each match in a row's text; matches of
+       literal text may overlap, while regular expression matches don't*/
+    template<typename Callback>
+    void for_each_match(const char *text, std::size_t len, Callback on_match);
+private:
+    std::string m_text;
+    std::unique_ptr<Regex> m_regex;
+};
+
+template<typename Callback>
+void Query::for_each_match(const char *text, std::size_t len, Callback on_match)
+{
+    if(is_regex()) {
+        m_regex->for_each_match(text, len, on_match);
+        return;
+    }
+    if(m_text.empty())
+        return;
+    const char *found = text;
+    while((found = find_literal(found, text + len - found, m_text)) != nullptr) {
+        on_match(found - text, found - text + m_text.size());
+        ++found;
+    }
+}
+
+/**A place in the buffer*/
+struct Position {
+    Buffer::const_iterator row_it;
+    std::size_t row;
+    std::size_t col;
+};
+
+/**The first match of query at or after start, wrapping around to the
+   start of the buffer if needed; returns false if there is none*/
+bool find_next(const Buffer &buffer, const Position &start, Query &query,
+               Position &match);
+
+/**Counts the matches of query in a snapshot of the buffer, and how many of
+   them start before (row, col); gives up and returns false once token is
+   cancelled*/
+bool locate_match(const Snapshot &rows, Query &query, std::size_t row, std::size_t col,
+                  const CancelToken &token, std::size_t &before, std::size_t &total);
+
+/**Counts the matches of a query in the buffer as a Search job. Where they
+   were found is kept, so when literal text is extended (e.g. while it is
+   being typed) only those places need checking again. The buffer must not
+   change while a count is running*/
+class MatchCounter {
+public:
+    MatchCounter(const Buffer &buffer, JobScheduler &jobs)
+        : m_buffer(buffer), m_jobs(jobs) {}
+    ~MatchCounter() { stop(); }
+    MatchCounter(const MatchCounter&) = delete;
+    MatchCounter& operator=(const MatchCounter&) = delete;
+
+    /**Stops any count in progress and starts counting query*/
+    void start(const Query &query);
+    void stop();
+    std::size_t count() const { return m_count; }
+    bool done() const { return m_done; }
+private:
+    struct Match {
+        Buffer::const_iterator row_it;
+        std::size_t col;
+    };
+
+    const Buffer &m_buffer;
+    JobScheduler &m_jobs;
+    Query m_query;
+    // Where the matches counted so far are, if m_matches_kept (it isn't
+    // when there were too many to keep or the count was stopped partway)
+    std::vector<Match> m_matches;
+    bool m_matches_kept = false;
+    // The first row that hasn't been searched yet
+    Buffer::const_iterator m_next_row;
+    std::atomic<std::size_t> m_count{0};
+    std::atomic<bool> m_done{true};
+    // Set once the old query's matches have been checked again; until
+    // then, they are only in the running job's hands
+    std::atomic<bool> m_candidates_checked{true};
+    CancelToken m_counting;
+
+    void count_matches(std::vector<Match> candidates);
+    void add_match(Buffer::const_iterator row_it, std::size_t col);
+};
+#endif
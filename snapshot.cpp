@@ -0,0 +1,199 @@
+#include "snapshot.h"
+#include <atomic>
+#include <iterator>
+#include <algorithm>
+
+/**Makes node safe to change: left alone if nothing else can reach it,
+   otherwise replaced by a copy (which shares its children)*/
+static RowNode& writable(std::shared_ptr<RowNode> &node)
+{
+    if(node.use_count() == 1) {
+        // Pairs with the release when a reader on another thread let go
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } else {
+        node = std::make_shared<RowNode>(*node);
+    }
+    return *node;
+}
+
+/**The child of a (non-leaf) node that holds the row at index, with index
+   changed to be relative to that child; rows past the end count as in the
+   last child*/
+template<typename Node>
+static std::size_t child_holding(const Node &node, std::size_t &index)
+{
+    // Checked first since appending (e.g. while loading) always ends up there
+    const std::size_t last = node.children.size() - 1;
+    const std::size_t last_start = node.rows - node.children[last]->rows;
+    if(index >= last_start) {
+        index -= last_start;
+        return last;
+    }
+    std::size_t child = 0;
+    while(index >= node.children[child]->rows) {
+        index -= node.children[child]->rows;
+        ++child;
+    }
+    return child;
+}
+
+/**Moves the entries of an overfull node from first onwards into a new node,
+   returned so it can be added after the node*/
+static std::shared_ptr<RowNode> split(RowNode &node, std::size_t first)
+{
+    auto sibling = std::make_shared<RowNode>();
+    // Room for the node to fill up without the vectors growing past that
+    if(node.is_leaf()) {
+        sibling->texts.reserve(RowNode::MaxEntries + 1);
+        const auto rest = node.texts.begin() + first;
+        sibling->texts.assign(std::make_move_iterator(rest),
+                              std::make_move_iterator(node.texts.end()));
+        node.texts.erase(rest, node.texts.end());
+        sibling->rows = sibling->texts.size();
+    } else {
+        sibling->children.reserve(RowNode::MaxEntries + 1);
+        const auto rest = node.children.begin() + first;
+        sibling->children.assign(std::make_move_iterator(rest),
+                                 std::make_move_iterator(node.children.end()));
+        node.children.erase(rest, node.children.end());
+        for(const auto &child : sibling->children)
+            sibling->rows += child->rows;
+    }
+    node.rows -= sibling->rows;
+    return sibling;
+}
+
+/**Where to split a node that has just grown too big by adding an entry at
+   the given position. Nodes filled by appending are left full, rather than
+   half full, since nothing more is likely to go in them*/
+static std::size_t split_point(std::size_t size, std::size_t added)
+{
+    return added + 1 == size ? added : size / 2;
+}
+
+/**Inserts text as row index under node; returns the new node made by
+   splitting it, if it got too big*/
+static std::shared_ptr<RowNode> insert_into(std::shared_ptr<RowNode> &node_ptr,
+                                            std::size_t index, RowText &&text)
+{
+    auto &node = writable(node_ptr);
+    if(node.is_leaf()) {
+        ++node.rows;
+        node.texts.insert(node.texts.begin() + index, std::move(text));
+        const auto size = node.texts.size();
+        return size > RowNode::MaxEntries ? split(node, split_point(size, index)) : nullptr;
+    }
+    const auto child = child_holding(node, index);
+    ++node.rows;
+    auto sibling = insert_into(node.children[child], index, std::move(text));
+    if(sibling == nullptr)
+        return nullptr;
+    node.children.insert(node.children.begin() + child + 1, std::move(sibling));
+    const auto size = node.children.size();
+    return size > RowNode::MaxEntries ? split(node, split_point(size, child + 1)) : nullptr;
+}
+
+/**Removes row index from under node*/
+static void erase_from(std::shared_ptr<RowNode> &node_ptr, std::size_t index)
+{
+    auto &node = writable(node_ptr);
+    if(node.is_leaf()) {
+        --node.rows;
+        node.texts.erase(node.texts.begin() + index);
+        return;
+    }
+    const auto child = child_holding(node, index);
+    --node.rows;
+    erase_from(node.children[child], index);
+    // Nodes are allowed to be underfull, but not empty
+    if(node.children[child]->rows == 0)
+        node.children.erase(node.children.begin() + child);
+}
+
+const RowText& Snapshot::row(std::size_t index) const
+{
+    const RowNode *node = m_root.get();
+    while(!node->is_leaf())
+        node = node->children[child_holding(*node, index)].get();
+    return node->texts[index];
+}
+
+RowText PersistentRows::set(std::size_t index, RowText text)
+{
+    auto *node_ptr = &m_root;
+    while(!writable(*node_ptr).is_leaf()) {
+        auto &node = **node_ptr;
+        node_ptr = &node.children[child_holding(node, index)];
+    }
+    std::swap((*node_ptr)->texts[index], text);
+    return text;
+}
+
+bool PersistentRows::release(std::size_t index)
+{
+    // A snapshot that can see the row holds one of the nodes on its path
+    if(m_root.use_count() > 1)
+        return false;
+    RowNode *node = m_root.get();
+    while(!node->is_leaf()) {
+        const auto &child = node->children[child_holding(*node, index)];
+        if(child.use_count() > 1)
+            return false;
+        node = child.get();
+    }
+    // Pairs with the release when a reader on another thread let go
+    std::atomic_thread_fence(std::memory_order_acquire);
+    node->texts[index] = RowText();
+    return true;
+}
+
+void PersistentRows::insert(std::size_t index, RowText text)
+{
+    auto sibling = insert_into(m_root, index, std::move(text));
+    if(sibling != nullptr) {
+        // The root was split, so the tree grows a level
+        auto root = std::make_shared<RowNode>();
+        root->rows = m_root->rows + sibling->rows;
+        root->children.push_back(std::move(m_root));
+        root->children.push_back(std::move(sibling));
+        m_root = std::move(root);
+    }
+}
+
+void PersistentRows::erase(std::size_t index)
+{
+    erase_from(m_root, index);
+    // Drop levels left with a single child
+    while(m_root->children.size() == 1) {
+        auto child = m_root->children.front();
+        m_root = std::move(child);
+    }
+}
+
+void PersistentRows::append(std::vector<RowText> &texts)
+{
+    std::vector<RowNode*> path;
+    for(std::size_t next = 0; next < texts.size();) {
+        path.clear();
+        auto *node = &writable(m_root);
+        while(!node->is_leaf()) {
+            path.push_back(node);
+            node = &writable(node->children.back());
+        }
+        const auto count = std::min(texts.size() - next,
+                                    RowNode::MaxEntries - node->texts.size());
+        if(count == 0) {
+            // The last leaf is full; this splits off a new one to fill
+            insert(size(), std::move(texts[next++]));
+            continue;
+        }
+        const auto first = texts.begin() + next;
+        node->texts.insert(node->texts.end(), std::make_move_iterator(first),
+                           std::make_move_iterator(first + count));
+        node->rows += count;
+        for(auto *parent : path)
+            parent->rows += count;
+        next += count;
+    }
+    texts.clear();
+}
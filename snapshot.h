@@ -0,0 +1,87 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include "row-text.h"
+
+/**A node of the persistent tree that buffer versions are made of. Leaves
+   hold the text of up to MaxEntries rows and other nodes up to MaxEntries
+   children; each node knows how many rows are under it, so a row is found
+   by index in O(log n). A node that more than one version can reach is
+   never changed: an edit copies the nodes on its path instead*/
+struct RowNode {
+    static constexpr std::size_t MaxEntries = 64;
+
+    std::size_t rows = 0;
+    std::vector<std::shared_ptr<RowNode>> children;
+    std::vector<RowText> texts;
+
+    bool is_leaf() const { return children.empty(); }
+};
+
+/**The rows of a buffer as they were at some point. Taking one costs O(1)
+   and it never changes afterwards, so it can be read on any thread while
+   the buffer goes on being edited; only the parts of the tree (and the
+   rows) edited since are kept twice*/
+class Snapshot {
+public:
+    Snapshot() = default;
+    Snapshot(std::shared_ptr<const RowNode> root, std::uint64_t version)
+        : m_root(std::move(root)), m_version(version) {}
+
+    std::size_t size() const { return m_root != nullptr ? m_root->rows : 0; }
+    /**Counts edits made to the buffer, so snapshots can be told apart*/
+    std::uint64_t version() const { return m_version; }
+    const RowText& row(std::size_t index) const;
+    /**Calls visit(text) for each row in order until it returns false;
+       returns false if it was stopped*/
+    template<typename Visit>
+    bool for_each_row(Visit visit) const
+    {
+        return m_root == nullptr || visit_rows(*m_root, visit);
+    }
+private:
+    std::shared_ptr<const RowNode> m_root;
+    std::uint64_t m_version = 0;
+
+    template<typename Visit>
+    static bool visit_rows(const RowNode &node, Visit &visit)
+    {
+        for(const auto &text : node.texts) {
+            if(!visit(text))
+                return false;
+        }
+        for(const auto &child : node.children) {
+            if(!visit_rows(*child, visit))
+                return false;
+        }
+        return true;
+    }
+};
+
+/**The latest version of a buffer's rows, kept up to date edit by edit.
+   Nodes that no snapshot can see are changed in place, so edits only
+   allocate while an older version is still being read*/
+class PersistentRows {
+public:
+    PersistentRows() : m_root(std::make_shared<RowNode>()) {}
+
+    std::size_t size() const { return m_root->rows; }
+    /**Replaces a row's text, returning the text it had*/
+    RowText set(std::size_t index, RowText text);
+    /**Lets go of a row's text (leaving it empty until set() again) if no
+       snapshot can see it, so the row's owner can change it in place;
+       returns whether it could*/
+    bool release(std::size_t index);
+    void insert(std::size_t index, RowText text);
+    void erase(std::size_t index);
+    /**Moves texts to the end as rows, filling the last leaf directly rather
+       than looking for it once per row*/
+    void append(std::vector<RowText> &texts);
+    Snapshot snapshot(std::uint64_t version) const { return {m_root, version}; }
+private:
+    std::shared_ptr<RowNode> m_root;
+};
+#endif
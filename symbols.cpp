@@ -0,0 +1,142 @@
+#include "symbols.h"
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+
+bool SymbolIndex::scan(const Snapshot &rows, const CancelToken &token,
+                       Contents &contents) const
+{
+    contents.symbols.clear();
+    contents.rows.clear();
+    contents.rows.reserve(rows.size());
+    return rows.for_each_row([&](const RowText &text) {
+        if(token.cancelled())
+            return false;
+        const auto before = contents.symbols.size();
+        m_mode.symbols(text.data(), text.data() + text.size(), contents.symbols);
+        contents.rows.push_back({contents.symbols.size() - before});
+        return true;
+    });
+}
+
+void SymbolIndex::assign(Contents contents)
+{
+    if(m_built)
+        return;
+    m_symbols = std::move(contents.symbols);
+    m_rows.assign(contents.rows);
+    m_built = true;
+}
+
+void SymbolIndex::update(Buffer::RowChange change, std::size_t row, const BufferRow &text)
+{
+    if(!m_built)
+        return;
+    m_found.clear();
+    if(change != Buffer::RowChange::Erased)
+        m_mode.symbols(text.data(), text.data() + text.size(), m_found);
+    const std::size_t old_count = change != Buffer::RowChange::Inserted
+        ? m_rows.row(row).count : 0;
+    if(old_count > 0 || !m_found.empty()) {
+        // Swap the row's old symbols for the new ones
+        const auto start = m_symbols.begin() + m_rows.prefix(row).count;
+        const auto common = std::min(old_count, m_found.size());
+        std::move(m_found.begin(), m_found.begin() + common, start);
+        if(old_count > common)
+            m_symbols.erase(start + common, start + old_count);
+        else
+            m_symbols.insert(start + common, std::make_move_iterator(m_found.begin() + common),
+                             std::make_move_iterator(m_found.end()));
+    }
+    switch(change) {
+    case Buffer::RowChange::Inserted:
+        m_rows.insert(row, {m_found.size()});
+        break;
+    case Buffer::RowChange::Changed:
+        if(old_count != m_found.size())
+            m_rows.set(row, {m_found.size()});
+        break;
+    case Buffer::RowChange::Erased:
+        m_rows.erase(row);
+        break;
+    }
+}
+
+std::size_t SymbolIndex::row_of(std::size_t index) const
+{
+    return m_rows.find_next(0, [index](SymbolCount before, SymbolCount run) {
+        return before.count + run.count > index;
+    });
+}
+
+std::vector<std::size_t> SymbolIndex::filter(std::string_view query,
+                                             const std::vector<std::size_t> *within) const
+{
+    std::vector<std::size_t> matches;
+    if(query.empty()) {
+        // Every symbol matches, in order
+        if(within != nullptr)
+            return *within;
+        for(std::size_t index = 0; index < m_symbols.size(); ++index)
+            matches.push_back(index);
+        return matches;
+    }
+    std::vector<std::pair<int, std::size_t>> scored;
+    const auto consider = [&](std::size_t index) {
+        const int score = fuzzy_score(m_symbols[index].name, query);
+        if(score >= 0)
+            scored.emplace_back(-score, index);
+    };
+    if(within != nullptr) {
+        for(const auto index : *within)
+            consider(index);
+    } else {
+        for(std::size_t index = 0; index < m_symbols.size(); ++index)
+            consider(index);
+    }
+    std::sort(scored.begin(), scored.end());
+    matches.reserve(scored.size());
+    for(const auto &[score, index] : scored)
+        matches.push_back(index);
+    return matches;
+}
+
+/**Whether byte i of a name starts a word in it, e.g. the 'i' in "find_it",
+   "Index" or "Buffer::insert"*/
+static bool starts_word(std::string_view name, std::size_t i)
+{
+    if(i == 0)
+        return true;
+    const auto before = static_cast<unsigned char>(name[i - 1]);
+    const auto letter = static_cast<unsigned char>(name[i]);
+    return !std::isalnum(before) || (std::islower(before) && std::isupper(letter));
+}
+
+int fuzzy_score(std::string_view name, std::string_view query)
+{
+    int score = 0;
+    // Where the letter after the last one found would be
+    std::size_t next = 0;
+    for(std::size_t i = 0; i < query.size(); ++i) {
+        const auto wanted = std::tolower(static_cast<unsigned char>(query[i]));
+        // Take the first place the letter is next to the last one or starts
+        // a word, or else just the first place it is
+        std::size_t found = std::string_view::npos;
+        for(std::size_t j = next; j < name.size(); ++j) {
+            if(std::tolower(static_cast<unsigned char>(name[j])) != wanted)
+                continue;
+            if(found == std::string_view::npos)
+                found = j;
+            if((i > 0 && j == next) || starts_word(name, j)) {
+                found = j;
+                break;
+            }
+        }
+        if(found == std::string_view::npos)
+            return -1;
+        score += 1 + (i > 0 && found == next ? 4 : 0) + (starts_word(name, found) ? 3 : 0);
+        next = found + 1;
+    }
+    // Shorter names are closer matches
+    return score * 64 + std::max(0, 63 - static_cast<int>(name.size()));
+}
@@ -0,0 +1,70 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+#include <cstddef>
+#include <string_view>
+#include <vector>
+#include "buffer.h"
+#include "jobs.h"
+#include "row-tree.h"
+#include "syntax-highlight.h"
+
+/**How many symbols are declared in a run of rows*/
+struct SymbolCount {
+    std::size_t count = 0;
+
+    friend SymbolCount operator+(SymbolCount first, SymbolCount second)
+    {
+        return {first.count + second.count};
+    }
+};
+
+/**The symbols declared in a buffer (by its mode's symbols()), in the order
+   they appear. How many are on each row is kept in a RowTree, so that an
+   edited row's symbols can be found and rescanned without touching the
+   rest, and the row a symbol is on found in O(log n). Scanning the whole
+   buffer can be done on a worker thread, from a snapshot*/
+class SymbolIndex {
+public:
+    /**What scan() finds, to be handed to assign()*/
+    struct Contents {
+        std::vector<Symbol> symbols;
+        std::vector<SymbolCount> rows;
+    };
+
+    explicit SymbolIndex(const HighlightMode &mode) : m_mode(mode) {}
+    /**Whether the mode has symbols to find*/
+    bool enabled() const { return m_mode.symbols != nullptr; }
+    bool built() const { return m_built; }
+    /**Finds the symbols in every row; false if the token was cancelled
+       first. Only reads the snapshot, so it is safe to call from a job*/
+    bool scan(const Snapshot &rows, const CancelToken &token, Contents &contents) const;
+    /**Starts keeping track of the symbols scan() found, if that hasn't
+       been done yet; the buffer mustn't have changed since the snapshot*/
+    void assign(Contents contents);
+    /**Keeps the index up to date with an edit to the buffer; given to
+       Buffer::on_change()*/
+    void update(Buffer::RowChange change, std::size_t row, const BufferRow &text);
+
+    const std::vector<Symbol>& symbols() const { return m_symbols; }
+    /**The row symbols()[index] is on*/
+    std::size_t row_of(std::size_t index) const;
+    /**The symbols (as indices into symbols()) among within (or among all
+       of them, if it is null) whose names fuzzily match query, best first
+       and otherwise in order*/
+    std::vector<std::size_t> filter(std::string_view query,
+                                    const std::vector<std::size_t> *within = nullptr) const;
+private:
+    const HighlightMode &m_mode;
+    std::vector<Symbol> m_symbols;
+    RowTree<SymbolCount> m_rows;
+    bool m_built = false;
+    // Reused for the symbols on a row as it is rescanned
+    std::vector<Symbol> m_found;
+};
+
+/**How well query matches a name when its letters are found in order
+   (ignoring case) but not necessarily next to each other, e.g. "bfind" in
+   "BracketIndex::find": higher for letters next to the one before and at
+   the starts of words. -1 if the letters aren't all there*/
+int fuzzy_score(std::string_view name, std::string_view query);
+#endif
@@ -1,6 +1,9 @@
 #include <string_view>
 #include <string> // for std::char_traits
+#include <algorithm>
+#include <cctype>
 #include "syntax-highlight.h"
+#include "buffer.h"
 #include "cpp_matcher.h"
 #include "mips_matcher.h"
 
@@ -20,16 +23,59 @@ static void highlight(Screen &window, int col, int row, int length, Color fg)
     }
 }
 
+LexState lex_state_at(const HighlightMode &mode, const BufferRow &row,
+                      LexState start, std::size_t col)
+{
+    constexpr auto Interval = BufferRow::CheckpointInterval;
+    if(mode.scan == nullptr)
+        return 0;
+    if(col < Interval)
+        // Near the start of the row; quicker to just scan
+        return mode.scan(start, row.data(), row.data() + col);
+
+    auto &checkpoints = row.lex_checkpoints();
+    auto &tail = row.lex_tail();
+    if(checkpoints.empty() || checkpoints[0] != start) {
+        // Cached states were computed from a different starting state
+        checkpoints.assign(1, start);
+        tail.valid = false;
+    }
+    if(col == row.size() && tail.valid && tail.offset < col) {
+        // Text from the tail's offset on is as it was when the end state
+        // was found, so if the state there is too, so is the end state
+        if(lex_state_at(mode, row, start, tail.offset) == tail.state)
+            return tail.end;
+        tail.valid = false;
+    }
+    while(checkpoints.size() <= col / Interval) {
+        const char *from = row.data() + (checkpoints.size() - 1) * Interval;
+        checkpoints.push_back(mode.scan(checkpoints.back(), from, from + Interval));
+    }
+    const std::size_t nearest = col / Interval;
+    const LexState state = mode.scan(checkpoints[nearest], row.data() + nearest * Interval,
+                                     row.data() + col);
+    if(col == row.size())
+        tail = {col, state, state, true};
+    return state;
+}
+
 /**Default highlighting mode; highlights nothing*/
-void text_mode(Screen&, int, int) {}
+static void highlight_text(Screen&, const LexState*, int) {}
+
+const HighlightMode text_mode{highlight_text, nullptr, 0, nullptr, nullptr, nullptr,
+                              nullptr};
+
+// Markdown lexer state
+constexpr LexState InInlineCode = 1;
 
 /**Highlights some features of markdown files, including '*', '#', and
    inline code */
-void markdown_mode(Screen &window, int, int end_row)
+static void highlight_markdown(Screen &window, const LexState *row_states,
+                               int end_row)
 {
-    bool in_inline_code = false;
     const int width = window.width();
     for(int row = 0; row < end_row; ++row) {
+        bool in_inline_code = row_states[row] & InInlineCode;
 	for(int col = 0; col < width; ++col) {
 	    auto character = window.get(col, row);
 	    switch(character) {
@@ -55,16 +101,43 @@ void markdown_mode(Screen &window, int, int end_row)
     }
 }
 
+static LexState scan_markdown(LexState state, const char *first, const char *last)
+{
+    for(; first != last; ++first) {
+        if(*first == '`')
+            state ^= InInlineCode;
+    }
+    return state;
+}
+
+/**Titles are rows starting with 1 to 6 '#'s then a space, at that level*/
+static int heading_markdown(const char *first, const char *last)
+{
+    int level = 0;
+    for(; first != last && *first == '#' && level <= 6; ++first)
+        ++level;
+    return level <= 6 && (first == last || *first == ' ' || *first == '\t') ? level : 0;
+}
+
+const HighlightMode markdown_mode{highlight_markdown, scan_markdown, InInlineCode, nullptr,
+                                  heading_markdown, nullptr, nullptr};
+
+// C++ lexer state; the pending flags mean the last character might begin
+// a "/*" or "*/" depending on the character after it
+constexpr LexState InString = 1;
+constexpr LexState InComment = 2;
+constexpr LexState PendingSlash = 4;
+constexpr LexState PendingStar = 8;
+
 /**Highlights some of the common keywords and types of C++, as well as
-   the text within string/character literals. start_row is the index of
-   the row in the buffer at the top of the screen*/
-void cpp_mode(Screen &window, int, int end_row)
+   the text within string/character literals*/
+static void highlight_cpp(Screen &window, const LexState *row_states, int end_row)
 {
     const int width = window.width();
-    bool in_string = false;
-    bool in_comment = false;
 
     for(int row = 0; row < end_row; ++row) {
+        bool in_string = row_states[row] & InString;
+        bool in_comment = row_states[row] & InComment;
 	int col = 0;
 	while(col < width) {
 	    auto character = window.get(col, row);
@@ -108,8 +181,317 @@ void cpp_mode(Screen &window, int, int end_row)
     }
 }
 
+/**Follows the same rules as highlight_cpp() for one character*/
+static LexState step_cpp(LexState state, char character)
+{
+    if(state & PendingSlash) {
+        state &= ~PendingSlash;
+        if(character == '*')
+            // Opening of multi-line comment
+            return state | InComment;
+    } else if(state & PendingStar) {
+        state &= ~PendingStar;
+        if(character == '/')
+            // Closing of multi-line comment
+            return state & ~InComment;
+    }
+
+    if(character == '"')
+        state ^= InString;
+    else if(state & InString)
+        return state;
+    else if(character == '/')
+        state |= PendingSlash;
+    else if(character == '*')
+        state |= PendingStar;
+    return state;
+}
+
+static LexState scan_cpp(LexState state, const char *first, const char *last)
+{
+    for(; first != last; ++first)
+        state = step_cpp(state, *first);
+    return state;
+}
+
+static BracketSpan brackets_cpp(LexState state, const char *first, const char *last,
+                                std::vector<std::size_t> *found)
+{
+    BracketSpan span;
+    for(const char *pos = first; pos != last; ++pos) {
+        if(*pos == '/' && (state & PendingSlash) && !(state & InComment)) {
+            // The rest of the row is a "//" comment (which the highlighter
+            // doesn't color)
+            span.end_state = state & ~PendingSlash;
+            return span;
+        }
+        if((state & InString) && *pos == '\\' && last - pos >= 2) {
+            // An escaped character (e.g. \") doesn't end the string
+            ++pos;
+            continue;
+        }
+        state = step_cpp(state, *pos);
+        if(state & (InString | InComment))
+            continue;
+        switch(*pos) {
+        case '\'':
+            // Skip character literals (e.g. '{'), which the highlighter
+            // doesn't know about, but not digit separators (e.g. 1'000)
+            if(last - pos >= 3 && pos[2] == '\'' && pos[1] != '\\')
+                pos += 2;
+            else if(last - pos >= 4 && pos[1] == '\\' && pos[3] == '\'')
+                pos += 3;
+            break;
+        case '(':
+        case '[':
+        case '{':
+            ++span.depth;
+            if(found != nullptr)
+                found->push_back(pos - first);
+            break;
+        case ')':
+        case ']':
+        case '}':
+            span.min_depth = std::min(span.min_depth, --span.depth);
+            if(found != nullptr)
+                found->push_back(pos - first);
+            break;
+        }
+    }
+    span.end_state = state;
+    return span;
+}
+
+static bool is_name_char(char letter)
+{
+    return std::isalnum(static_cast<unsigned char>(letter)) || letter == '_';
+}
+
+static const char* skip_spaces(const char *pos, const char *last)
+{
+    while(pos != last && (*pos == ' ' || *pos == '\t'))
+        ++pos;
+    return pos;
+}
+
+/**The keyword (as match_cpp() highlights it) at pos and its color, or an
+   empty view if there is none; keywords are only matched as whole words*/
+static std::string_view keyword_at(const char *pos, const char *last, Color &color)
+{
+    const auto [is_match, match_color, len] = match_cpp_text(pos, last);
+    if(!is_match || !is_name_char(*pos))
+        return {};
+    const std::string_view keyword(pos, len);
+    if(is_name_char(keyword.back()) && pos + len != last && is_name_char(pos[len]))
+        return {};
+    color = match_color;
+    return keyword;
+}
+
+/**Whether the parameters of a function declared on a row (its text after
+   the '(') look like declarations, e.g. "int count" or "const Row &row",
+   rather than the arguments of a variable's constructor, e.g. "count, 0"
+   or "*mode"*/
+static bool declares_parameters(const char *pos, const char *last)
+{
+    pos = skip_spaces(pos, last);
+    if(pos == last || *pos == ')')
+        return true;
+    int words = 0;
+    // Template arguments (e.g. "std::function<void(int)>") are skipped
+    int angle_depth = 0;
+    for(; pos != last && ((*pos != ',' && *pos != ')') || angle_depth > 0); ++pos) {
+        if(*pos == '<' || *pos == '>') {
+            angle_depth += *pos == '<' ? 1 : -1;
+        } else if(angle_depth > 0) {
+            continue;
+        } else if(is_name_char(*pos)) {
+            // A qualified name (e.g. "std::string") is one word
+            if(pos + 1 == last || (!is_name_char(pos[1]) && pos[1] != ':'))
+                ++words;
+        } else if((*pos == '*' || *pos == '&') && words > 0) {
+            return true;
+        } else if(*pos != ' ' && *pos != '\t' && *pos != ':') {
+            // Part of an expression (e.g. "m_data->size()"), or else a
+            // default argument (e.g. "int count = 0")
+            return words >= 2;
+        }
+    }
+    return words >= 2;
+}
+
+/**Whether the rest of a row after what looks like a function's '(' is the
+   rest of a declaration: parameters going on to the next row, or ones
+   followed by e.g. " const {", " override;" or " : m_mode(mode)", rather
+   than by more words (as in a sentence of a comment)*/
+static bool declares_function(const char *pos, const char *last)
+{
+    int depth = 1;
+    for(; pos != last && depth > 0; ++pos) {
+        if(*pos == '(')
+            ++depth;
+        else if(*pos == ')')
+            --depth;
+    }
+    const std::string_view rest(pos, last - pos);
+    const auto end = rest.substr(0, rest.find("//")).find_last_not_of(" \t");
+    if(depth > 0)
+        return end != rest.npos && (rest[end] == ',' || rest[end] == '(');
+    pos = skip_spaces(pos, last);
+    while(pos != last && is_name_char(*pos)) {
+        const char *word = pos;
+        while(pos != last && is_name_char(*pos))
+            ++pos;
+        const std::string_view qualifier(word, pos - word);
+        if(qualifier != "const" && qualifier != "override" && qualifier != "final"
+           && qualifier != "noexcept")
+            return false;
+        pos = skip_spaces(pos, last);
+    }
+    return pos == last || *pos == '{' || *pos == ';' || *pos == ':' || *pos == '='
+        || (last - pos >= 2 && (pos[1] == '/' || pos[1] == '>') && (*pos == '/' || *pos == '-'));
+}
+
+/**Finds the class, struct, enum or macro defined on a row, or the function
+   declared on it: a (possibly qualified) name after a type, e.g. "static
+   int main(", or a qualified one on an unindented row, e.g.
+   "Buffer::Buffer(". Rows are looked at one at a time, so the rows of a
+   multi-line comment are told apart from code by how they start or read,
+   and a variable constructed with arguments that look like parameters is
+   taken for a function*/
+static void symbols_cpp(const char *first, const char *last, std::vector<Symbol> &found)
+{
+    const char *pos = skip_spaces(first, last);
+    if(pos == last || *pos == '*' || (last - pos >= 2 && pos[0] == '/'
+                                      && (pos[1] == '/' || pos[1] == '*')))
+        return;
+    const bool indented = pos != first;
+    const auto name_end = [last](const char *name) {
+        while(name != last && is_name_char(*name))
+            ++name;
+        return name;
+    };
+    const auto add = [&](Symbol::Kind kind, const char *name, const char *end) {
+        found.push_back({kind, std::string(name, end), std::size_t(name - first)});
+    };
+    if(*pos == '#') {
+        const auto [is_match, color, len] = match_cpp_text(pos, last);
+        (void)color;
+        if(!is_match || std::string_view(pos, len) != "#define")
+            return;
+        const char *name = skip_spaces(pos + len, last);
+        if(name != pos + len && name != name_end(name))
+            add(Symbol::Kind::Macro, name, name_end(name));
+        return;
+    }
+    // The (possibly qualified) name seen last, and how many names came
+    // before it (its type, if it is a function)
+    const char *name = nullptr;
+    const char *name_last = nullptr;
+    bool qualified = false;
+    bool after_scope = false;
+    int types = 0;
+    while(pos != last) {
+        if(is_name_char(*pos)) {
+            Color color;
+            const auto keyword = keyword_at(pos, last, color);
+            if(keyword == "class " || keyword == "struct " || keyword == "enum ") {
+                const auto kind = keyword == "enum " ? Symbol::Kind::Enum
+                    : Symbol::Kind::Class;
+                const char *type = skip_spaces(pos + keyword.size(), last);
+                const auto scoped = keyword_at(type, last, color);
+                if(kind == Symbol::Kind::Enum && (scoped == "class " || scoped == "struct "))
+                    type = skip_spaces(type + scoped.size(), last);
+                const char *type_end = name_end(type);
+                const char *after = skip_spaces(type_end, last);
+                // Only a definition, not a declaration or a variable (e.g.
+                // "struct stat info;")
+                const bool defined = after == last || *after == '{'
+                    || (*after == ':' && (after + 1 == last || after[1] != ':'));
+                if(type != type_end && defined)
+                    add(kind, type, type_end);
+                return;
+            }
+            if(!keyword.empty() && color == KeywordColor && keyword != "const "
+               && keyword != "constexpr " && keyword != "auto ")
+                // A statement (e.g. "return f(x);") or a label
+                return;
+            if(!after_scope) {
+                if(name != nullptr)
+                    ++types;
+                name = pos;
+                qualified = false;
+            } else {
+                qualified = true;
+            }
+            after_scope = false;
+            pos = name_last = name_end(pos);
+            continue;
+        }
+        switch(*pos) {
+        case '(': {
+            const bool is_function = name != nullptr && !after_scope
+                && skip_spaces(name_last, last) == pos && (types > 0 || (qualified && !indented));
+            if(!is_function)
+                return;
+            // A variable constructed with arguments (e.g. "Index index(rows);")
+            // looks like a function's declaration, except for the arguments
+            const std::string_view rest(pos, last - pos);
+            const bool declaration = rest.find(';') != rest.npos;
+            if(declares_function(pos + 1, last)
+               && (!declaration || declares_parameters(pos + 1, last)))
+                add(Symbol::Kind::Function, name, name_last);
+            return;
+        }
+        case ':':
+            if(pos + 1 == last || pos[1] != ':')
+                return;
+            after_scope = true;
+            pos += 2;
+            continue;
+        case '<': {
+            if(pos + 1 != last && pos[1] == '<')
+                // An expression (e.g. "out << f(x)")
+                return;
+            // Skip template arguments, e.g. "std::vector<int> f(" or
+            // "RowTree<Summary>::row("
+            int depth = 0;
+            do {
+                if(*pos == '<')
+                    ++depth;
+                else if(*pos == '>')
+                    --depth;
+                else if(*pos == '(' || *pos == ';' || *pos == '{')
+                    return;
+                ++pos;
+            } while(pos != last && depth > 0);
+            if(depth > 0)
+                return;
+            continue;
+        }
+        case '~':
+            // A destructor's name (e.g. "Buffer::~Buffer")
+            if(!after_scope)
+                return;
+            break;
+        case ' ':
+        case '\t':
+        case '*':
+        case '&':
+        case ',':
+            break;
+        default:
+            return;
+        }
+        ++pos;
+    }
+}
+
+const HighlightMode cpp_mode{highlight_cpp, scan_cpp, InString | InComment, brackets_cpp,
+                             nullptr, match_cpp_words, symbols_cpp};
+
 /**Highlights most instructions/registers of the MIPS-32 assembly language*/
-void mips_mode(Screen &window, int, int end_row)
+static void highlight_mips(Screen &window, const LexState*, int end_row)
 {
     const int width = window.width();
 
@@ -126,3 +508,16 @@ void mips_mode(Screen &window, int, int end_row)
         }
     }
 }
+
+/**Rows starting with a label (e.g. "main:") start a section*/
+static int heading_mips(const char *first, const char *last)
+{
+    const char *pos = first;
+    while(pos != last && (std::isalnum(static_cast<unsigned char>(*pos))
+                          || *pos == '_' || *pos == '.' || *pos == '$'))
+        ++pos;
+    return pos != first && pos != last && *pos == ':' ? 1 : 0;
+}
+
+const HighlightMode mips_mode{highlight_mips, nullptr, 0, nullptr, heading_mips,
+                              match_mips_words, nullptr};
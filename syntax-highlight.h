@@ -1,21 +1,92 @@
 #ifndef SYNTAX_HIGHLIGHT_H
 #define SYNTAX_HIGHLIGHT_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
 #include "screen.h"
 
-void text_mode(Screen&, int, int);
+class BufferRow;
 
-void markdown_mode(Screen &window, int start, int end);
+/**What a highlighting mode remembers from one character to the next (e.g.
+   whether it is inside a string); 0 is the state at the top of the screen*/
+using LexState = unsigned char;
+
+/**How the brackets in some text nest: depth is how many more were opened
+   than closed, min_depth the lowest the depth got relative to the start
+   (so never above 0), and end_state the state after the text*/
+struct BracketSpan {
+    std::int32_t depth = 0;
+    std::int32_t min_depth = 0;
+    LexState end_state = 0;
+};
+
+/**Something declared in a row that can be jumped to by name*/
+struct Symbol {
+    enum class Kind : char {
+        Function,
+        // A class or struct
+        Class,
+        Enum,
+        Macro
+    };
+    Kind kind;
+    std::string name;
+    // The offset of the name in the row
+    std::size_t col;
+};
+
+/**A highlighting mode colors the text onscreen. Modes that track state
+   across characters can also compute that state from the buffer itself,
+   so that highlighting can start partway into a line*/
+struct HighlightMode {
+    /**Colors the first end_row rows onscreen; row_states[row] is the state
+       at the left edge of that row*/
+    void (*highlight)(Screen &window, const LexState *row_states, int end_row);
+    /**Advances the state over some text; nullptr if the mode has no state*/
+    LexState (*scan)(LexState state, const char *first, const char *last);
+    /**The parts of the state that carry over from one line to the next*/
+    LexState carried;
+    /**Follows the brackets ()[]{} in some text, given the state at its
+       start, skipping any in strings and comments; if found isn't null, the
+       offset of each bracket that counted is added to it. nullptr if the
+       mode doesn't match brackets*/
+    BracketSpan (*brackets)(LexState state, const char *first, const char *last,
+                            std::vector<std::size_t> *found);
+    /**The level of the heading a row starts with (e.g. a markdown title),
+       or 0 if it doesn't start with one; each heading's section runs up to
+       the next heading of the same or a higher level. nullptr if the mode
+       has no headings*/
+    int (*heading)(const char *first, const char *last);
+    /**The words the mode highlights, offered as completions, ending with
+       nullptr; nullptr if it has none*/
+    const char *const *keywords;
+    /**Adds the symbols declared in a row to found, looking at the row by
+       itself (so that rows can be rescanned one at a time as they change);
+       nullptr if the mode has none*/
+    void (*symbols)(const char *first, const char *last, std::vector<Symbol> &found);
+};
+
+/**The state at byte col of the row, given the state at its start. Long rows
+   cache the state at regular checkpoints, so this only has to scan from the
+   nearest checkpoint before col*/
+LexState lex_state_at(const HighlightMode &mode, const BufferRow &row,
+                      LexState start, std::size_t col);
+
+extern const HighlightMode text_mode;
+
+extern const HighlightMode markdown_mode;
 constexpr Color ItalicColor = Color::Yellow;
 constexpr Color TitleColor = Color::Blue;
 constexpr Color InlineCodeColor = Color::Green;
 
-void cpp_mode(Screen &window, int start_row, int end_row);
+extern const HighlightMode cpp_mode;
 constexpr Color KeywordColor = Color::Cyan;
 constexpr Color TypeColor = Color::Yellow;
 constexpr Color PreprocessorColor = Color::Magenta;
 constexpr Color StringColor = Color::Green;
 
-void mips_mode(Screen &window, int, int end_row);
+extern const HighlightMode mips_mode;
 constexpr Color RegColor = Color::Green;
 constexpr Color InstructColor = Color::Cyan;
 #endif
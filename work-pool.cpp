@@ -0,0 +1,107 @@
+#include "work-pool.h"
+
+// The pool (if any) that the current thread belongs to, and its queue there
+static thread_local WorkPool *current_pool = nullptr;
+static thread_local std::size_t current_queue = 0;
+
+WorkPool::WorkPool()
+{
+    const std::size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+    for(std::size_t i = 0; i < thread_count; ++i)
+        m_queues.push_back(std::make_unique<Queue>());
+    for(std::size_t i = 0; i < thread_count; ++i)
+        m_threads.emplace_back(&WorkPool::run, this, i);
+}
+
+WorkPool::~WorkPool()
+{
+    stop();
+}
+
+void WorkPool::push(Task task)
+{
+    const auto index = current_pool == this
+        ? current_queue : m_next_queue++ % m_queues.size();
+    ++m_unfinished;
+    {
+        // Counted before the task can be seen, so a thread taking it can't
+        // bring the count below zero; taken so a thread can't miss this
+        // while deciding to sleep
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        ++m_queued;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back(std::move(task));
+    }
+    m_wakeup.notify_one();
+}
+
+void WorkPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_stopping = true;
+    }
+    m_wakeup.notify_all();
+    for(auto &thread : m_threads) {
+        if(thread.joinable())
+            thread.join();
+    }
+    for(auto &queue : m_queues) {
+        m_unfinished -= queue->tasks.size();
+        queue->tasks.clear();
+    }
+    m_queued = 0;
+}
+
+void WorkPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_sleep_mutex);
+    m_finished.wait(lock, [this]{ return m_unfinished == 0; });
+}
+
+/**Takes the newest task from the thread's own queue, or else the oldest from
+   another's; returns false if every queue is empty*/
+bool WorkPool::take(std::size_t index, Task &task)
+{
+    const auto count = m_queues.size();
+    for(std::size_t i = 0; i < count; ++i) {
+        auto &queue = *m_queues[(index + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.tasks.empty())
+            continue;
+        if(i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        --m_queued;
+        return true;
+    }
+    return false;
+}
+
+void WorkPool::run(std::size_t index)
+{
+    current_pool = this;
+    current_queue = index;
+    Task task;
+    while(!m_stopping) {
+        if(take(index, task)) {
+            task();
+            // Let go of whatever the task held on to
+            task = nullptr;
+            if(--m_unfinished == 0) {
+                // Taken so wait() can't miss this while deciding to sleep
+                std::lock_guard<std::mutex> lock(m_sleep_mutex);
+                m_finished.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_wakeup.wait(lock, [this]{ return m_stopping || m_queued > 0; });
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+/**Runs tasks on one thread per core. Each thread has its own queue: it
+   runs the tasks it added itself newest first (while what they work on is
+   still in its cache), and when its queue runs dry it steals the oldest
+   task from another thread's queue. Tasks may add more tasks*/
+class WorkPool {
+public:
+    using Task = std::function<void()>;
+
+    WorkPool();
+    /**Stops the pool, dropping any tasks not yet started*/
+    ~WorkPool();
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    /**Queues a task; from one of the pool's threads, it goes on that
+       thread's own queue*/
+    void push(Task task);
+    /**True when no tasks are queued or running*/
+    bool idle() const { return m_unfinished == 0; }
+    /**Blocks until every task (including any they add) has finished*/
+    void wait();
+    /**Drops the tasks not yet started and waits for the rest to finish*/
+    void stop();
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    // Tasks queued but not started yet, and those plus the running ones
+    std::atomic<std::size_t> m_queued{0};
+    std::atomic<std::size_t> m_unfinished{0};
+    // Where tasks pushed from outside the pool go next
+    std::atomic<std::size_t> m_next_queue{0};
+    std::atomic<bool> m_stopping{false};
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_finished;
+
+    void run(std::size_t index);
+    bool take(std::size_t index, Task &task);
+};
+#endif